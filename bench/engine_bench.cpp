@@ -0,0 +1,182 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "common.h"
+#include "reactor.h"
+
+// Compares the throughput of the server engines on this machine. For every engine it starts the server, connects
+// `clients` sessions and runs `messages` rounds in which each session sends one line of `payload` bytes; every line
+// is fanned out to the other sessions, and a round ends once all of them have been delivered. One JSON object is
+// printed per engine.
+//
+// usage: engine_bench [clients] [messages] [payload] [threads]
+
+namespace {
+
+	/**
+	 * @brief Starts the server executable with `engine` on `port`, its output discarded.
+	 * @returns The process id of the server.
+	 */
+	pid_t startServer(const int port, const char* engine, const int threads)
+	{
+		const char* binary = std::getenv("BEEJ_SERVER") ? std::getenv("BEEJ_SERVER") : SERVER_BINARY;
+		pid_t pid = ::fork();
+
+		if (pid == 0) {
+			int devNull = ::open("/dev/null", O_WRONLY);
+			::dup2(devNull, STDOUT_FILENO);
+			::execl(binary, "server", std::to_string(port).c_str(), engine, std::to_string(threads).c_str(), nullptr);
+			std::_Exit(127);
+		}
+
+		return pid;
+	}
+
+	/**
+	 * @brief Connects to the server on localhost, retrying while it is starting up.
+	 * @returns The connected socket; `-1` if the server never came up.
+	 */
+	int connectTo(const int port)
+	{
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((unsigned short)port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		for (int attempt = 0; attempt < 200; attempt++) {
+			int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+			if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+				return fd;
+
+			::close(fd);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		return -1;
+	}
+
+	/**
+	 * @brief Reads from `fd` until the welcome prompt ("> ") has been received.
+	 */
+	void readWelcome(const int fd)
+	{
+		std::string welcome;
+		char buf[256];
+
+		while (!welcome.ends_with("> ")) {
+			ssize_t rd = ::recv(fd, buf, sizeof(buf), 0);
+
+			if (rd <= 0)
+				return;
+
+			welcome.append(buf, (size_t)rd);
+		}
+	}
+
+	/**
+	 * @brief Runs the workload against one engine and prints the result.
+	 */
+	void run(const char* engine, const int port, const int clients, const int messages, const int payload, const int threads)
+	{
+		pid_t server = startServer(port, engine, threads);
+
+		std::vector<int> sockets;
+		for (int i = 0; i < clients; i++) {
+			int fd = connectTo(port);
+
+			if (fd == -1) {
+				std::cerr << std::format("[bench] Could not connect to the {} server\n", engine);
+				::kill(server, SIGKILL);
+				::waitpid(server, nullptr, 0);
+				return;
+			}
+
+			readWelcome(fd);
+			sockets.push_back(fd);
+		}
+
+		// every line reaches each of the other sessions once, prefixed by "\b\b"
+		const uint64_t expected = (uint64_t)clients * messages * (clients - 1);
+		std::atomic<uint64_t> delivered = 0;
+		std::atomic<bool> done = false;
+
+		std::thread receiver([&]() {
+			std::unique_ptr<m0st4fa::Reactor> reactor = m0st4fa::Reactor::create();
+			std::vector<m0st4fa::ReactorEvent> events(256);
+			std::vector<char> buf(1 << 16);
+			uint64_t backspaces = 0;
+
+			for (int fd : sockets)
+				reactor->add(fd, m0st4fa::Reactor::READABLE);
+
+			while (!done && backspaces / 2 < expected) {
+				int ready = reactor->wait(events, 100);
+
+				for (int i = 0; i < ready; i++) {
+					ssize_t rd = ::recv(events[i].fd, buf.data(), buf.size(), MSG_DONTWAIT);
+
+					for (ssize_t j = 0; j < rd; j++)
+						backspaces += buf[j] == '\b';
+				}
+
+				delivered = backspaces / 2;
+			}
+			});
+
+		std::string line(payload, 'x');
+		line += "\r\n";
+
+		auto begin = std::chrono::steady_clock::now();
+		auto deadline = begin + std::chrono::seconds(60);
+
+		for (int m = 0; m < messages && std::chrono::steady_clock::now() < deadline; m++) {
+			for (int fd : sockets)
+				m0st4fa::ConnectionInformation::send(fd, line);
+
+			// wait for the fan-out of this round to complete (or give up after a while)
+			const uint64_t roundEnd = (uint64_t)clients * (m + 1) * (clients - 1);
+			while (delivered < roundEnd && std::chrono::steady_clock::now() < deadline)
+				std::this_thread::yield();
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		done = true;
+		receiver.join();
+
+		for (int fd : sockets)
+			::close(fd);
+
+		// the server's CPU time tells how much work each engine needs for the same traffic
+		rusage usage{};
+		::kill(server, SIGTERM);
+		::wait4(server, nullptr, 0, &usage);
+
+		double userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+		double systemSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+		std::cout << std::format(
+			"{{\"benchmark\": \"engine\", \"engine\": \"{}\", \"threads\": {}, \"clients\": {}, \"messages\": {}, \"payload\": {}, \"delivered\": {}, \"expected\": {}, "
+			"\"seconds\": {}, \"deliveries_per_second\": {}, \"server_user_seconds\": {}, \"server_system_seconds\": {}}}\n",
+			engine, threads, clients, messages, payload, (uint64_t)delivered, expected,
+			seconds, (uint64_t)(delivered / seconds), userSeconds, systemSeconds);
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	m0st4fa::setupWinsock();
+
+	int clients = argc > 1 ? std::atoi(argv[1]) : 20;
+	int messages = argc > 2 ? std::atoi(argv[2]) : 1000;
+	int payload = argc > 3 ? std::atoi(argv[3]) : 64;
+	int threads = argc > 4 ? std::atoi(argv[4]) : 1;
+
+	run("reactor", 4100, clients, messages, payload, threads);
+	run("uring", 4101, clients, messages, payload, threads);
+
+	return 0;
+}
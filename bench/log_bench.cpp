@@ -0,0 +1,197 @@
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <filesystem>
+#include <thread>
+#include <vector>
+#include "framing.h"
+#include "logger.h"
+#include "message_log.h"
+
+// Measures the durable message log (see `MessageLog`) on the disk holding `directory`. First, the latency of a message
+// that waits for its own sync. Then, for every commit policy, `threads` threads append `messages` messages of
+// `payload` bytes as the broadcast path does, without letting more than half of `MessageLog::MAX_PENDING` wait for the
+// disk; it prints the cost of an append, the throughput of durable messages, and how many syncs it took and how long
+// they lasted. Last, it measures reading back the end of the log on startup, through the sparse index, against
+// reading all of it. One JSON object is printed per result.
+//
+// usage: log_bench [directory] [messages] [payload] [threads]
+
+namespace {
+
+	/**
+	 * @brief A broadcast frame of `payload` from `sender`, as the server builds it.
+	 */
+	m0st4fa::Frame buildFrame(const int sender, const std::string_view payload)
+	{
+		m0st4fa::PooledString frame;
+		frame.resize(m0st4fa::FrameHeader::SIZE);
+		m0st4fa::FrameHeader{ (uint32_t)payload.size(), m0st4fa::MessageType::MESSAGE, (uint32_t)sender }.encode(frame.data());
+
+		char number[16];
+		char* numberEnd = std::to_chars(number, number + sizeof(number), sender).ptr;
+		frame.append(payload).append("\b\b").append(number, numberEnd).append(": ").append(payload).append("\r\n> ");
+
+		return m0st4fa::makeFrame(std::move(frame));
+	}
+
+	/**
+	 * @brief Appends the messages to a fresh log in `directory` with `policy`, then closes it and prints the results.
+	 */
+	void benchCommit(const std::string& name, m0st4fa::LogPolicy policy, const size_t messages, const size_t payloadSize, const size_t threads)
+	{
+		std::filesystem::remove_all(policy.directory);
+
+		m0st4fa::MessageLog log;
+		if (!log.open(policy))
+			return;
+
+		std::string payload(payloadSize, 'x');
+		std::atomic<uint64_t> appendNanoseconds{ 0 };
+		std::vector<std::thread> producers;
+
+		auto begin = std::chrono::steady_clock::now();
+
+		for (size_t t = 0; t < threads; t++)
+			producers.emplace_back([&, t]() {
+				constexpr size_t BATCH = 256; // appends timed together
+				size_t count = messages / threads;
+				uint64_t spent = 0;
+
+				for (size_t i = 0; i < count; i += BATCH) {
+					// keeps clear of the bound on the messages waiting, so none is dropped
+					m0st4fa::LogStats stats = log.stats();
+					while (stats.appended - stats.committed > m0st4fa::MessageLog::MAX_PENDING / 2) {
+						std::this_thread::yield();
+						stats = log.stats();
+					}
+
+					size_t batch = std::min(BATCH, count - i);
+					std::vector<m0st4fa::Frame> frames;
+
+					for (size_t j = 0; j < batch; j++)
+						frames.push_back(buildFrame((int)t, payload));
+
+					auto appendBegin = std::chrono::steady_clock::now();
+
+					for (m0st4fa::Frame& frame : frames)
+						log.append("lobby", std::move(frame));
+
+					spent += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - appendBegin).count();
+				}
+
+				appendNanoseconds += spent;
+				});
+
+		for (std::thread& producer : producers)
+			producer.join();
+
+		// closing commits the rest, so every message is durable once it returns
+		log.close();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		m0st4fa::LogStats stats = log.stats();
+
+		std::cout << std::format(
+			"{{\"benchmark\": \"log\", \"name\": \"{}\", \"commit_messages\": {}, \"commit_interval_ms\": {}, \"threads\": {}, \"messages\": {}, \"dropped\": {}, "
+			"\"append_ns\": {:.1f}, \"durable_messages_per_second\": {}, \"mib_per_second\": {:.1f}, \"commits\": {}, \"messages_per_commit\": {:.1f}, "
+			"\"mean_sync_us\": {:.1f}, \"max_sync_us\": {:.1f}}}\n",
+			name, policy.commitMessages, policy.commitInterval.count(), threads, stats.committed, stats.dropped,
+			(double)appendNanoseconds.load() / (double)std::max<uint64_t>(stats.appended, 1), (uint64_t)((double)stats.committed / seconds),
+			(double)stats.bytes / seconds / (1024 * 1024), stats.commits, (double)stats.committed / (double)std::max<uint64_t>(stats.commits, 1),
+			(double)stats.syncNanoseconds / 1e3 / (double)std::max<uint64_t>(stats.commits, 1), (double)stats.maxSyncNanoseconds / 1e3);
+	}
+
+	/**
+	 * @brief Appends `messages` messages one at a time from a single thread, each waiting until it is durable: the cost of a sync when nothing shares it.
+	 */
+	void benchLatency(const std::string& name, m0st4fa::LogPolicy policy, const size_t messages, const size_t payloadSize)
+	{
+		std::filesystem::remove_all(policy.directory);
+
+		m0st4fa::MessageLog log;
+		if (!log.open(policy))
+			return;
+
+		std::string payload(payloadSize, 'x');
+		auto begin = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < messages; i++) {
+			log.append("lobby", buildFrame(0, payload));
+
+			while (log.stats().committed <= i)
+				std::this_thread::yield();
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		log.close();
+
+		m0st4fa::LogStats stats = log.stats();
+
+		std::cout << std::format(
+			"{{\"benchmark\": \"log\", \"name\": \"{}\", \"messages\": {}, \"commits\": {}, \"durable_latency_us\": {:.1f}, \"mean_sync_us\": {:.1f}, \"max_sync_us\": {:.1f}}}\n",
+			name, stats.committed, stats.commits, seconds * 1e6 / (double)messages,
+			(double)stats.syncNanoseconds / 1e3 / (double)std::max<uint64_t>(stats.commits, 1), (double)stats.maxSyncNanoseconds / 1e3);
+	}
+
+	/**
+	 * @brief Reopens the log left in `directory` and reads back its last `count` messages, as the server does on startup.
+	 */
+	void benchRestore(const std::string& name, const m0st4fa::LogPolicy& policy, const size_t count)
+	{
+		auto begin = std::chrono::steady_clock::now();
+
+		m0st4fa::MessageLog log;
+		if (!log.open(policy))
+			return;
+
+		auto opened = std::chrono::steady_clock::now();
+		uint64_t bytes = 0;
+
+		size_t read = log.readRecent(count, [&](const m0st4fa::MessageLog::Record& record) {
+			bytes += record.payload.size();
+			});
+
+		auto end = std::chrono::steady_clock::now();
+
+		std::cout << std::format(
+			"{{\"benchmark\": \"log\", \"name\": \"{}\", \"messages\": {}, \"open_ms\": {:.2f}, \"read_ms\": {:.2f}, \"payload_bytes\": {}}}\n",
+			name, read, std::chrono::duration<double, std::milli>(opened - begin).count(), std::chrono::duration<double, std::milli>(end - opened).count(), bytes);
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	std::string directory = argc > 1 ? argv[1] : (std::filesystem::temp_directory_path() / "log_bench").string();
+	size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+	size_t payload = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 64;
+	size_t threads = std::max<size_t>(argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 4, 1);
+
+	m0st4fa::LogPolicy policy;
+	policy.directory = directory;
+	policy.segmentSize = 8 * 1024 * 1024;
+
+	// a sync as soon as anything is waiting, against group commit
+	policy.commitMessages = 1;
+	policy.commitInterval = std::chrono::milliseconds{ 1 };
+	benchLatency("sync.single", policy, 200, payload);
+	benchCommit("commit.eager", policy, messages, payload, threads);
+
+	policy.commitMessages = 1024;
+	policy.commitInterval = std::chrono::milliseconds{ 10 };
+	benchCommit("commit.group.10ms", policy, messages, payload, threads);
+
+	policy.commitMessages = 8192;
+	policy.commitInterval = std::chrono::milliseconds{ 50 };
+	benchCommit("commit.group.50ms", policy, messages, payload, threads);
+
+	// the log left by the last run
+	benchRestore("restore.recent", policy, policy.restoreCount);
+	benchRestore("restore.all", policy, messages);
+
+	std::filesystem::remove_all(directory);
+	m0st4fa::Logger::global().flush();
+
+	return 0;
+}
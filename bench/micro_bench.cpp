@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <sys/socket.h>
+#include "common.h"
+#include "framing.h"
+#include "logger.h"
+#include "outbound.h"
+#include "pool.h"
+#include "slab.h"
+#include "timing_wheel.h"
+
+// Measures the hot paths of the server in isolation: framing received bytes into lines and frames, building a broadcast
+// frame and fanning it out over socketpairs, calling a message handler per recipient (through `std::function` against a
+// statically dispatched handler), the connection tables under churn, the timing wheel with 100k timers, and logging
+// (formatting on the calling thread against queueing for the logger.) Every benchmark runs `REPEATS` times after a
+// warm-up run; one JSON object with the median and the best time per operation is printed per benchmark, so that
+// results can be compared across changes. A last object has the counters of the buffer pool, which every frame and
+// output queue draws from.
+//
+// usage: micro_bench [filter] (only the benchmarks whose name contains `filter` run)
+
+namespace {
+
+	constexpr int REPEATS = 7;
+
+	/**
+	 * @brief Keeps the compiler from optimizing away the computation of `value`.
+	 */
+	template <typename T>
+	void keep(const T& value)
+	{
+		asm volatile("" : : "g"(&value) : "memory");
+	}
+
+	/**
+	 * @brief Times `fn`, which performs `ops` operations per call, and prints the result unless `name` is filtered out. `reset` (if any) runs before every call, untimed.
+	 */
+	void measure(const std::string_view filter, const std::string_view name, const uint64_t ops, const std::function<void()>& fn, const std::function<void()>& reset = {})
+	{
+		if (!name.contains(filter))
+			return;
+
+		if (reset)
+			reset();
+
+		fn();
+
+		std::vector<double> nsPerOp;
+
+		for (int r = 0; r < REPEATS; r++) {
+			if (reset)
+				reset();
+
+			auto begin = std::chrono::steady_clock::now();
+			fn();
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+
+			nsPerOp.push_back(ns / (double)ops);
+		}
+
+		std::sort(nsPerOp.begin(), nsPerOp.end());
+		double median = nsPerOp[REPEATS / 2];
+
+		std::cout << std::format(
+			"{{\"benchmark\": \"micro\", \"name\": \"{}\", \"ops\": {}, \"repeats\": {}, \"ns_per_op\": {:.2f}, \"best_ns_per_op\": {:.2f}, \"ops_per_second\": {}}}\n",
+			name, ops, REPEATS, median, nsPerOp.front(), (uint64_t)(1e9 / median));
+	}
+
+	/**
+	 * @brief Formats a log message on the calling thread, with a prefix and `std::vformat` at runtime (the way the server logged before it had a `Logger`.)
+	 */
+	template <typename... Args>
+	std::string formatNow(const std::string_view msg, const Args&... args)
+	{
+		std::string temp = "[server] ";
+		temp += msg;
+		return std::vformat(temp, std::make_format_args(args...));
+	}
+
+	/**
+	 * @brief `lines` lines of `length` bytes (with "\r\n") as a telnet client sends them.
+	 */
+	std::string makeLines(const size_t lines, const size_t length)
+	{
+		std::string line(length - 2, 'x');
+		line += "\r\n";
+
+		std::string stream;
+		for (size_t i = 0; i < lines; i++)
+			stream += line;
+
+		return stream;
+	}
+
+	/**
+	 * @brief `frames` binary message frames of `length` bytes of payload.
+	 */
+	std::string makeFrames(const size_t frames, const size_t length)
+	{
+		std::string frame(m0st4fa::FrameHeader::SIZE, '\0');
+		m0st4fa::FrameHeader{ (uint32_t)length, m0st4fa::MessageType::MESSAGE, 0 }.encode(frame.data());
+		frame.append(length, 'x');
+
+		std::string stream;
+		for (size_t i = 0; i < frames; i++)
+			stream += frame;
+
+		return stream;
+	}
+
+	/**
+	 * @brief Feeds `stream` to a line buffer in receive-sized chunks and consumes every line (or frame.)
+	 */
+	template <bool FRAMES>
+	void parse(m0st4fa::LineBuffer& buffer, const std::string_view stream)
+	{
+		constexpr size_t CHUNK = 1500; // about a segment per receive
+
+		for (std::string_view rest = stream; !rest.empty();) {
+			rest.remove_prefix(buffer.append(rest.substr(0, CHUNK)));
+
+			if constexpr (FRAMES) {
+				m0st4fa::FrameHeader header;
+				std::string_view payload;
+
+				while (buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::COMPLETE)
+					keep(payload);
+			}
+			else {
+				std::string_view line;
+
+				while (buffer.nextLine(line))
+					keep(line);
+			}
+		}
+	}
+
+	/**
+	 * @brief Builds a broadcast frame the way the server does: binary header and payload, then "\b\b<fd>: <payload>\r\n> ".
+	 */
+	m0st4fa::Frame buildFrame(const int sender, const std::string_view payload)
+	{
+		m0st4fa::PooledString frame;
+		frame.reserve(m0st4fa::FrameHeader::SIZE + 32 + 2 * payload.size());
+
+		frame.resize(m0st4fa::FrameHeader::SIZE);
+		m0st4fa::FrameHeader{ (uint32_t)payload.size(), m0st4fa::MessageType::MESSAGE, (uint32_t)sender }.encode(frame.data());
+
+		char number[16];
+		char* numberEnd = std::to_chars(number, number + sizeof(number), sender).ptr;
+		frame.append(payload).append("\b\b").append(number, numberEnd).append(": ").append(payload).append("\r\n> ");
+
+		return m0st4fa::makeFrame(std::move(frame));
+	}
+
+	/**
+	 * @brief Fans one frame per round out to `recipients` socketpairs through their output queues, and drains the other ends.
+	 */
+	void benchFanOut(const std::string_view filter, const size_t recipients)
+	{
+		constexpr size_t ROUNDS = 200;
+
+		std::vector<std::array<int, 2>> pairs(recipients);
+		std::vector<m0st4fa::OutputQueue> queues(recipients);
+
+		for (auto& pair : pairs) {
+			::socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data());
+			m0st4fa::setNonBlocking(pair[0]);
+		}
+
+		std::string payload(64, 'x');
+		std::vector<char> sink(1 << 16);
+
+		measure(filter, std::format("fanout.socketpair.{}", recipients), ROUNDS * recipients, [&]() {
+			for (size_t round = 0; round < ROUNDS; round++) {
+				m0st4fa::Frame frame = buildFrame(5, payload);
+				std::string_view text = std::string_view{ *frame }.substr(m0st4fa::FrameHeader::SIZE + payload.size());
+
+				for (size_t i = 0; i < recipients; i++) {
+					queues[i].append(frame, m0st4fa::FrameHeader::SIZE + payload.size(), text.size());
+					queues[i].flush(pairs[i][0]);
+				}
+
+				for (auto& pair : pairs)
+					while (::recv(pair[1], sink.data(), sink.size(), MSG_DONTWAIT) > 0);
+			}
+			});
+
+		for (auto& pair : pairs) {
+			::close(pair[0]);
+			::close(pair[1]);
+		}
+	}
+
+	/**
+	 * @brief Calls `handler` for every recipient the way the server does when it has a message handler (see `Server::_fan_out`), with the output of each recipient going to a string instead of its socket.
+	 */
+	template <typename Handler>
+	void fanOutTo(std::vector<std::string>& outputs, Handler& handler, const std::string_view msg)
+	{
+		for (size_t sock = 0; sock < outputs.size(); sock++) {
+			outputs[sock].append("\b\b");
+			handler((int)sock, msg);
+			outputs[sock].append("\r\n> ");
+		}
+	}
+
+	/**
+	 * @brief Fans messages out to `recipients` through a handler that echoes the message, called through `std::function` and then directly.
+	 */
+	void benchHandler(const std::string_view filter, const size_t recipients)
+	{
+		constexpr size_t ROUNDS = 200;
+
+		std::vector<std::string> outputs(recipients);
+		std::string payload(64, 'x');
+
+		auto echo = [&outputs](const int sock, const std::string_view msg) {
+			outputs[sock].append(msg);
+			};
+
+		std::function<void(const int, std::string_view)> erased = echo;
+
+		auto run = [&](auto& handler) {
+			for (size_t round = 0; round < ROUNDS; round++) {
+				for (std::string& output : outputs)
+					output.clear();
+
+				fanOutTo(outputs, handler, payload);
+			}
+			};
+
+		measure(filter, std::format("handler.function.{}", recipients), ROUNDS * recipients, [&]() { run(erased); });
+		measure(filter, std::format("handler.static.{}", recipients), ROUNDS * recipients, [&]() { run(echo); });
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	std::string_view filter = argc > 1 ? argv[1] : "";
+
+	// framing
+	{
+		constexpr size_t LINES = 10000;
+		m0st4fa::LineBuffer buffer;
+
+		for (size_t length : { 16, 64, 512 }) {
+			std::string lines = makeLines(LINES, length);
+			measure(filter, std::format("framing.lines.{}", length), LINES, [&]() { parse<false>(buffer, lines); });
+
+			std::string frames = makeFrames(LINES, length);
+			measure(filter, std::format("framing.frames.{}", length), LINES, [&]() { parse<true>(buffer, frames); });
+		}
+	}
+
+	// building a broadcast frame (pooled buffer and reference count)
+	{
+		constexpr size_t FRAMES = 10000;
+		std::string payload(64, 'x');
+
+		measure(filter, "frame.build.64", FRAMES, [&]() {
+			for (size_t i = 0; i < FRAMES; i++)
+				keep(buildFrame((int)i, payload));
+			});
+	}
+
+	// fan-out
+	for (size_t recipients : { 16, 256 })
+		benchFanOut(filter, recipients);
+
+	// message handlers
+	for (size_t recipients : { 16, 256 })
+		benchHandler(filter, recipients);
+
+	// connection tables under churn: a full table where random connections leave and new ones take their descriptors
+	{
+		constexpr size_t CONNECTIONS = 1024;
+		constexpr size_t CHURN = 100000;
+
+		std::mt19937 random{ 42 };
+		std::vector<int> victims(CHURN);
+		for (int& fd : victims)
+			fd = (int)(random() % CONNECTIONS);
+
+		m0st4fa::Sockets sockets;
+		for (size_t fd = 0; fd < CONNECTIONS; fd++)
+			sockets.add((int)fd, POLLIN);
+
+		measure(filter, "sockets.churn", CHURN, [&]() {
+			for (int fd : victims) {
+				sockets.remove(fd);
+				sockets.add(fd, POLLIN);
+			}
+			});
+
+		struct Record {
+			uint64_t data[8]{};
+		};
+
+		m0st4fa::Slab<Record> slab;
+		for (size_t fd = 0; fd < CONNECTIONS; fd++)
+			slab.insert((int)fd);
+
+		measure(filter, "slab.churn", CHURN, [&]() {
+			for (int fd : victims) {
+				slab.erase(fd);
+				keep(slab.insert(fd));
+			}
+			});
+
+		measure(filter, "slab.find", CHURN, [&]() {
+			for (int fd : victims)
+				keep(slab.find(fd));
+			});
+	}
+
+	// timers: 100k connections with an idle timer each, rearmed as they send (cancel and arm), then a full turn of the wheel expiring them all
+	{
+		constexpr size_t TIMERS = 100000;
+		using Clock = m0st4fa::TimingWheel::Clock;
+
+		std::mt19937 random{ 42 };
+		std::vector<size_t> senders(TIMERS);
+		for (size_t& sender : senders)
+			sender = random() % TIMERS;
+
+		m0st4fa::TimingWheel wheel{ std::chrono::milliseconds{ 100 }, 512 };
+		std::vector<m0st4fa::TimingWheel::TimerId> ids(TIMERS);
+		auto start = Clock::now();
+
+		// a new wheel with the timers spread over a minute
+		auto reset = [&]() {
+			wheel = m0st4fa::TimingWheel{ std::chrono::milliseconds{ 100 }, 512 };
+			start = Clock::now();
+
+			for (size_t i = 0; i < TIMERS; i++)
+				ids[i] = wheel.arm(start + std::chrono::milliseconds{ 1000 + 10 * (i % 6000) }, i);
+			};
+
+		measure(filter, "timers.rearm", TIMERS, [&]() {
+			for (size_t sender : senders) {
+				wheel.cancel(ids[sender]);
+				ids[sender] = wheel.arm(start + std::chrono::seconds{ 30 }, sender);
+			}
+			}, reset);
+
+		measure(filter, "timers.expire", TIMERS, [&]() {
+			size_t expired = wheel.advance(start + std::chrono::hours{ 1 }, [](uint64_t data) { keep(data); });
+			keep(expired);
+			}, reset);
+	}
+
+	// logging; the logger writes to a stream that discards everything, and is drained between runs, so only queueing the messages is timed
+	{
+		constexpr size_t MESSAGES = 10000;
+		std::string_view address = "IP: 127.0.0.1, port: 50000";
+
+		measure(filter, "format.vformat.1", MESSAGES, [&]() {
+			for (size_t i = 0; i < MESSAGES; i++)
+				keep(formatNow("Removed connection {}\n", address));
+			});
+
+		measure(filter, "format.vformat.2", MESSAGES, [&]() {
+			for (size_t i = 0; i < MESSAGES; i++)
+				keep(formatNow("Failed to bind listening socket '{}': {}\n", 4, "Address already in use"));
+			});
+
+		std::ostream discard{ nullptr };
+		m0st4fa::Logger::global().redirect(discard, discard);
+
+		// few enough not to fill half of the ring buffer, which would wake the logger up during the run
+		constexpr size_t RECORDS = 4000;
+
+		measure(filter, "log.queue.1", RECORDS, [&]() {
+			for (size_t i = 0; i < RECORDS; i++)
+				LOG_INFO("server", "Removed connection {}", address);
+			}, [] { m0st4fa::Logger::global().flush(); });
+
+		measure(filter, "log.queue.2", RECORDS, [&]() {
+			for (size_t i = 0; i < RECORDS; i++)
+				LOG_INFO("server", "Failed to bind listening socket '{}': {}", 4, "Address already in use");
+			}, [] { m0st4fa::Logger::global().flush(); });
+
+		measure(filter, "format.std_format", MESSAGES, [&]() {
+			for (size_t i = 0; i < MESSAGES; i++)
+				keep(std::format("{} has disconnected.", (int)i));
+			});
+	}
+
+	// how many of the buffer allocations above the pool has served without the global allocator
+	const m0st4fa::PoolStats& pool = m0st4fa::BufferPool::local().stats();
+
+	std::cout << std::format(
+		"{{\"benchmark\": \"micro\", \"name\": \"pool\", \"hits\": {}, \"misses\": {}, \"recycled\": {}, \"released\": {}, \"transfers\": {}, \"hit_rate\": {:.4f}}}\n",
+		pool.hits, pool.misses, pool.recycled, pool.released, pool.transfers, pool.hitRate());
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include "include/async_client.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Runs `sessions` chat bots on a single thread against a server on localhost. Every bot connects and waits to be welcomed;
+// once every bot has been, each pipelines `messages` messages to the lobby without waiting for anything, and then reads
+// until it has seen the messages of every other bot.
+// Bots that have not finished after `seconds` are cancelled. Prints how many bots finished and how long it took.
+//
+// usage: bots [port] [sessions] [messages] [seconds]
+
+namespace {
+
+	struct Run {
+		std::string marker; // tells the messages of the bots of this run apart from notices, prompts and the history of earlier runs
+		m0st4fa::EventLoop loop;
+		std::vector<std::unique_ptr<m0st4fa::AsyncClient>> clients;
+		int port = 3490;
+		size_t messages = 10;
+		size_t welcomed = 0; // bots that have joined the lobby
+		size_t failed = 0; // bots that could not join it
+		size_t running = 0;
+		size_t finished = 0; // bots that have seen every message
+	};
+
+	m0st4fa::Task<void> bot(Run& run, m0st4fa::AsyncClient& client, const size_t id)
+	{
+		using m0st4fa::IoStatus;
+
+		std::string_view line;
+
+		// the server welcomes a connection once it has joined the lobby
+		IoStatus status = co_await client.connect("localhost", run.port);
+
+		if (status == IoStatus::DONE)
+			status = co_await client.recvLine(line);
+
+		if (status != IoStatus::DONE) {
+			run.failed++;
+			run.running--;
+			co_return;
+		}
+
+		run.welcomed++;
+
+		// a message only reaches the bots that have joined before it
+		while (run.welcomed + run.failed < run.clients.size())
+			co_await run.loop.sleep(std::chrono::milliseconds{ 1 });
+
+		// queued (and mostly sent) before the first is awaited
+		m0st4fa::Task<IoStatus> last = client.sendLine(std::format("{}{} says hello", run.marker, id));
+
+		for (size_t i = 1; i < run.messages; i++)
+			last = client.sendLine(std::format("{}{} says {}", run.marker, id, i));
+
+		status = co_await last;
+
+		size_t expected = (run.welcomed - 1) * run.messages;
+		size_t seen = 0;
+
+		while (status == IoStatus::DONE && seen < expected) {
+			status = co_await client.recvLine(line);
+
+			if (status == IoStatus::DONE && line.find(run.marker) != std::string_view::npos)
+				seen++;
+		}
+
+		run.finished += seen == expected;
+		run.running--;
+	}
+
+	m0st4fa::Task<void> watchdog(Run& run, const std::chrono::seconds timeout)
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+
+		while (run.running > 0 && std::chrono::steady_clock::now() < deadline)
+			co_await run.loop.sleep(std::chrono::milliseconds{ 50 });
+
+		for (auto& client : run.clients)
+			client->cancel();
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	m0st4fa::setupWinsock();
+
+	Run run;
+	run.marker = std::format("bot{:08x}#", std::random_device{}());
+	run.port = argc > 1 ? std::atoi(argv[1]) : 3490;
+	size_t sessions = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+	run.messages = std::max<size_t>(argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 10, 1);
+	std::chrono::seconds timeout{ argc > 4 ? std::atoi(argv[4]) : 10 };
+
+#ifndef _WIN32
+	// every bot takes a descriptor
+	rlimit limit{};
+	if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &limit);
+	}
+#endif
+
+	for (size_t i = 0; i < sessions; i++)
+		run.clients.push_back(std::make_unique<m0st4fa::AsyncClient>(run.loop));
+
+	auto begin = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < sessions; i++)
+		run.loop.spawn(bot(run, *run.clients[i], i));
+
+	run.running = sessions;
+	run.loop.spawn(watchdog(run, timeout));
+	run.loop.run();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	std::cout << std::format("[bots] {} of {} bots finished ({} joined) in {:.3f}s, on one thread\n", run.finished, sessions, run.welcomed, seconds);
+
+	return run.finished == sessions ? 0 : 1;
+}
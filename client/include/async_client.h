@@ -0,0 +1,103 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "event_loop.h"
+#include "framing.h"
+#include "outbound.h"
+#include "task.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief A client connection driven by an `EventLoop`: its operations are coroutines, so one thread can run many clients, each written as straight-line code (`co_await client.connect(...)`, `co_await client.send(...)`, `co_await client.recvLine(line)`.)
+	 *
+	 * Sends are pipelined: `send` queues its bytes (and hands them to the kernel right away, if it can) before it returns, so a coroutine can send several messages and then await them all, or await none of them and only the replies; the bytes still queued are sent whenever the client waits for something. At most one coroutine at a time may receive lines; any number may await sends.
+	 *
+	 * The client must outlive the coroutines that use it.
+	 */
+	class AsyncClient {
+
+		/**
+		 * @brief Waits for the coroutine that waits for the socket to be writable to stop (the loop resumes a single coroutine per direction.)
+		 */
+		struct WriterAwaiter {
+			AsyncClient& client;
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				this->client.mSendWaiters.push_back(handle);
+			}
+
+			void await_resume() const noexcept {
+			}
+		};
+
+		EventLoop& mLoop;
+		int mFd = -1;
+		LineBuffer mInput;
+		OutputQueue mOutput;
+		uint64_t mQueued = 0; // bytes ever queued
+		uint64_t mSent = 0; // bytes ever handed to the kernel
+		IoStatus mStatus = IoStatus::CLOSED; // `DONE` while connected
+		int mError = 0; // why the connection has failed
+		uint64_t mCancellations = 0; // bumped by `cancel`; an operation that sees it change reports that it has been cancelled
+		bool mWriting = false; // a coroutine waits for the socket to be writable
+		std::vector<std::coroutine_handle<>> mSendWaiters; // the other coroutines awaiting sends
+
+		void _fail(const int);
+		void _flush();
+		void _wake_senders();
+		Task<IoStatus> _sent(const uint64_t);
+
+	public:
+
+		static constexpr std::string_view LINE_ENDING = "\r\n";
+
+		explicit AsyncClient(EventLoop& loop) : mLoop{ loop } {
+		}
+
+		AsyncClient(const AsyncClient&) = delete;
+		AsyncClient& operator=(const AsyncClient&) = delete;
+
+		~AsyncClient() {
+			this->close();
+		}
+
+		Task<IoStatus> connect(const std::string, const int);
+		Task<IoStatus> send(const std::string_view);
+		Task<IoStatus> sendLine(const std::string_view);
+		Task<IoStatus> recvLine(std::string_view&);
+		void cancel();
+		void close();
+
+		/**
+		 * @returns The socket of the connection; `-1` if it is not connected.
+		 */
+		int fd() const {
+			return this->mFd;
+		}
+
+		/**
+		 * @returns Why the connection has failed (an error code, see `ConnectionInformation::formatFckingMSErrorMessages`); `0` if it has not.
+		 */
+		int error() const {
+			return this->mError;
+		}
+
+		/**
+		 * @returns The number of bytes queued by `send` that have not been handed to the kernel yet.
+		 */
+		size_t queued() const {
+			return this->mOutput.size();
+		}
+
+	};
+
+}
@@ -8,13 +8,12 @@ namespace m0st4fa {
 		addrinfo* mServerInfo = nullptr;
 
 		int _set_server_address(const std::string, const int serverPort);
-		static std::string _format_client(const std::string_view);
 
 	protected:
 
-		std::string _format(const std::string_view) const override;
-		std::string _format(const std::string_view, const std::string_view) const override;
-		std::string _format(const std::string_view, const std::string_view, const std::string_view) const override;
+		const char* _log_source() const override {
+			return "client";
+		}
 
 	public:
 		Client(const std::string serverAddress = "localhost", const int serverPort = 3490, const int myPort = 3500) : ConnectionInformation() {
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "framing.h"
+#include "histogram.h"
+#include "outbound.h"
+#include "reactor.h"
+#include "slab.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief The workload of a `LoadGenerator`.
+	 */
+	struct LoadOptions {
+		int port = 3490; // of the server on localhost
+		size_t sessions = 100;
+		double rate = 1000; // messages per second, over all sessions
+		std::chrono::seconds duration{ 10 }; // of the measured run
+		std::chrono::seconds warmup{ 1 }; // sending before the measured run, whose latencies are not recorded
+		std::vector<size_t> sizes{ 64 }; // payload sizes, used in turn (a size listed twice is sent twice as often)
+		bool binary = false; // whether the sessions switch to the binary protocol
+		bool compress = false; // whether they also ask for compressed frames (see `DEFLATE_HELLO`); they need `binary`
+	};
+
+	/**
+	 * @brief What a `LoadGenerator` has measured. Only the measured run counts.
+	 */
+	struct LoadReport {
+		size_t connected = 0; // sessions that made it through the handshake
+		uint64_t sent = 0; // messages
+		uint64_t delivered = 0; // messages received by the sessions (each message is delivered to every other session)
+		uint64_t bytes = 0; // received
+		uint64_t compressed = 0; // messages received as `COMPRESSED` frames
+		double seconds = 0;
+		LatencyHistogram latency; // end-to-end, from the send by one session to the receipt by another, in nanoseconds
+	};
+
+	/**
+	 * @brief Drives a local server with many concurrent sessions from a single event loop. Every message carries the time it was sent, so the sessions that receive it measure the end-to-end latency of the fan-out.
+	 */
+	class LoadGenerator {
+
+		struct Session {
+			LineBuffer input;
+			OutputQueue output;
+			bool connected = false;
+			bool ready = false; // connected, and switched to binary frames if the protocol is binary
+			bool writeArmed = false;
+			char nonce[NONCE_SIZE]{};
+		};
+
+		LoadOptions mOptions;
+		std::unique_ptr<Reactor> mReactor = Reactor::create();
+		Slab<Session> mSessions; // indexed by socket
+		std::vector<int> mReady; // sockets of the sessions that may send
+		size_t mNextSender = 0;
+		size_t mNextSize = 0;
+		bool mMeasuring = false;
+		uint64_t mMeasureStart = 0; // messages stamped earlier belong to the warm-up
+		LoadReport mReport{};
+
+		static uint64_t _now();
+
+		void _connect_all();
+		void _send_for(const std::chrono::seconds);
+		void _poll(const int);
+		void _on_writable(const int, Session&);
+		void _on_readable(const int, Session&);
+		void _on_frame(const int, const FrameHeader&, const std::string_view);
+		void _on_message(const std::string_view);
+		void _send_message();
+		void _close(const int);
+
+	public:
+
+		static constexpr std::chrono::seconds CONNECT_TIMEOUT{ 30 };
+		static constexpr std::chrono::seconds DRAIN_TIMEOUT{ 2 }; // to receive the messages still in flight after the run
+		static constexpr size_t MAX_BURST = 4096; // the most messages sent at once to keep up with the rate; a longer stall is not made up for
+
+		explicit LoadGenerator(LoadOptions options) : mOptions{ std::move(options) } {
+		}
+
+		~LoadGenerator();
+
+		LoadReport run();
+
+	};
+
+}
@@ -0,0 +1,73 @@
+#include <cstring>
+#include "include/load_generator.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Stress-tests a server on localhost: `sessions` connections, all in the lobby, send `rate` messages per second in
+// total for `seconds` (after a second of warm-up), cycling through the payload `sizes`. Every message is stamped with
+// the time it was sent, and every other session that receives it records the end-to-end latency. With the deflate
+// protocol, the sessions are binary and ask for compressed frames, so the received bytes show what compression saves.
+// One JSON object with the throughput and the latency percentiles is printed.
+//
+// usage: loadgen [port] [sessions] [rate] [seconds] [sizes, e.g., 64,64,512] [text|binary|deflate]
+
+int main(int argc, char* argv[])
+{
+	m0st4fa::setupWinsock();
+
+	m0st4fa::LoadOptions options;
+	options.port = argc > 1 ? std::atoi(argv[1]) : 3490;
+	options.sessions = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+	options.rate = argc > 3 ? std::atof(argv[3]) : 1000;
+	options.duration = std::chrono::seconds{ argc > 4 ? std::atoi(argv[4]) : 10 };
+	options.compress = argc > 6 && std::strcmp(argv[6], "deflate") == 0;
+	options.binary = options.compress || (argc > 6 && std::strcmp(argv[6], "binary") == 0);
+
+	if (argc > 5) {
+		options.sizes.clear();
+
+		for (const char* size = argv[5]; *size != '\0'; size += std::strcspn(size, ","), size += *size == ',')
+			options.sizes.push_back(std::strtoul(size, nullptr, 10));
+	}
+
+	// a message must fit in the line buffer of the server, with its framing
+	constexpr size_t MAX_SIZE = m0st4fa::LineBuffer::DEFAULT_CAPACITY - m0st4fa::FrameHeader::SIZE - 2;
+
+	for (size_t size : options.sizes) {
+		if (size == 0 || size > MAX_SIZE) {
+			std::cerr << std::format("[loadgen] Message sizes must be between 1 and {}\n", MAX_SIZE);
+			return 1;
+		}
+	}
+
+#ifndef _WIN32
+	// every session takes a descriptor
+	rlimit limit{};
+	if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &limit);
+	}
+#endif
+
+	m0st4fa::LoadGenerator generator{ options };
+	m0st4fa::LoadReport report = generator.run();
+
+	std::string sizes;
+	for (size_t size : options.sizes)
+		sizes += (sizes.empty() ? "" : ",") + std::to_string(size);
+
+	const m0st4fa::LatencyHistogram& latency = report.latency;
+	double seconds = report.seconds > 0 ? report.seconds : 1;
+
+	std::cout << std::format(
+		"{{\"benchmark\": \"loadgen\", \"protocol\": \"{}\", \"sessions\": {}, \"connected\": {}, \"rate\": {}, \"sizes\": \"{}\", \"seconds\": {}, "
+		"\"sent\": {}, \"delivered\": {}, \"compressed\": {}, \"messages_per_second\": {}, \"deliveries_per_second\": {}, \"received_bytes_per_second\": {}, "
+		"\"latency_us\": {{\"mean\": {}, \"p50\": {}, \"p99\": {}, \"p999\": {}, \"max\": {}}}}}\n",
+		options.compress ? "deflate" : options.binary ? "binary" : "text", options.sessions, report.connected, options.rate, sizes, report.seconds,
+		report.sent, report.delivered, report.compressed, (uint64_t)(report.sent / seconds), (uint64_t)(report.delivered / seconds), (uint64_t)(report.bytes / seconds),
+		latency.mean() / 1000, latency.percentile(0.5) / 1000.0, latency.percentile(0.99) / 1000.0, latency.percentile(0.999) / 1000.0, latency.max() / 1000.0);
+
+	return report.connected >= 2 ? 0 : 1;
+}
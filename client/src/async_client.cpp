@@ -0,0 +1,276 @@
+#include "include/async_client.h"
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Connects to `host` on `port`. The name is resolved synchronously (`getaddrinfo`); the connection is established without blocking the loop.
+	 * @param[in] host The name or address of the server.
+	 * @param[in] port The port of the server.
+	 * @returns `DONE` once connected; `FAILED` if the name cannot be resolved or the server cannot be reached; `CANCELLED` if `cancel` has been called meanwhile.
+	 */
+	Task<IoStatus> AsyncClient::connect(const std::string host, const int port)
+	{
+		this->close();
+
+		uint64_t cancellations = this->mCancellations;
+
+		addrinfo hints{};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+
+		addrinfo* info = nullptr;
+		int rv = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &info);
+
+		if (rv != 0) {
+			LOG_WARNING("client", "Could not resolve {}: {}", host, gai_strerrorA(rv));
+			co_return IoStatus::FAILED;
+		}
+
+		int fd = (int)::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+
+		if (fd == -1) {
+			int e = lastSocketError();
+			::freeaddrinfo(info);
+			LOG_WARNING("client", "Could not create a socket: {}", ConnectionInformation::formatFckingMSErrorMessages(e));
+			co_return IoStatus::FAILED;
+		}
+
+		// sends are pipelined and already batched by the output queue; they must not wait for acknowledgements
+		int noDelay = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		setNonBlocking(fd);
+
+		rv = ::connect(fd, info->ai_addr, (socklen_t)info->ai_addrlen);
+		int e = rv == -1 ? lastSocketError() : 0;
+		::freeaddrinfo(info);
+
+		this->mFd = fd;
+		this->mStatus = IoStatus::DONE;
+		this->mError = 0;
+
+		if (rv == -1 && !wouldBlock(e) && e != EINPROGRESS) {
+			this->_fail(e);
+			co_return IoStatus::FAILED;
+		}
+
+		// the socket becomes writable once the connection is established (or has failed)
+		if (rv == -1) {
+			bool ready = co_await this->mLoop.writable(fd);
+
+			if (!ready)
+				co_return IoStatus::CANCELLED;
+		}
+
+		if (this->mCancellations != cancellations)
+			co_return IoStatus::CANCELLED;
+
+		int err = 0;
+		socklen_t length = sizeof(err);
+		::getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&err, &length);
+
+		if (err != 0) {
+			this->_fail(err);
+			co_return IoStatus::FAILED;
+		}
+
+		co_return IoStatus::DONE;
+	}
+
+	/**
+	 * @brief Queues `data` and sends as much of it as the socket takes right away. The rest is sent while the client awaits anything (this send included.)
+	 * @param[in] data The bytes to be sent; they are copied.
+	 * @returns A task that finishes once `data` has been handed to the kernel: `DONE`; `CLOSED` or `FAILED` if the connection is not usable; `CANCELLED` if `cancel` has been called meanwhile. It need not be awaited.
+	 */
+	Task<IoStatus> AsyncClient::send(const std::string_view data)
+	{
+		if (this->mStatus == IoStatus::DONE) {
+			this->mOutput.append(data);
+			this->mQueued += data.size();
+			this->_flush();
+		}
+
+		return this->_sent(this->mQueued);
+	}
+
+	/**
+	 * @brief Sends `line` followed by `LINE_ENDING` (see `send`.)
+	 * @param[in] line The line, without its ending.
+	 * @returns The task that finishes once the line has been handed to the kernel.
+	 */
+	Task<IoStatus> AsyncClient::sendLine(const std::string_view line)
+	{
+		if (this->mStatus == IoStatus::DONE) {
+			this->mOutput.append(line);
+			this->mOutput.append(LINE_ENDING);
+			this->mQueued += line.size() + LINE_ENDING.size();
+			this->_flush();
+		}
+
+		return this->_sent(this->mQueued);
+	}
+
+	/**
+	 * @brief Waits until the bytes queued up to `target` have been handed to the kernel. One of the waiting coroutines waits for the socket to be writable and flushes the queue; the others wait for it to stop, and then check again.
+	 * @returns See `send`.
+	 */
+	Task<IoStatus> AsyncClient::_sent(const uint64_t target)
+	{
+		uint64_t cancellations = this->mCancellations;
+
+		while (true) {
+			if (this->mCancellations != cancellations)
+				co_return IoStatus::CANCELLED;
+
+			if (this->mSent >= target)
+				co_return IoStatus::DONE;
+
+			if (this->mStatus != IoStatus::DONE)
+				co_return this->mStatus;
+
+			if (this->mWriting) {
+				co_await WriterAwaiter{ *this };
+				continue;
+			}
+
+			this->mWriting = true;
+			bool ready = co_await this->mLoop.writable(this->mFd);
+			this->mWriting = false;
+
+			this->_wake_senders();
+
+			if (!ready)
+				co_return IoStatus::CANCELLED;
+
+			this->_flush();
+		}
+	}
+
+	/**
+	 * @brief Receives the next line.
+	 * @param[out] line The line, without its ending; it stays valid until the next call to `recvLine`.
+	 * @returns `DONE` if a line has been received; `CLOSED` if the server has closed the connection (the lines received before are still handed out first); `FAILED` if the connection has failed; `CANCELLED` if `cancel` has been called meanwhile.
+	 */
+	Task<IoStatus> AsyncClient::recvLine(std::string_view& line)
+	{
+		uint64_t cancellations = this->mCancellations;
+
+		while (!this->mInput.nextLine(line)) {
+			if (this->mCancellations != cancellations)
+				co_return IoStatus::CANCELLED;
+
+			if (this->mStatus != IoStatus::DONE)
+				co_return this->mStatus;
+
+			// a request and the wait for its reply go together; do not leave the request queued behind it
+			if (!this->mOutput.empty())
+				this->_flush();
+
+			int rd = this->mInput.receive(this->mFd);
+
+			if (rd > 0)
+				continue;
+
+			if (rd == 0) {
+				this->mStatus = IoStatus::CLOSED;
+				continue;
+			}
+
+			int e = lastSocketError();
+
+			if (!wouldBlock(e)) {
+				this->_fail(e);
+				continue;
+			}
+
+			bool ready = co_await this->mLoop.readable(this->mFd);
+
+			if (!ready)
+				co_return IoStatus::CANCELLED;
+		}
+
+		co_return IoStatus::DONE;
+	}
+
+	/**
+	 * @brief Sends as much of the queued output as the socket takes without blocking.
+	 * @returns void
+	 */
+	void AsyncClient::_flush()
+	{
+		int sent = this->mOutput.flush(this->mFd);
+
+		if (sent == -1) {
+			this->_fail(lastSocketError());
+			return;
+		}
+
+		this->mSent += (uint64_t)sent;
+	}
+
+	/**
+	 * @brief Marks the connection as failed with `error`; every operation on it reports it from now on. The output still queued is discarded.
+	 * @returns void
+	 */
+	void AsyncClient::_fail(const int error)
+	{
+		LOG_WARNING("client", "Connection {} has failed: {}", this->mFd, ConnectionInformation::formatFckingMSErrorMessages(error));
+
+		this->mStatus = IoStatus::FAILED;
+		this->mError = error;
+		this->mOutput.clear();
+		this->mQueued = this->mSent;
+
+		this->_wake_senders();
+	}
+
+	/**
+	 * @brief Resumes the coroutines waiting for the one that waits for the socket to be writable, on the next turn of the loop.
+	 * @returns void
+	 */
+	void AsyncClient::_wake_senders()
+	{
+		for (std::coroutine_handle<> handle : this->mSendWaiters)
+			this->mLoop.schedule(handle);
+
+		this->mSendWaiters.clear();
+	}
+
+	/**
+	 * @brief Cancels the operations in progress: they finish with `CANCELLED` on the next turn of the loop. The connection stays usable, and its queued output is kept.
+	 * @returns void
+	 */
+	void AsyncClient::cancel()
+	{
+		this->mCancellations++;
+
+		if (this->mFd != -1)
+			this->mLoop.cancel(this->mFd);
+
+		this->_wake_senders();
+	}
+
+	/**
+	 * @brief Cancels the operations in progress and closes the connection. The output still queued is discarded.
+	 * @returns void
+	 */
+	void AsyncClient::close()
+	{
+		if (this->mFd == -1)
+			return;
+
+		this->cancel();
+		this->mLoop.forget(this->mFd);
+		::closesocket(this->mFd);
+
+		this->mFd = -1;
+		this->mStatus = IoStatus::CLOSED;
+		this->mInput = LineBuffer{};
+		this->mOutput.clear();
+		this->mQueued = this->mSent;
+	}
+
+}
@@ -20,49 +20,6 @@ namespace m0st4fa {
 		return 0;
 	}
 
-	/**
-	 * @brief Formats `msg` for standard client stream.
-	 * @param[in] msg The message to be formatted.
-	 * @returns A string formatted for standard client stream.
-	 */
-	std::string Client::_format_client(const std::string_view msg)
-	{
-		return "[client] " + std::string(msg);
-	}
-
-	/**
-	 * @brief Implements formatting for standard client stream with 0 format arguments.
-	 * @param[in] msg The message to be formatted.
-	 * @returns A string formatted for standard client stream.
-	 */
-	std::string Client::_format(const std::string_view msg) const
-	{
-		return _format_client(msg);
-	}
-
-	/**
-	 * @brief Implements formatting for standard client stream with 1 format arguments.
-	 * @param[in] msg The message to be formatted.
-	 * @param[in] arg1 First formatting argument.
-	 * @returns A string formatted for standard client stream.
-	 */
-	std::string Client::_format(const std::string_view msg, const std::string_view arg1) const
-	{
-		return std::vformat(_format_client(msg).data(), std::make_format_args(arg1));
-	}
-
-	/**
-	 * @brief Implements formatting for standard client stream with 1 format arguments.
-	 * @param[in] msg The message to be formatted.
-	 * @param[in] arg1 The first formatting argument.
-	 * @param[in] arg2 The second formatting argument.
-	 * @returns A string formatted for standard client stream.
-	 */
-	std::string Client::_format(const std::string_view msg, const std::string_view arg1, const std::string_view arg2) const
-	{
-		return std::vformat(_format_client(msg).data(), std::make_format_args(arg1, arg2));
-	}
-
 	// TODO: Document this!
 	int Client::connect()
 	{
@@ -70,11 +27,11 @@ namespace m0st4fa {
 
 		int e = errno;
 		if (rv != 0) {
-			std::cout << _format("Error while connecting to server: {}", strerror(e));
+			LOG_CRITICAL("client", "Error while connecting to server: {}", strerror(e));
 			exit(1);
 		}
 
-		std::cout << _format("Connected to {}\n", m0st4fa::toString((const sockaddr_storage*)this->mServerInfo->ai_addr));
+		LOG_INFO("client", "Connected to {}", m0st4fa::toString((const sockaddr_storage*)this->mServerInfo->ai_addr));
 
 		return 0;
 	}
@@ -0,0 +1,372 @@
+#include "include/load_generator.h"
+#include "compression.h"
+#include <algorithm>
+#include <charconv>
+#include <random>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+namespace m0st4fa {
+
+	LoadGenerator::~LoadGenerator()
+	{
+		while (this->mSessions.size() > 0)
+			this->_close(this->mSessions.keys().back());
+	}
+
+	/**
+	 * @returns The time in nanoseconds, on the clock the messages are stamped with.
+	 */
+	uint64_t LoadGenerator::_now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+	 * @brief Connects the sessions, waits for them to be ready, sends for the warm-up and then for the measured run, and waits for the messages still in flight.
+	 * @returns What has been measured.
+	 */
+	LoadReport LoadGenerator::run()
+	{
+		this->_connect_all();
+
+		auto connectDeadline = std::chrono::steady_clock::now() + CONNECT_TIMEOUT;
+		while (this->mReady.size() < this->mSessions.size() && std::chrono::steady_clock::now() < connectDeadline)
+			this->_poll(10);
+
+		this->mReport.connected = this->mReady.size();
+
+		// nobody would receive the messages
+		if (this->mReady.size() < 2)
+			return this->mReport;
+
+		this->_send_for(this->mOptions.warmup);
+
+		this->mMeasuring = true;
+		this->mMeasureStart = _now();
+		auto begin = std::chrono::steady_clock::now();
+
+		this->_send_for(this->mOptions.duration);
+		this->mReport.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		// every message reaches all the other sessions
+		auto drainDeadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+		while (this->mReport.delivered < this->mReport.sent * (this->mReady.size() - 1) && std::chrono::steady_clock::now() < drainDeadline)
+			this->_poll(10);
+
+		return this->mReport;
+	}
+
+	/**
+	 * @brief Starts connecting every session, without waiting for the connections to be established.
+	 * @returns void
+	 */
+	void LoadGenerator::_connect_all()
+	{
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((unsigned short)this->mOptions.port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		for (size_t i = 0; i < this->mOptions.sessions; i++) {
+			int fd = (int)::socket(AF_INET, SOCK_STREAM, 0);
+
+			if (fd == -1) {
+				std::cerr << std::format("[loadgen] Could not create socket {}: {}\n", i, strerror(errno));
+				return;
+			}
+
+			// messages are sent one by one and timed; they must not wait for each other
+			int noDelay = 1;
+			::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+			setNonBlocking(fd);
+
+			int rv = ::connect(fd, (sockaddr*)&addr, sizeof(addr));
+			int e = lastSocketError();
+
+			if (rv == -1 && !wouldBlock(e) && e != EINPROGRESS) {
+				std::cerr << std::format("[loadgen] Could not connect session {}: {}\n", i, ConnectionInformation::formatFckingMSErrorMessages(e));
+				::closesocket(fd);
+				continue;
+			}
+
+			this->mSessions.insert(fd);
+			this->mReactor->add(fd, Reactor::READABLE | Reactor::WRITABLE); // writable once connected
+		}
+	}
+
+	/**
+	 * @brief Sends at the configured rate for `period`, while receiving.
+	 * @returns void
+	 */
+	void LoadGenerator::_send_for(const std::chrono::seconds period)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		auto end = begin + period;
+		uint64_t issued = 0;
+
+		for (auto now = begin; now < end; now = std::chrono::steady_clock::now()) {
+			uint64_t due = (uint64_t)(this->mOptions.rate * std::chrono::duration<double>(now - begin).count());
+
+			for (size_t i = 0; issued < due && i < MAX_BURST; i++, issued++)
+				this->_send_message();
+
+			// the messages a stall has left unsent are skipped rather than sent in a burst
+			issued = due;
+
+			this->_poll(1);
+		}
+	}
+
+	/**
+	 * @brief Waits up to `timeout` milliseconds for the sessions to become ready, and serves the ones that are.
+	 * @returns void
+	 */
+	void LoadGenerator::_poll(const int timeout)
+	{
+		thread_local std::vector<ReactorEvent> events(1024);
+
+		int ready = this->mReactor->wait(events, timeout);
+
+		for (int i = 0; i < ready; i++) {
+			int fd = events[i].fd;
+
+			if (events[i].events & Reactor::WRITABLE) {
+				Session* session = this->mSessions.find(fd);
+
+				if (session != nullptr)
+					this->_on_writable(fd, *session);
+			}
+
+			if (events[i].events & ~Reactor::WRITABLE) {
+				Session* session = this->mSessions.find(fd);
+
+				if (session != nullptr)
+					this->_on_readable(fd, *session);
+			}
+		}
+	}
+
+	/**
+	 * @brief Completes the connection of session `fd` (starting the switch to binary frames, if configured), and sends its queued output.
+	 * @returns void
+	 */
+	void LoadGenerator::_on_writable(const int fd, Session& session)
+	{
+		if (!session.connected) {
+			int err = 0;
+			socklen_t length = sizeof(err);
+			::getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&err, &length);
+
+			if (err != 0) {
+				std::cerr << std::format("[loadgen] Could not connect: {}\n", ConnectionInformation::formatFckingMSErrorMessages(err));
+				this->_close(fd);
+				return;
+			}
+
+			session.connected = true;
+
+			if (this->mOptions.binary) {
+				thread_local std::mt19937_64 random{ std::random_device{}() };
+				uint64_t nonce = random();
+				std::memcpy(session.nonce, &nonce, NONCE_SIZE);
+
+				session.output.append(this->mOptions.compress ? DEFLATE_HELLO : BINARY_HELLO);
+				session.output.append(std::string_view{ session.nonce, NONCE_SIZE });
+			}
+			else {
+				session.ready = true;
+				this->mReady.push_back(fd);
+			}
+		}
+
+		if (session.output.flush(fd) == -1) {
+			this->_close(fd);
+			return;
+		}
+
+		session.writeArmed = !session.output.empty();
+		this->mReactor->modify(fd, session.writeArmed ? Reactor::READABLE | Reactor::WRITABLE : Reactor::READABLE);
+	}
+
+	/**
+	 * @brief Receives what session `fd` has available and times the messages in it.
+	 * @returns void
+	 */
+	void LoadGenerator::_on_readable(const int fd, Session& session)
+	{
+		int rd = session.input.receive(fd);
+
+		if (rd == 0 || (rd == -1 && !wouldBlock(lastSocketError()))) {
+			std::cerr << std::format("[loadgen] The server has closed session {}\n", fd);
+			this->_close(fd);
+			return;
+		}
+
+		if (rd > 0 && this->mMeasuring)
+			this->mReport.bytes += (uint64_t)rd;
+
+		if (this->mOptions.binary) {
+			// skip the text sent before the switch, up to the nonce that ends the `HELLO` frame (the codec, if any, comes before it)
+			if (!session.ready) {
+				std::string_view pending = session.input.pending();
+				size_t pos = pending.find(std::string_view{ session.nonce, NONCE_SIZE });
+
+				if (pos == std::string_view::npos) {
+					session.input.discard(pending.size() - std::min(pending.size(), NONCE_SIZE - 1));
+					return;
+				}
+
+				session.input.discard(pos + NONCE_SIZE);
+				session.ready = true;
+				this->mReady.push_back(fd);
+			}
+
+			FrameHeader header;
+			std::string_view payload;
+			FrameStatus status;
+
+			while ((status = session.input.nextFrame(header, payload)) == FrameStatus::COMPLETE)
+				this->_on_frame(fd, header, payload);
+
+			if (status == FrameStatus::OVERSIZED) {
+				std::cerr << std::format("[loadgen] Session {} received an oversized frame\n", fd);
+				this->_close(fd);
+			}
+
+			return;
+		}
+
+		// "> \b\b<sender>: <payload>"; the prompt of the previous message comes first
+		std::string_view line;
+		while (session.input.nextLine(line)) {
+			size_t frame = line.find("\b\b");
+			size_t separator = frame == std::string_view::npos ? frame : line.find(": ", frame);
+
+			if (separator != std::string_view::npos)
+				this->_on_message(line.substr(separator + 2));
+		}
+	}
+
+	/**
+	 * @brief Handles a binary frame received by session `fd`: messages are timed, after being decompressed if they come as `COMPRESSED` frames.
+	 * @returns void
+	 */
+	void LoadGenerator::_on_frame(const int fd, const FrameHeader& header, const std::string_view payload)
+	{
+		if (header.type == MessageType::MESSAGE) {
+			this->_on_message(payload);
+			return;
+		}
+
+		if (header.type != MessageType::COMPRESSED || payload.size() < COMPRESSED_PREFIX_SIZE || (MessageType)payload[0] != MessageType::MESSAGE)
+			return;
+
+		const unsigned char* prefix = (const unsigned char*)payload.data();
+		size_t size = (size_t)prefix[1] << 24 | (size_t)prefix[2] << 16 | (size_t)prefix[3] << 8 | prefix[4];
+
+		thread_local std::string message;
+		message.resize(size);
+
+		if (inflateRaw(payload.substr(COMPRESSED_PREFIX_SIZE), message.data(), size) != size) {
+			std::cerr << std::format("[loadgen] Session {} received a corrupt compressed frame\n", fd);
+			return;
+		}
+
+		if (this->mMeasuring)
+			this->mReport.compressed++;
+
+		this->_on_message(message);
+	}
+
+	/**
+	 * @brief Times a received message, if it has been sent during the measured run.
+	 * @param[in] payload The message: the time it was sent, '|', then padding.
+	 * @returns void
+	 */
+	void LoadGenerator::_on_message(const std::string_view payload)
+	{
+		uint64_t sentAt = 0;
+		auto [end, ec] = std::from_chars(payload.data(), payload.data() + payload.size(), sentAt);
+
+		// not a message of ours (e.g., a notice)
+		if (ec != std::errc{} || end == payload.data() + payload.size() || *end != '|')
+			return;
+
+		if (!this->mMeasuring || sentAt < this->mMeasureStart)
+			return;
+
+		uint64_t now = _now();
+
+		this->mReport.delivered++;
+		this->mReport.latency.record(now > sentAt ? now - sentAt : 0);
+	}
+
+	/**
+	 * @brief Sends the next message, from the next ready session in turn, with the next size of the mix.
+	 * @returns void
+	 */
+	void LoadGenerator::_send_message()
+	{
+		if (this->mReady.empty())
+			return;
+
+		int fd = this->mReady[this->mNextSender++ % this->mReady.size()];
+		Session& session = *this->mSessions.find(fd);
+		size_t size = this->mOptions.sizes[this->mNextSize++ % this->mOptions.sizes.size()];
+
+		thread_local std::string message;
+		message.clear();
+
+		if (this->mOptions.binary)
+			message.resize(FrameHeader::SIZE);
+
+		char stamp[24];
+		char* stampEnd = std::to_chars(stamp, stamp + sizeof(stamp), _now()).ptr;
+		size_t stampSize = (size_t)(stampEnd - stamp) + 1;
+
+		message.append(stamp, stampEnd).append("|").append(size > stampSize ? size - stampSize : 0, 'x');
+
+		if (this->mOptions.binary)
+			FrameHeader{ (uint32_t)(message.size() - FrameHeader::SIZE), MessageType::MESSAGE, 0 }.encode(message.data());
+		else
+			message.append("\r\n");
+
+		session.output.append(message);
+
+		if (this->mMeasuring)
+			this->mReport.sent++;
+
+		// the rest goes out when the socket is writable again
+		if (session.writeArmed)
+			return;
+
+		if (session.output.flush(fd) == -1) {
+			this->_close(fd);
+			return;
+		}
+
+		if (!session.output.empty()) {
+			session.writeArmed = true;
+			this->mReactor->modify(fd, Reactor::READABLE | Reactor::WRITABLE);
+		}
+	}
+
+	/**
+	 * @brief Closes session `fd`.
+	 * @returns void
+	 */
+	void LoadGenerator::_close(const int fd)
+	{
+		this->mReactor->remove(fd);
+		::closesocket(fd);
+		this->mSessions.erase(fd);
+
+		auto it = std::find(this->mReady.begin(), this->mReady.end(), fd);
+		if (it != this->mReady.end())
+			this->mReady.erase(it);
+	}
+
+}
@@ -19,10 +19,14 @@ namespace m0st4fa {
 	};
 
 	/**
-	 * @brief Initializes Winsock library. It does not work without this step!
+	 * @brief Initializes Winsock library. It does not work without this step! On POSIX systems it only makes writes to closed peers fail with `EPIPE` instead of killing the process.
 	 */
 	int setupWinsock() {
 
+#ifndef _WIN32
+		::signal(SIGPIPE, SIG_IGN);
+		return 0;
+#else
 		// Set up the WinSock library
 		WORD wVersionRequested;
 		WSADATA wsaData;
@@ -40,6 +44,110 @@ namespace m0st4fa {
 		}
 
 		return 0;
+#endif
+	}
+
+	/**
+	 * @brief Gets the error code of the last failed socket call on this thread.
+	 * @returns `WSAGetLastError()` on Windows; `errno` otherwise.
+	 */
+	int lastSocketError()
+	{
+#ifdef _WIN32
+		return ::WSAGetLastError();
+#else
+		return errno;
+#endif
+	}
+
+	/**
+	 * @brief Puts socket `sockFd` into (or takes it out of) non-blocking mode.
+	 * @param[in] sockFd The socket to be modified.
+	 * @param[in] enable `true` to make calls on the socket return instead of blocking; `false` to restore blocking mode.
+	 * @returns `0` on success; `-1` otherwise.
+	 */
+	int setNonBlocking(const int sockFd, const bool enable)
+	{
+#ifdef _WIN32
+		u_long mode = enable ? 1 : 0;
+		return ::ioctlsocket(sockFd, FIONBIO, &mode) == 0 ? 0 : -1;
+#else
+		int flags = ::fcntl(sockFd, F_GETFL, 0);
+
+		if (flags == -1)
+			return -1;
+
+		flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+
+		return ::fcntl(sockFd, F_SETFL, flags);
+#endif
+	}
+
+	/**
+	 * @brief Accepts the next pending connection of the listening socket `listenFd` as a non-blocking socket. Where `accept4` exists, the socket is made non-blocking (and close-on-exec) by the same call, which saves a system call per connection.
+	 * @param[in] listenFd The listening socket.
+	 * @param[out] addr The address of the peer.
+	 * @returns The accepted socket; `-1` on error (check `lastSocketError()`.)
+	 */
+	int acceptNonBlocking(const int listenFd, sockaddr_storage* addr)
+	{
+		socklen_t length = sizeof(sockaddr_storage);
+
+#ifdef __linux__
+		return ::accept4(listenFd, (sockaddr*)addr, &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		int sockFd = (int)::accept(listenFd, (sockaddr*)addr, &length);
+
+		if (sockFd != -1)
+			setNonBlocking(sockFd);
+
+		return sockFd;
+#endif
+	}
+
+	/**
+	 * @brief Tells whether `errCode`, from `accept`, only concerns the connection being accepted (e.g., it has been reset while queued), so that the next one may be accepted right away.
+	 * @param[in] errCode The error code returned by `lastSocketError`.
+	 */
+	bool isTransientAcceptError(const int errCode)
+	{
+#ifdef _WIN32
+		return errCode == WSAECONNRESET || errCode == WSAEINTR;
+#else
+		switch (errCode) {
+		case ECONNABORTED:
+		case EINTR:
+		case EPROTO:
+		case EPERM: // refused by a firewall rule
+#ifdef __linux__
+		// errors of the network that Linux passes on from the new socket
+		case ENETDOWN:
+		case ENOPROTOOPT:
+		case EHOSTDOWN:
+		case ENONET:
+		case EHOSTUNREACH:
+		case EOPNOTSUPP:
+		case ENETUNREACH:
+#endif
+			return true;
+		default:
+			return false;
+		}
+#endif
+	}
+
+	/**
+	 * @brief Tells whether `errCode` means that a non-blocking call had nothing to do (as opposed to a real failure.)
+	 * @param[in] errCode The error code returned by `lastSocketError`.
+	 * @returns `true` if the call would have blocked.
+	 */
+	bool wouldBlock(const int errCode)
+	{
+#ifdef _WIN32
+		return errCode == WSAEWOULDBLOCK;
+#else
+		return errCode == EAGAIN || errCode == EWOULDBLOCK;
+#endif
 	}
 
 	/**
@@ -52,7 +160,8 @@ namespace m0st4fa {
 		int rv = getaddrinfo(nullptr, std::to_string(myPort).c_str(), &mMyHints, &this->mMyInfo);
 
 		if (rv != 0) {
-			std::cout << _format("Could not obtain the localhost address: {}\n", gai_strerrorA(rv));
+			LOG_CRITICAL(_log_source(), "Could not obtain the localhost address: {}", gai_strerrorA(rv));
+			Logger::global().flush();
 			std::abort();
 		};
 
@@ -61,31 +170,41 @@ namespace m0st4fa {
 
 	/**
 	 * @brief Binds the first address of our server (that, presumably it got by calling setDeviceAddress before) to a socket. It aborts the process in case of any error.
+	 * @param[in] reusePort Whether other sockets may be bound to the same address (`SO_REUSEPORT`); the kernel then spreads incoming connections among them.
 	 * @returns The value returned by `bind` (important for error checking).
 	 */
-	int ConnectionInformation::assignSocket()
+	int ConnectionInformation::assignSocket(const bool reusePort)
 	{
 		addrinfo* p = nullptr;
 		int rv = 0;
 
 		// Bind the first name we get to a socket
-		for (p = this->mMyInfo; p != nullptr; this->mMyInfo->ai_next) {
+		for (p = this->mMyInfo; p != nullptr; p = p->ai_next) {
 
 			// Get a new socket
-			pMySockFd = socket(this->mMyInfo->ai_family, this->mMyInfo->ai_socktype, 0);
+			pMySockFd = socket(p->ai_family, p->ai_socktype, 0);
 
 			int e = errno;
 
 			if (pMySockFd == -1) {
-				std::cout << _format("Failed to create listening socket for address {}: {}\n" , toString((const sockaddr_storage*)p->ai_addr).data(), strerror(e));
+				LOG_WARNING(_log_source(), "Failed to create listening socket for address {}: {}", toString((const sockaddr_storage*)p->ai_addr), strerror(e));
 				continue;
 			}
 
+			// Allow restarting the server without waiting for TIME_WAIT connections to expire
+			int yes = 1;
+			::setsockopt(pMySockFd, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+#ifdef SO_REUSEPORT
+			if (reusePort)
+				::setsockopt(pMySockFd, SOL_SOCKET, SO_REUSEPORT, (const char*)&yes, sizeof(yes));
+#endif
+
 			// Bind the socket
-			rv = bind(pMySockFd, this->mMyInfo->ai_addr, this->mMyInfo->ai_addrlen);
+			rv = bind(pMySockFd, p->ai_addr, p->ai_addrlen);
 			e = errno;
 			if (rv == -1) {
-				std::cout << _format("Failed to bind listening socket '{}': {}\n" , std::to_string(pMySockFd).data(), strerror(e));
+				LOG_WARNING(_log_source(), "Failed to bind listening socket '{}': {}", pMySockFd, strerror(e));
 				continue;
 			}
 
@@ -94,7 +213,8 @@ namespace m0st4fa {
 		}
 
 		if (p == NULL) {
-			std::cout << _format("Failed to create or bind a listening socket!");
+			LOG_CRITICAL(_log_source(), "Failed to create or bind a listening socket!");
+			Logger::global().flush();
 			std::abort();
 		}
 
@@ -111,18 +231,16 @@ namespace m0st4fa {
 	 */
 	int ConnectionInformation::_initialize_connection(int sockFd, const sockaddr_storage* const connectedAddr) const
 	{
-		std::cout << _format("Accepted connection from {}\n", toString(connectedAddr).data());
+		LOG_INFO(_log_source(), "Accepted connection from {}", toString(connectedAddr));
 
 		std::string msg = std::format("Welcome {}!\r\n> ", sockFd); // Temporary variable to store messages
 		int remainingBytes = send(sockFd, msg);
 
-		int e = errno;
-		if (remainingBytes > 0) {
-			std::cout << _format("Cannot send message \"{}\" to peer: {}\n", msg, strerror(errno));
-			std::abort();
-		}
+		// the peer may well be gone already (e.g., a client that has given up waiting during a connection storm)
+		if (remainingBytes > 0)
+			LOG_WARNING(_log_source(), "Cannot send message \"{}\" to peer: {}", msg, strerror(errno));
 
-		return 0;
+		return remainingBytes;
 	}
 
 	/**
@@ -147,7 +265,7 @@ namespace m0st4fa {
 
 			// if there's an error
 			if (rd == -1) {
-				std::cout << _format("An error returned while receiving data: {}\n", strerror(err));
+				LOG_CRITICAL(_log_source(), "An error returned while receiving data: {}", strerror(err));
 				std::exit(-1);
 			}
 
@@ -182,7 +300,7 @@ namespace m0st4fa {
 		int rv = ::closesocket(sockFd);
 		int e = errno;
 
-		std::cout << this->_format("Error while closing socket: {}\n", strerror(e));
+		LOG_WARNING(_log_source(), "Error while closing socket: {}", strerror(e));
 
 		return rv == 0 ? 0 : -1;
 
@@ -215,20 +333,25 @@ namespace m0st4fa {
 	}
 
 	// TODO: THIS NEEDS A COMPLETE CHANGE AFTER ENCAPSULATING DATA TO BE ABLE TO GET DATA OF ANY LENGTH.
-	// TODO: Make it use std::string instead to not have memory leaks.
 	/**
 	 * @brief Receives data from a particular socket.
 	 * @param[in] sockFd The socket from which to receive data.
 	 * @param[in] byteN The size of the data to be received.
 	 * @param[in] nbytes The number of bytes that have been received.
-	 * @returns The received data.
+	 * @returns The received data; it stays valid until the next call on the same thread.
 	 */
 	std::string_view ConnectionInformation::receive(const int sockFd, const size_t byteN, int& nbytes)
 	{
-		char* buf = new char[byteN] {};
-		nbytes = ::recv(sockFd, buf, byteN, 0);
+		// reused by every call, instead of a buffer allocated (and leaked) per call
+		thread_local std::vector<char> buf;
 
-		return std::string_view{ buf };
+		if (buf.size() < byteN)
+			buf.resize(byteN);
+
+		nbytes = ::recv(sockFd, buf.data(), (int)byteN, 0);
+
+		// `buf` is not null-terminated when it has been filled completely
+		return std::string_view{ buf.data(), nbytes > 0 ? (size_t)nbytes : 0 };
 	}
 
 	/**
@@ -244,7 +367,7 @@ namespace m0st4fa {
 		size_t remaining = total;
 
 		while (remaining != 0) {
-			rv = ::send(sockFd, msg.data(), msg.length(), 0);
+			rv = ::send(sockFd, msg.data() + (total - remaining), remaining, 0); // continue where the previous (partial) send stopped
 
 			// if there was an error while sending data
 			if (rv == -1) return remaining; // return how many characters remain to be sent
@@ -257,6 +380,9 @@ namespace m0st4fa {
 
 	std::string ConnectionInformation::formatFckingMSErrorMessages(const int errorCode)
 	{
+#ifndef _WIN32
+		return ::strerror(errorCode);
+#else
 		LPTSTR errorString = NULL; // Pointer to store formatted message
 
 		DWORD flags = FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM;
@@ -272,6 +398,19 @@ namespace m0st4fa {
 		);
 
 		return std::string();
+#endif
+	}
+
+	/**
+	 * @brief Finds where a file descriptor is stored in the collection, in constant time.
+	 * @returns The index of `socketFd` in `sockets`; `-1` if it is not in the collection.
+	 */
+	int Sockets::_position(const int socketFd) const
+	{
+		if (socketFd < 0 || (size_t)socketFd >= this->positions.size())
+			return -1;
+
+		return this->positions[socketFd];
 	}
 
 	/**
@@ -282,47 +421,51 @@ namespace m0st4fa {
 	 */
 	void Sockets::add(const int socketFd, const int eventBitmap)
 	{
+		// the index grows with the largest descriptor, which the system keeps small by reusing the lowest free numbers
+		if ((size_t)socketFd >= this->positions.size())
+			this->positions.resize((size_t)socketFd + 1, -1);
+
+		this->positions[socketFd] = (int)this->sockets.size();
+		this->sockets.push_back(pollfd{ (decltype(pollfd::fd))socketFd, (short)eventBitmap, 0 });
+	}
 
-		// if we're out of space on the heap
-		if (length == capacity) {
-			capacity *= 2; // duplicate the capacity
-			pollfd* n = new pollfd[capacity]; // allocate new space for the objects
+	/**
+	 * @brief Removes a file descriptor from the collection, in constant time (the last element takes its place.)
+	 * @param[in] socketFd The file descriptor to be removed.
+	 * @returns `0` if the file descriptor was removed; `-1` otherwise (e.g., it didn't actually exist.)
+	 */
+	int Sockets::remove(const int socketFd)
+	{
+		int pos = this->_position(socketFd);
 
-			// copy pollfd objects. I do this instead of using memcpy because I might implement some struct in the future, and this would copy the objects correctly (by calling constructures.)
-			for (int i = 0; i <= length; i++)
-				n[i] = this->sockets[i];
+		if (pos == -1)
+			return -1; // if we didn't find the socket (and thus didn't eliminate it)
 
-			delete[] this->sockets;
-			this->sockets = n;
-		}
+		pollfd& last = this->sockets.back();
+		this->positions[(int)last.fd] = pos;
+		this->sockets[pos] = last;
 
-		// construct new file descriptor object
-		pollfd newFd{socketFd, eventBitmap};
+		this->sockets.pop_back();
+		this->positions[socketFd] = -1;
 
-		// add object
-		this->sockets[length++] = newFd;
+		return 0; // because we found and eliminated the socket
 	}
 
 	/**
-	 * @brief Removes a file descriptor from the collection.
-	 * @param[in] socketFd The file descriptor to be removed.
-	 * @returns `0` if the file descriptor was removed; `-1` otherwise (e.g., it didn't actually exist.)
+	 * @brief Changes the events polled for on a file descriptor of the collection.
+	 * @param[in] socketFd The file descriptor.
+	 * @param[in] eventBitmap The events you want to poll for.
+	 * @returns `0` if the file descriptor was updated; `-1` otherwise (e.g., it didn't actually exist.)
 	 */
-	int Sockets::remove(const int socketFd)
+	int Sockets::update(const int socketFd, const int eventBitmap)
 	{
-		
-		for (int i = 0; i <= this->length; i++) {
-			pollfd& curr = this->sockets[i];
-
-			if (curr.fd == socketFd) {
-				curr = this->sockets[length - 1];
-				this->length--;
-				return 0; // because we found and eliminated the socket
-			}
+		int pos = this->_position(socketFd);
 
-		}
+		if (pos == -1)
+			return -1;
 
-		return -1; // if we didn't find the socket (and thus didn't eliminate it)
+		this->sockets[pos].events = (short)eventBitmap;
+		return 0;
 	}
 
 }
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#ifdef _WIN32
+
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
@@ -10,15 +12,41 @@
 #include <ws2tcpip.h>
 #include <iphlpapi.h>
 
+#else
+
+// POSIX API Headers
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+// Winsock spellings used throughout the code base, so that it builds unchanged on POSIX systems.
+inline int closesocket(const int sockFd) { return ::close(sockFd); }
+inline const char* gai_strerrorA(const int errCode) { return ::gai_strerror(errCode); }
+
+#endif
+
 // Other Headers
 #include <iostream>
 #include <vector>
 #include <format>
 #include <string>
+#include <cstring>
+#include "logger.h"
 
 namespace m0st4fa {
 
 	int setupWinsock();
+	int lastSocketError();
+	int setNonBlocking(const int, const bool = true);
+	int acceptNonBlocking(const int, sockaddr_storage*);
+	bool isTransientAcceptError(const int);
+	bool wouldBlock(const int);
 
 	std::string toString(const sockaddr_storage*);
 
@@ -33,9 +61,7 @@ namespace m0st4fa {
 
 		int _initialize_connection(int, const sockaddr_storage* const) const;
 		std::string_view _receive_sentence(const int, char* const, const size_t, int&) const;
-		virtual std::string _format(const std::string_view msg) const = 0;
-		virtual std::string _format(const std::string_view msg, const std::string_view arg1) const = 0;
-		virtual std::string _format(const std::string_view msg, const std::string_view arg1, const std::string_view arg2) const = 0;
+		virtual const char* _log_source() const = 0; // the source of the log messages (see `Logger::write`)
 
 		int _closeSocket(int sockFd);
 
@@ -44,7 +70,7 @@ namespace m0st4fa {
 		static std::string_view receive(const int, const size_t, int&);
 		static int send(const int, const std::string_view);
 		static std::string formatFckingMSErrorMessages(const int);
-		static constexpr unsigned int BACK_LOG = 10;
+		static constexpr unsigned int BACK_LOG = 4096; // connections the kernel queues for `accept`; it caps the number (at `net.core.somaxconn` on Linux)
 
 		ConnectionInformation() {
 			// Initialize to zero
@@ -63,7 +89,7 @@ namespace m0st4fa {
 
 		int setDeviceAddress(const unsigned int);
 
-		int assignSocket();
+		int assignSocket(const bool = false);
 
 		operator std::string() const;
 
@@ -78,14 +104,19 @@ namespace m0st4fa {
 
 	};
 
+	/**
+	 * @brief Collection of `pollfd`s, kept packed for `poll`. Adding, removing and updating a descriptor take constant time.
+	 */
 	class Sockets {
 
-		pollfd* sockets;
-		size_t length = 0;
-		size_t capacity;
+		std::vector<pollfd> sockets;
+		std::vector<int> positions; // the index of each file descriptor in `sockets` (indexed by descriptor); `-1` if it is not in the collection
+
+		int _position(const int) const;
 
 	public:
-		Sockets(size_t initSz = 10) : capacity{initSz}, sockets { new pollfd[initSz] } {
+		Sockets(size_t initSz = 10) {
+			this->sockets.reserve(initSz);
 		}
 
 		/**
@@ -98,13 +129,14 @@ namespace m0st4fa {
 		};
 		void add(const int, const int);
 		int remove(const int);
+		int update(const int, const int);
 
 		/**
 		 * @brief Gets the underlying `pollfd` collection.
 		 * @returns The underlying set of `pollfd` collection.
 		 */
-		pollfd* getSockets() const {
-			return this->sockets;
+		pollfd* getSockets() {
+			return this->sockets.data();
 		}
 
 		/**
@@ -112,7 +144,7 @@ namespace m0st4fa {
 		 * @returns The number of elements stored in the collection.
 		 */
 		size_t getLength() const {
-			return this->length;
+			return this->sockets.size();
 		}
 
 	};
@@ -0,0 +1,132 @@
+#include <cstdint>
+#include "compression.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace m0st4fa {
+
+#ifdef HAVE_ZLIB
+	namespace {
+
+		constexpr int RAW_WINDOW_BITS = -15; // raw deflate, without the zlib header and checksum
+
+		/**
+		 * @brief The deflate stream of a thread, reset for every message: setting one up allocates a few hundred KiB, which is not something to do per message.
+		 */
+		struct Deflater {
+			z_stream stream{};
+			int level = Z_DEFAULT_COMPRESSION;
+			bool ready = false;
+
+			~Deflater() {
+				if (this->ready)
+					::deflateEnd(&this->stream);
+			}
+
+			bool prepare(const int wanted) {
+				if (!this->ready) {
+					this->ready = ::deflateInit2(&this->stream, wanted, Z_DEFLATED, RAW_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+					this->level = wanted;
+					return this->ready;
+				}
+
+				::deflateReset(&this->stream);
+
+				if (wanted != this->level) {
+					::deflateParams(&this->stream, wanted, Z_DEFAULT_STRATEGY);
+					this->level = wanted;
+				}
+
+				return true;
+			}
+		};
+
+		/**
+		 * @brief The inflate stream of a thread, reset for every message.
+		 */
+		struct Inflater {
+			z_stream stream{};
+			bool ready = false;
+
+			~Inflater() {
+				if (this->ready)
+					::inflateEnd(&this->stream);
+			}
+
+			bool prepare() {
+				if (!this->ready)
+					return this->ready = ::inflateInit2(&this->stream, RAW_WINDOW_BITS) == Z_OK;
+
+				::inflateReset(&this->stream);
+				return true;
+			}
+		};
+
+	}
+#endif
+
+	/**
+	 * @brief Compresses `data` with raw deflate into `out`, unless it does not fit in `capacity` bytes (pass less than the size of `data` to only keep results that are worth it.)
+	 * @param[in] data The bytes to compress.
+	 * @param[out] out Where the compressed bytes go.
+	 * @param[in] capacity The room at `out`.
+	 * @param[in] level The zlib compression level (1, fastest, to 9, smallest.)
+	 * @returns The size of the compressed bytes; `0` if they do not fit (or compression is not available.)
+	 */
+	size_t deflateRaw(const std::string_view data, char* const out, const size_t capacity, const int level)
+	{
+#ifdef HAVE_ZLIB
+		thread_local Deflater deflater;
+
+		if (capacity == 0 || !deflater.prepare(level))
+			return 0;
+
+		z_stream& stream = deflater.stream;
+		stream.next_in = (Bytef*)data.data();
+		stream.avail_in = (uInt)data.size();
+		stream.next_out = (Bytef*)out;
+		stream.avail_out = (uInt)capacity;
+
+		// anything but the end of the stream means that the output did not fit
+		if (::deflate(&stream, Z_FINISH) != Z_STREAM_END)
+			return 0;
+
+		return capacity - stream.avail_out;
+#else
+		return 0;
+#endif
+	}
+
+	/**
+	 * @brief Decompresses the raw deflate stream `data`, which must expand to exactly `size` bytes, into `out`.
+	 * @param[in] data The compressed bytes.
+	 * @param[out] out Room for `size` bytes.
+	 * @param[in] size The size of the decompressed bytes.
+	 * @returns `size`; `SIZE_MAX` if `data` is not a stream of `size` bytes (or compression is not available.)
+	 */
+	size_t inflateRaw(const std::string_view data, char* const out, const size_t size)
+	{
+#ifdef HAVE_ZLIB
+		thread_local Inflater inflater;
+
+		if (!inflater.prepare())
+			return SIZE_MAX;
+
+		z_stream& stream = inflater.stream;
+		stream.next_in = (Bytef*)data.data();
+		stream.avail_in = (uInt)data.size();
+		stream.next_out = (Bytef*)out;
+		stream.avail_out = (uInt)size;
+
+		if (::inflate(&stream, Z_FINISH) != Z_STREAM_END || stream.avail_out != 0)
+			return SIZE_MAX;
+
+		return size;
+#else
+		return SIZE_MAX;
+#endif
+	}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief The codec binary clients may ask for with `DEFLATE_HELLO` (see `MessageType::COMPRESSED`): raw deflate (RFC 1951), each frame compressed on its own, so that one compressed frame can be shared by every recipient. It is only available where the build has found zlib (`HAVE_ZLIB`.)
+	 */
+	inline constexpr std::string_view DEFLATE_CODEC{ "deflate" };
+
+	/**
+	 * @returns Whether `deflateRaw` and `inflateRaw` work in this build.
+	 */
+	constexpr bool compressionAvailable() {
+#ifdef HAVE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	size_t deflateRaw(const std::string_view, char* const, const size_t, const int);
+	size_t inflateRaw(const std::string_view, char* const, const size_t);
+
+}
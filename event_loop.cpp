@@ -0,0 +1,209 @@
+#include <utility>
+#include "event_loop.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Runs `task` to completion and tells the loop when it has finished.
+	 */
+	EventLoop::Detached EventLoop::_detach(EventLoop& loop, Task<void> task)
+	{
+		co_await task;
+		loop.mTasks--;
+	}
+
+	/**
+	 * @brief Starts `task` on the next turn of the loop. The loop owns it until it finishes; `run` returns once every spawned task has finished.
+	 * @returns void
+	 */
+	void EventLoop::spawn(Task<void> task)
+	{
+		this->mTasks++;
+		this->schedule(_detach(*this, std::move(task)).handle);
+	}
+
+	/**
+	 * @brief Resumes `handle` on the next turn of the loop.
+	 * @returns void
+	 */
+	void EventLoop::schedule(std::coroutine_handle<> handle)
+	{
+		this->mReady.push_back(handle);
+	}
+
+	/**
+	 * @brief Registers the coroutine suspended in `awaiter` as waiting for its descriptor.
+	 * @returns void
+	 */
+	void EventLoop::_watch(IoAwaiter& awaiter)
+	{
+		Watch& watch = this->mWatches.insert(awaiter.mFd);
+
+		if (awaiter.mEvent == Reactor::READABLE)
+			watch.reader = &awaiter;
+		else
+			watch.writer = &awaiter;
+
+		_update(awaiter.mFd, watch, watch.interest | awaiter.mEvent);
+	}
+
+	/**
+	 * @brief Has the reactor watch `fd` for `interest`. The interest in a direction is only dropped once the descriptor has been reported ready in it with no coroutine waiting, so that a coroutine that reads (or writes) in a loop does not change it every time.
+	 * @returns void
+	 */
+	void EventLoop::_update(const int fd, Watch& watch, const unsigned int interest)
+	{
+		if (interest == watch.interest && watch.added)
+			return;
+
+		watch.interest = interest;
+
+		if (!watch.added) {
+			this->mReactor->add(fd, interest);
+			watch.added = true;
+		}
+		else
+			this->mReactor->modify(fd, interest);
+	}
+
+	/**
+	 * @brief Resumes the coroutines waiting for `fd`; their waits report that they have been cancelled.
+	 * @returns void
+	 */
+	void EventLoop::cancel(const int fd)
+	{
+		Watch* watch = this->mWatches.find(fd);
+
+		if (watch == nullptr)
+			return;
+
+		for (IoAwaiter** awaiter : { &watch->reader, &watch->writer }) {
+			if (*awaiter == nullptr)
+				continue;
+
+			(*awaiter)->mCancelled = true;
+			this->schedule((*awaiter)->mHandle);
+			*awaiter = nullptr;
+		}
+	}
+
+	/**
+	 * @brief Cancels the waits for `fd` and stops watching it. It must be called before `fd` is closed.
+	 * @returns void
+	 */
+	void EventLoop::forget(const int fd)
+	{
+		this->cancel(fd);
+
+		Watch* watch = this->mWatches.find(fd);
+
+		if (watch == nullptr)
+			return;
+
+		if (watch->added)
+			this->mReactor->remove(fd);
+
+		this->mWatches.erase(fd);
+	}
+
+	/**
+	 * @returns How many milliseconds the loop may wait for descriptors before the next timer is due; `-1` if there is no timer.
+	 */
+	int EventLoop::_timeout() const
+	{
+		if (this->mTimers.empty())
+			return -1;
+
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(this->mTimers.top().due - std::chrono::steady_clock::now());
+
+		return left.count() > 0 ? (int)left.count() : 0;
+	}
+
+	/**
+	 * @brief Schedules the coroutines whose timers are due.
+	 * @returns void
+	 */
+	void EventLoop::_fire_timers()
+	{
+		auto now = std::chrono::steady_clock::now();
+
+		while (!this->mTimers.empty() && this->mTimers.top().due <= now) {
+			this->schedule(this->mTimers.top().handle);
+			this->mTimers.pop();
+		}
+	}
+
+	/**
+	 * @brief Runs the loop until every spawned task has finished (or `stop` is called): resumes the scheduled coroutines, then waits for descriptors and timers and schedules the coroutines waiting for them.
+	 * @returns void
+	 */
+	void EventLoop::run()
+	{
+		std::vector<ReactorEvent> events(MAX_EVENTS);
+		std::vector<std::coroutine_handle<>> ready;
+
+		this->mStopping = false;
+
+		while (!this->mStopping) {
+
+			// coroutines scheduled while these run wait for the next turn
+			while (!this->mReady.empty()) {
+				ready.swap(this->mReady);
+
+				for (std::coroutine_handle<> handle : ready)
+					handle.resume();
+
+				ready.clear();
+			}
+
+			if (this->mTasks == 0 || this->mStopping)
+				return;
+
+			int count = this->mReactor->wait(events, _timeout());
+
+			if (count == -1 && lastSocketError() != EINTR) {
+				LOG_CRITICAL("loop", "Error while polling for sockets: {}", ConnectionInformation::formatFckingMSErrorMessages(lastSocketError()));
+				return;
+			}
+
+			for (int i = 0; i < count; i++) {
+				Watch* watch = this->mWatches.find(events[i].fd);
+
+				if (watch == nullptr)
+					continue;
+
+				// a hangup or a failure wakes up both directions; the next call on the descriptor reports it
+				bool failed = events[i].events & (Reactor::HANGUP | Reactor::FAILED);
+				unsigned int idle = 0;
+
+				if (failed || (events[i].events & Reactor::READABLE)) {
+					if (watch->reader != nullptr)
+						this->schedule(std::exchange(watch->reader, nullptr)->mHandle);
+					else
+						idle |= Reactor::READABLE;
+				}
+
+				if (failed || (events[i].events & Reactor::WRITABLE)) {
+					if (watch->writer != nullptr)
+						this->schedule(std::exchange(watch->writer, nullptr)->mHandle);
+					else
+						idle |= Reactor::WRITABLE;
+				}
+
+				_update(events[i].fd, *watch, watch->interest & ~idle);
+			}
+
+			_fire_timers();
+		}
+	}
+
+	/**
+	 * @brief Makes `run` return after the current turn, even if tasks have not finished. They stay suspended; calling `run` again goes on with them.
+	 * @returns void
+	 */
+	void EventLoop::stop()
+	{
+		this->mStopping = true;
+	}
+
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+#include "reactor.h"
+#include "slab.h"
+#include "task.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief The result of an I/O operation awaited on an `EventLoop`.
+	 */
+	enum class IoStatus {
+		DONE,
+		CLOSED, // the peer has closed the connection (or it has not been connected)
+		FAILED, // the connection has failed
+		CANCELLED, // the wait has been cancelled (see `EventLoop::cancel`)
+	};
+
+	/**
+	 * @brief Runs coroutines (see `Task`) on a single thread: they await the readiness of descriptors and timers, and the loop resumes them when the `Reactor` reports it. One thread can serve many connections this way without blocking on any of them.
+	 */
+	class EventLoop {
+
+	public:
+
+		/**
+		 * @brief Awaits the readiness of a descriptor (see `readable` and `writable`.)
+		 */
+		class IoAwaiter {
+
+			EventLoop& mLoop;
+			int mFd;
+			unsigned int mEvent;
+			std::coroutine_handle<> mHandle;
+			bool mCancelled = false;
+
+			friend class EventLoop;
+
+		public:
+
+			IoAwaiter(EventLoop& loop, const int fd, const unsigned int event) : mLoop{ loop }, mFd{ fd }, mEvent{ event } {
+			}
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				this->mHandle = handle;
+				this->mLoop._watch(*this);
+			}
+
+			/**
+			 * @returns `true` if the descriptor is ready (or has failed, which the next call on it reports); `false` if the wait has been cancelled (see `cancel`.)
+			 */
+			bool await_resume() const noexcept {
+				return !this->mCancelled;
+			}
+
+		};
+
+		/**
+		 * @brief Awaits a point in time (see `sleep`.)
+		 */
+		class SleepAwaiter {
+
+			EventLoop& mLoop;
+			std::chrono::steady_clock::time_point mDue;
+
+		public:
+
+			SleepAwaiter(EventLoop& loop, const std::chrono::steady_clock::time_point due) : mLoop{ loop }, mDue{ due } {
+			}
+
+			bool await_ready() const noexcept {
+				return std::chrono::steady_clock::now() >= this->mDue;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				this->mLoop.mTimers.push(Timer{ this->mDue, handle });
+			}
+
+			void await_resume() const noexcept {
+			}
+
+		};
+
+	private:
+
+		/**
+		 * @brief The coroutines waiting for a descriptor; at most one per direction.
+		 */
+		struct Watch {
+			IoAwaiter* reader = nullptr;
+			IoAwaiter* writer = nullptr;
+			unsigned int interest = 0; // what the reactor watches the descriptor for
+			bool added = false; // whether the descriptor is registered with the reactor
+		};
+
+		struct Timer {
+			std::chrono::steady_clock::time_point due;
+			std::coroutine_handle<> handle;
+
+			bool operator>(const Timer& other) const {
+				return this->due > other.due;
+			}
+		};
+
+		/**
+		 * @brief The coroutine running a spawned task to completion; it destroys itself when the task has finished.
+		 */
+		struct Detached {
+			struct promise_type {
+				Detached get_return_object() noexcept {
+					return Detached{ std::coroutine_handle<promise_type>::from_promise(*this) };
+				}
+
+				std::suspend_always initial_suspend() const noexcept {
+					return {};
+				}
+
+				std::suspend_never final_suspend() const noexcept {
+					return {};
+				}
+
+				void return_void() const noexcept {
+				}
+
+				void unhandled_exception() const noexcept {
+					std::terminate();
+				}
+
+				static void* operator new(const size_t size) {
+					return BufferPool::local().allocate(size);
+				}
+
+				static void operator delete(void* frame, const size_t size) {
+					BufferPool::local().deallocate(frame, size);
+				}
+			};
+
+			std::coroutine_handle<promise_type> handle;
+		};
+
+		std::unique_ptr<Reactor> mReactor = Reactor::create();
+		Slab<Watch> mWatches; // indexed by descriptor
+		std::vector<std::coroutine_handle<>> mReady; // resumed in order by the next turn of the loop
+		std::priority_queue<Timer, std::vector<Timer>, std::greater<>> mTimers;
+		size_t mTasks = 0; // spawned tasks that have not finished
+		bool mStopping = false;
+
+		static constexpr size_t MAX_EVENTS = 256;
+
+		static Detached _detach(EventLoop&, Task<void>);
+		void _watch(IoAwaiter&);
+		void _update(const int, Watch&, const unsigned int);
+		int _timeout() const;
+		void _fire_timers();
+
+	public:
+
+		EventLoop() = default;
+		EventLoop(const EventLoop&) = delete;
+		EventLoop& operator=(const EventLoop&) = delete;
+
+		/**
+		 * @brief Waits until `fd` can be read from (or has been closed by the peer, or has failed.)
+		 */
+		IoAwaiter readable(const int fd) {
+			return IoAwaiter{ *this, fd, Reactor::READABLE };
+		}
+
+		/**
+		 * @brief Waits until `fd` can be written to (or has failed.)
+		 */
+		IoAwaiter writable(const int fd) {
+			return IoAwaiter{ *this, fd, Reactor::WRITABLE };
+		}
+
+		/**
+		 * @brief Waits for `duration`; other coroutines run meanwhile.
+		 */
+		SleepAwaiter sleep(const std::chrono::milliseconds duration) {
+			return SleepAwaiter{ *this, std::chrono::steady_clock::now() + duration };
+		}
+
+		void spawn(Task<void>);
+		void schedule(std::coroutine_handle<>);
+		void cancel(const int);
+		void forget(const int);
+		void run();
+		void stop();
+
+		/**
+		 * @returns The number of spawned tasks that have not finished.
+		 */
+		size_t taskCount() const {
+			return this->mTasks;
+		}
+
+	};
+
+}
@@ -0,0 +1,227 @@
+#include "framing.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Writes the header to `out`, which must have room for `SIZE` bytes.
+	 * @returns void
+	 */
+	void FrameHeader::encode(char* out) const
+	{
+		out[0] = (char)(this->length >> 24);
+		out[1] = (char)(this->length >> 16);
+		out[2] = (char)(this->length >> 8);
+		out[3] = (char)this->length;
+		out[4] = (char)this->type;
+		out[5] = (char)(this->sender >> 24);
+		out[6] = (char)(this->sender >> 16);
+		out[7] = (char)(this->sender >> 8);
+		out[8] = (char)this->sender;
+	}
+
+	/**
+	 * @brief Reads a header from the `SIZE` bytes at `in`.
+	 */
+	FrameHeader FrameHeader::decode(const char* in)
+	{
+		const unsigned char* bytes = (const unsigned char*)in;
+
+		FrameHeader header;
+		header.length = (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+		header.type = (MessageType)bytes[4];
+		header.sender = (uint32_t)bytes[5] << 24 | (uint32_t)bytes[6] << 16 | (uint32_t)bytes[7] << 8 | bytes[8];
+
+		return header;
+	}
+
+	/**
+	 * @brief Moves the unconsumed bytes to the front of the buffer, making room at the back.
+	 */
+	void LineBuffer::_compact()
+	{
+		if (this->mBegin == 0)
+			return;
+
+		size_t length = this->mEnd - this->mBegin;
+		std::memmove(this->mBuffer.data(), this->mBuffer.data() + this->mBegin, length);
+
+		this->mScanned -= this->mBegin;
+		this->mBegin = 0;
+		this->mEnd = length;
+	}
+
+	/**
+	 * @brief Gets the free space at the back of the buffer, to receive into. Views returned by `nextLine` are invalidated.
+	 * @returns The free space (empty only if a single partial line fills the whole buffer, which `nextLine` then hands out.)
+	 */
+	std::span<char> LineBuffer::writable()
+	{
+		if (this->mEnd == this->mBuffer.size())
+			this->_compact();
+
+		return std::span<char>{ this->mBuffer.data() + this->mEnd, this->mBuffer.size() - this->mEnd };
+	}
+
+	/**
+	 * @brief Marks `n` bytes of the space returned by `writable` as received.
+	 */
+	void LineBuffer::commit(const size_t n)
+	{
+		this->mEnd += n;
+	}
+
+	/**
+	 * @brief Copies as much of `data` as fits into the buffer (for bytes that were received elsewhere, e.g., into a buffer provided to the kernel.) Consume the lines with `nextLine` and append the rest afterwards.
+	 * @param[in] data The received bytes.
+	 * @returns The number of bytes copied.
+	 */
+	size_t LineBuffer::append(const std::string_view data)
+	{
+		std::span<char> space = this->writable();
+		size_t n = std::min(space.size(), data.size());
+
+		std::memcpy(space.data(), data.data(), n);
+		this->commit(n);
+
+		return n;
+	}
+
+	/**
+	 * @brief Checks whether `nextLine` would hand out a line, without handing it out (e.g., to decide whether the connection may have another message handled before taking it.) The scan is remembered, so `nextLine` does not repeat it.
+	 * @returns `true` if a complete line (or a line too long for the buffer) is buffered.
+	 */
+	bool LineBuffer::hasLine()
+	{
+		const char* data = this->mBuffer.data();
+		const void* newline = std::memchr(data + this->mScanned, '\n', this->mEnd - this->mScanned);
+
+		if (newline != nullptr) {
+			this->mScanned = (size_t)((const char*)newline - data);
+			return true;
+		}
+
+		this->mScanned = this->mEnd;
+
+		return this->mBegin == 0 && this->mEnd == this->mBuffer.size();
+	}
+
+	/**
+	 * @brief Gets the next complete line, without its "\r\n" (or "\n".) A line that does not fit in the buffer is handed out in pieces of the buffer's capacity.
+	 * @param[out] line The line; it stays valid until the next call to `writable`, `commit`, `append` or `receive`.
+	 * @returns `true` if a line was found; `false` if only a partial line (or nothing) is buffered.
+	 */
+	bool LineBuffer::nextLine(std::string_view& line)
+	{
+		const char* data = this->mBuffer.data();
+		const void* newline = std::memchr(data + this->mScanned, '\n', this->mEnd - this->mScanned);
+
+		if (newline == nullptr) {
+			this->mScanned = this->mEnd;
+
+			// the buffer holds a single line that is too long; hand it out so that reading can go on
+			if (this->mBegin == 0 && this->mEnd == this->mBuffer.size()) {
+				line = std::string_view{ data, this->mEnd };
+				this->mBegin = this->mEnd = this->mScanned = 0;
+				return true;
+			}
+
+			return false;
+		}
+
+		size_t pos = (const char*)newline - data;
+		size_t length = pos - this->mBegin;
+
+		if (length > 0 && data[pos - 1] == '\r')
+			length--;
+
+		line = std::string_view{ data + this->mBegin, length };
+
+		this->mBegin = this->mScanned = pos + 1;
+
+		// reuse the buffer from the start whenever it has been consumed completely
+		if (this->mBegin == this->mEnd)
+			this->mBegin = this->mEnd = this->mScanned = 0;
+
+		return true;
+	}
+
+	/**
+	 * @brief Checks whether `nextFrame` would find something other than a partial frame (a complete frame, or one that cannot fit), without taking it.
+	 */
+	bool LineBuffer::hasFrame() const
+	{
+		if (this->size() < FrameHeader::SIZE)
+			return false;
+
+		FrameHeader header = FrameHeader::decode(this->mBuffer.data() + this->mBegin);
+
+		return header.length > this->capacity() - FrameHeader::SIZE || this->size() >= FrameHeader::SIZE + header.length;
+	}
+
+	/**
+	 * @brief Gets the next complete binary frame.
+	 * @param[out] header The header of the frame.
+	 * @param[out] payload The payload of the frame; it stays valid until the next call to `writable`, `commit`, `append` or `receive`.
+	 * @returns `FrameStatus::COMPLETE` if a frame was found.
+	 */
+	FrameStatus LineBuffer::nextFrame(FrameHeader& header, std::string_view& payload)
+	{
+		if (this->size() < FrameHeader::SIZE)
+			return FrameStatus::PARTIAL;
+
+		header = FrameHeader::decode(this->mBuffer.data() + this->mBegin);
+
+		if (header.length > this->capacity() - FrameHeader::SIZE)
+			return FrameStatus::OVERSIZED;
+
+		if (this->size() < FrameHeader::SIZE + header.length)
+			return FrameStatus::PARTIAL;
+
+		payload = std::string_view{ this->mBuffer.data() + this->mBegin + FrameHeader::SIZE, header.length };
+		this->discard(FrameHeader::SIZE + header.length);
+
+		return FrameStatus::COMPLETE;
+	}
+
+	/**
+	 * @brief Drops the first `n` buffered bytes (at most `size()`) without handing them out.
+	 * @returns void
+	 */
+	void LineBuffer::discard(const size_t n)
+	{
+		this->mBegin += n;
+		this->mScanned = std::max(this->mScanned, this->mBegin);
+
+		// reuse the buffer from the start whenever it has been consumed completely
+		if (this->mBegin == this->mEnd)
+			this->mBegin = this->mEnd = this->mScanned = 0;
+	}
+
+	/**
+	 * @brief Receives whatever socket `sockFd` has available into the buffer, without blocking (where `RECV_DONTWAIT` is supported.)
+	 * @param[in] sockFd The socket to receive from.
+	 * @returns The number of received bytes; `0` if the peer has closed the connection; `-1` on error (check `wouldBlock(lastSocketError())`.)
+	 */
+	int LineBuffer::receive(const int sockFd)
+	{
+		std::span<char> space = this->writable();
+
+		// the caller has not consumed the lines yet; report that there is nothing to receive now
+		if (space.empty()) {
+#ifdef _WIN32
+			::WSASetLastError(WSAEWOULDBLOCK);
+#else
+			errno = EWOULDBLOCK;
+#endif
+			return -1;
+		}
+
+		int rd = (int)::recv(sockFd, space.data(), (int)space.size(), RECV_DONTWAIT);
+
+		if (rd > 0)
+			this->commit((size_t)rd);
+
+		return rd;
+	}
+
+}
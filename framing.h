@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "common.h"
+#include "pool.h"
+
+namespace m0st4fa {
+
+#ifdef MSG_DONTWAIT
+	inline constexpr int RECV_DONTWAIT = MSG_DONTWAIT;
+#else
+	inline constexpr int RECV_DONTWAIT = 0; // Windows: descriptors are level-triggered there, so one receive per readiness event never blocks
+#endif
+
+	/**
+	 * @brief The wire format of a connection. Every connection starts with telnet-style lines; a client opts into binary frames by sending `BINARY_HELLO` (or `DEFLATE_HELLO`, to also ask for compressed frames) followed by a `NONCE_SIZE`-byte nonce of its choice before anything else.
+	 */
+	enum class Protocol : uint8_t {
+		PENDING, // nothing has been received yet
+		TEXT, // lines ending in "\r\n", with prompts
+		BINARY, // frames (see `FrameHeader`), without prompts
+	};
+
+	inline constexpr std::string_view BINARY_HELLO{ "\0CHATBIN", 8 }; // no telnet client starts with a NUL byte
+	inline constexpr std::string_view DEFLATE_HELLO{ "\0CHATDFL", 8 }; // `BINARY_HELLO`, and large messages may come as `COMPRESSED` frames
+	inline constexpr size_t NONCE_SIZE = 8;
+	inline constexpr size_t COMPRESSED_PREFIX_SIZE = 5; // the original type and length in front of the payload of a `COMPRESSED` frame
+
+	/**
+	 * @brief What a binary frame carries.
+	 */
+	enum class MessageType : uint8_t {
+		HELLO = 1, // server: the switch to binary frames is done; the payload is the nonce the client has sent with `BINARY_HELLO`, and everything received before this frame is text to be skipped. After `DEFLATE_HELLO`, the nonce is preceded by `DEFLATE_CODEC` if the server will send `COMPRESSED` frames
+		MESSAGE = 2, // client: a message (or a command, if it starts with '/') to the channel; server: a message of `sender`
+		NOTICE = 3, // server: a notice about `sender` (e.g., it has joined the channel), or a reply to a command (`sender` is `0`)
+		PING = 4, // server: checks that an idle connection is still there; it has no payload, and needs no answer
+		PRIVATE = 5, // server: a direct message from `sender` to the recipient alone (see `/msg`)
+		COMPRESSED = 6, // server: another frame, about the same `sender`, whose payload has been compressed (see `DEFLATE_CODEC`); the payload is the type of that frame, the length of its payload (network byte order), then the compressed payload
+	};
+
+	/**
+	 * @brief The header in front of every binary frame. The fields are sent in network byte order, without padding.
+	 */
+	struct FrameHeader {
+		static constexpr size_t SIZE = 9;
+
+		uint32_t length = 0; // of the payload
+		MessageType type = MessageType::MESSAGE;
+		uint32_t sender = 0; // the id (socket) of the connection the frame is about
+
+		void encode(char*) const;
+		static FrameHeader decode(const char*);
+	};
+
+	/**
+	 * @brief The result of looking for the next binary frame in a buffer.
+	 */
+	enum class FrameStatus {
+		COMPLETE,
+		PARTIAL, // the rest of the frame has not been received yet
+		OVERSIZED, // the frame cannot fit in the buffer; the stream cannot be read any further
+	};
+
+	/**
+	 * @brief Persistent input buffer of a connection with incremental parsers for lines and binary frames. Bytes are received straight into the buffer, complete lines (or frames) are handed out as views into it, and a partial one is kept until the rest of it arrives. It allocates once, when it is created.
+	 */
+	class LineBuffer {
+
+		std::vector<char, PoolAllocator<char>> mBuffer;
+		size_t mBegin = 0; // start of the bytes not handed out yet
+		size_t mEnd = 0; // end of the received bytes
+		size_t mScanned = 0; // bytes before this position are known not to contain '\n'
+
+		void _compact();
+
+	public:
+
+		static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+		explicit LineBuffer(const size_t capacity = DEFAULT_CAPACITY) : mBuffer(capacity) {
+		}
+
+		std::span<char> writable();
+		void commit(const size_t);
+		size_t append(const std::string_view);
+		bool hasLine();
+		bool nextLine(std::string_view&);
+		bool hasFrame() const;
+		FrameStatus nextFrame(FrameHeader&, std::string_view&);
+		void discard(const size_t);
+		int receive(const int);
+
+		/**
+		 * @returns The buffered bytes that have not been handed out yet.
+		 */
+		std::string_view pending() const {
+			return std::string_view{ this->mBuffer.data() + this->mBegin, this->size() };
+		}
+
+		/**
+		 * @returns The number of buffered bytes that have not been handed out as lines yet.
+		 */
+		size_t size() const {
+			return this->mEnd - this->mBegin;
+		}
+
+		size_t capacity() const {
+			return this->mBuffer.size();
+		}
+
+	};
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Histogram of non-negative values (e.g., latencies in nanoseconds) with log-linear buckets: values below `SUB_BUCKETS` are counted exactly, and every larger power of two is split into `SUB_BUCKETS` buckets, so percentiles are off by less than 1/`SUB_BUCKETS`. Recording is O(1) and the memory is fixed, however many values are recorded.
+	 * @tparam Count The type of the counters: `uint64_t`, or a type with `+=`, assignment from and conversion to `uint64_t` (e.g., a counter that other threads may read.)
+	 */
+	template <typename Count>
+	class BasicLatencyHistogram {
+
+		template <typename>
+		friend class BasicLatencyHistogram;
+
+		static constexpr size_t SUB_BUCKETS = 64;
+		static constexpr size_t SUB_BITS = 6; // log2(SUB_BUCKETS)
+		static constexpr size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+		std::array<Count, BUCKETS> mCounts{};
+		Count mCount{};
+		Count mSum{};
+		Count mMax{};
+
+		static size_t _bucket_of(const uint64_t value) {
+			if (value < SUB_BUCKETS)
+				return (size_t)value;
+
+			size_t shift = (size_t)std::bit_width(value) - SUB_BITS - 1;
+			return (shift + 1) * SUB_BUCKETS + (size_t)((value >> shift) - SUB_BUCKETS);
+		}
+
+		/**
+		 * @returns The largest value counted in `bucket`.
+		 */
+		static uint64_t _upper_bound(const size_t bucket) {
+			if (bucket < SUB_BUCKETS)
+				return bucket;
+
+			size_t shift = bucket / SUB_BUCKETS - 1;
+			uint64_t sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+
+			return ((sub + 1) << shift) - 1;
+		}
+
+	public:
+
+		void record(const uint64_t value) {
+			this->mCounts[_bucket_of(value)] += 1;
+			this->mCount += 1;
+			this->mSum += value;
+
+			if (value > (uint64_t)this->mMax)
+				this->mMax = value;
+		}
+
+		/**
+		 * @brief Adds the values recorded by `other` (e.g., by another thread) to this histogram.
+		 */
+		template <typename OtherCount>
+		void merge(const BasicLatencyHistogram<OtherCount>& other) {
+			for (size_t i = 0; i < BUCKETS; i++)
+				this->mCounts[i] += (uint64_t)other.mCounts[i];
+
+			this->mCount += (uint64_t)other.mCount;
+			this->mSum += (uint64_t)other.mSum;
+
+			if ((uint64_t)other.mMax > (uint64_t)this->mMax)
+				this->mMax = (uint64_t)other.mMax;
+		}
+
+		/**
+		 * @brief Gets the value below which the fraction `p` (between `0` and `1`) of the recorded values fall.
+		 * @returns The value (rounded up to the bound of its bucket, but never above the largest recorded value); `0` if nothing has been recorded.
+		 */
+		uint64_t percentile(const double p) const {
+			uint64_t count = this->mCount;
+			uint64_t max = this->mMax;
+
+			if (count == 0)
+				return 0;
+
+			uint64_t rank = (uint64_t)(p * (double)count);
+			if (rank >= count)
+				rank = count - 1;
+
+			uint64_t seen = 0;
+
+			for (size_t i = 0; i < BUCKETS; i++) {
+				seen += (uint64_t)this->mCounts[i];
+
+				if (seen > rank)
+					return _upper_bound(i) < max ? _upper_bound(i) : max;
+			}
+
+			return max;
+		}
+
+		uint64_t count() const {
+			return this->mCount;
+		}
+
+		uint64_t max() const {
+			return this->mMax;
+		}
+
+		double mean() const {
+			uint64_t count = this->mCount;
+			return count == 0 ? 0 : (double)(uint64_t)this->mSum / (double)count;
+		}
+
+	};
+
+	using LatencyHistogram = BasicLatencyHistogram<uint64_t>;
+
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include "logger.h"
+
+namespace m0st4fa {
+
+	thread_local LogRing* Logger::tRing = nullptr;
+
+	Logger::Logger() : mOut{ &std::cout }, mErr{ &std::cerr }
+	{
+		this->mThread = std::thread{ &Logger::_run, this };
+	}
+
+	/**
+	 * @brief Writes out whatever is still queued, then stops the background thread. It runs at exit, so messages logged right before `std::exit` are not lost.
+	 */
+	Logger::~Logger()
+	{
+		{
+			std::lock_guard lock{ this->mMutex };
+			this->mStopping = true;
+		}
+
+		this->mWake.notify_one();
+		this->mThread.join();
+	}
+
+	/**
+	 * @returns The logger of the process, whose background thread starts on first use.
+	 */
+	Logger& Logger::global()
+	{
+		static Logger logger;
+		return logger;
+	}
+
+	/**
+	 * @brief Creates the ring buffer of the calling thread. It belongs to the logger, so that its messages are written out even after the thread has exited.
+	 * @returns The ring.
+	 */
+	LogRing& Logger::_register()
+	{
+		std::lock_guard lock{ this->mMutex };
+
+		tRing = this->mRings.emplace_back(std::make_unique<LogRing>()).get();
+
+		return *tRing;
+	}
+
+	/**
+	 * @brief Formats the messages queued in every ring and writes them out, one write per stream. The caller must hold `mMutex`.
+	 * @returns void
+	 */
+	void Logger::_drain()
+	{
+		for (auto& ring : this->mRings) {
+			uint64_t dropped = ring->drain([this](const LogRecord& record, const char* args) {
+				std::string& batch = record.level == LogLevel::CRITICAL ? this->mErrBatch : this->mOutBatch;
+
+				batch.append("[").append(record.source).append("] ");
+				record.print(batch, record.format, args);
+				batch.append("\n");
+				});
+
+			if (dropped != 0)
+				this->mErrBatch.append(std::format("[logger] Dropped {} messages: the ring buffer of a thread was full\n", dropped));
+		}
+
+		if (!this->mOutBatch.empty()) {
+			*this->mOut << this->mOutBatch;
+			this->mOut->flush();
+			this->mOutBatch.clear();
+		}
+
+		if (!this->mErrBatch.empty()) {
+			*this->mErr << this->mErrBatch;
+			this->mErr->flush();
+			this->mErrBatch.clear();
+		}
+	}
+
+	/**
+	 * @brief The background thread: drains the rings every `INTERVAL` (or sooner, when one fills up) until the logger stops.
+	 * @returns void
+	 */
+	void Logger::_run()
+	{
+		std::unique_lock lock{ this->mMutex };
+
+		while (!this->mStopping) {
+			this->mWake.wait_for(lock, INTERVAL);
+			_drain();
+		}
+
+		_drain();
+	}
+
+	/**
+	 * @brief Writes out every message queued so far, from the calling thread. Call it before terminating without running the destructors (e.g., `std::abort`.)
+	 * @returns void
+	 */
+	void Logger::flush()
+	{
+		std::lock_guard lock{ this->mMutex };
+		_drain();
+	}
+
+	/**
+	 * @brief Writes the messages to `out` (and the critical ones to `err`) instead of the standard streams.
+	 * @returns void
+	 */
+	void Logger::redirect(std::ostream& out, std::ostream& err)
+	{
+		std::lock_guard lock{ this->mMutex };
+		_drain();
+
+		this->mOut = &out;
+		this->mErr = &err;
+	}
+
+}
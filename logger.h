@@ -0,0 +1,292 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// the least severe level that is logged (see `LogLevel`); the calls below it compile to nothing
+#ifndef MIN_LOG_LEVEL
+#define MIN_LOG_LEVEL 1
+#endif
+
+/**
+ * @brief Logs a message at `level` from `source` (e.g., "server"): `LOG_AT(level, source, format, args...)`. The format string is checked at compile time; the arguments are copied into the ring buffer of the calling thread, and the message is formatted and written by the background thread of the logger.
+ */
+#define LOG_AT(level, ...) \
+	do { \
+		if constexpr ((int)(level) >= MIN_LOG_LEVEL) \
+			::m0st4fa::Logger::write< level >(__VA_ARGS__); \
+	} while (false)
+
+#define LOG_TRACE(...) LOG_AT(::m0st4fa::LogLevel::TRACE, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(::m0st4fa::LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(::m0st4fa::LogLevel::WARNING, __VA_ARGS__)
+#define LOG_CRITICAL(...) LOG_AT(::m0st4fa::LogLevel::CRITICAL, __VA_ARGS__)
+
+namespace m0st4fa {
+
+	enum class LogLevel : uint8_t {
+		TRACE = 0, // per-message details
+		INFO = 1, // connections coming and going, configuration
+		WARNING = 2, // a connection has failed or misbehaved
+		CRITICAL = 3, // the server cannot go on (written to the error stream)
+	};
+
+	/**
+	 * @brief A logged message in a `LogRing`, followed by its arguments.
+	 */
+	struct LogRecord {
+		uint32_t size; // of the record and its arguments, rounded up to `alignof(LogRecord)`
+		LogLevel level;
+		const char* source;
+		std::string_view format;
+		void (*print)(std::string&, std::string_view, const char*); // formats the arguments; `nullptr` for the padding before the ring wraps around
+	};
+
+	/**
+	 * @brief Bounded lock-free single-producer single-consumer queue of log records. The producer never blocks: a record that does not fit is dropped (and counted.)
+	 */
+	class LogRing {
+
+		static constexpr size_t CAPACITY = 1 << 20; // bytes; a power of 2
+
+		std::unique_ptr<char[]> mData = std::make_unique<char[]>(CAPACITY);
+		alignas(64) std::atomic<size_t> mWritten{ 0 }; // bytes produced, ever
+		alignas(64) std::atomic<size_t> mRead{ 0 }; // bytes consumed, ever
+		alignas(64) size_t mReadCache = 0; // the last `mRead` seen by the producer
+		size_t mReserved = 0; // the bytes taken by the record being written (padding included)
+		std::atomic<uint64_t> mDropped{ 0 };
+
+	public:
+
+		/**
+		 * @brief Makes room for a record of `size` bytes (a multiple of `alignof(LogRecord)`). Producer only.
+		 * @returns Where to write the record; `nullptr` if the ring is full.
+		 */
+		char* reserve(const size_t size) {
+			size_t written = this->mWritten.load(std::memory_order_relaxed);
+			size_t offset = written % CAPACITY;
+
+			// records are contiguous; the end of the ring is skipped if the record does not fit there
+			size_t padding = offset + size > CAPACITY ? CAPACITY - offset : 0;
+
+			if (written + padding + size - this->mReadCache > CAPACITY) {
+				this->mReadCache = this->mRead.load(std::memory_order_acquire);
+
+				if (written + padding + size - this->mReadCache > CAPACITY) {
+					this->mDropped.fetch_add(1, std::memory_order_relaxed);
+					return nullptr;
+				}
+			}
+
+			if (padding >= sizeof(LogRecord)) {
+				LogRecord skip{ (uint32_t)padding, LogLevel::TRACE, nullptr, {}, nullptr };
+				std::memcpy(this->mData.get() + offset, &skip, sizeof(skip));
+			}
+
+			this->mReserved = padding + size;
+
+			return this->mData.get() + (offset + padding) % CAPACITY;
+		}
+
+		/**
+		 * @brief Publishes the record written after the last `reserve`. Producer only.
+		 * @returns Whether the ring has just become more than half full.
+		 */
+		bool commit() {
+			size_t before = this->mWritten.load(std::memory_order_relaxed);
+			size_t written = before + this->mReserved;
+			this->mWritten.store(written, std::memory_order_release);
+
+			return before - this->mReadCache <= CAPACITY / 2 && written - this->mReadCache > CAPACITY / 2;
+		}
+
+		/**
+		 * @brief Calls `fn` with every record published so far and its arguments, then frees their room. Consumer only.
+		 * @returns The number of records dropped since the last call.
+		 */
+		template <typename Fn>
+		uint64_t drain(Fn&& fn) {
+			size_t read = this->mRead.load(std::memory_order_relaxed);
+			size_t written = this->mWritten.load(std::memory_order_acquire);
+
+			while (read != written) {
+				size_t offset = read % CAPACITY;
+
+				// too little room was left for the padding to be marked
+				if (CAPACITY - offset < sizeof(LogRecord)) {
+					read += CAPACITY - offset;
+					continue;
+				}
+
+				LogRecord record;
+				std::memcpy(&record, this->mData.get() + offset, sizeof(record));
+
+				if (record.print != nullptr)
+					fn(record, this->mData.get() + offset + sizeof(record));
+
+				read += record.size;
+			}
+
+			this->mRead.store(read, std::memory_order_release);
+
+			return this->mDropped.exchange(0, std::memory_order_relaxed);
+		}
+
+	};
+
+	/**
+	 * @brief Asynchronous logger. Every thread that logs gets a ring buffer of its own, so logging threads never contend with each other; a background thread formats the messages and writes them out.
+	 */
+	class Logger {
+
+		std::mutex mMutex; // guards `mRings`, and lets one thread at a time drain them
+		std::condition_variable mWake;
+		std::vector<std::unique_ptr<LogRing>> mRings;
+		std::ostream* mOut;
+		std::ostream* mErr;
+		std::string mOutBatch;
+		std::string mErrBatch;
+		bool mStopping = false;
+		std::thread mThread;
+
+		static thread_local LogRing* tRing; // the ring of the calling thread
+
+		Logger();
+		~Logger();
+
+		LogRing& _register();
+		void _drain();
+		void _run();
+
+		/**
+		 * @brief Whether the arguments of type `T` are logged as text (their bytes are copied) rather than by value.
+		 */
+		template <typename T>
+		static constexpr bool IS_TEXT = std::is_convertible_v<const std::remove_cvref_t<T>&, std::string_view>;
+
+		/**
+		 * @brief How an argument of type `T` is stored in the ring: text is copied, anything else (numbers, characters) must be trivially copyable.
+		 */
+		template <typename T>
+		using Stored = std::conditional_t<IS_TEXT<T>, std::string_view, std::decay_t<T>>;
+
+		template <typename T>
+		static size_t _size_of(const T& arg) {
+			if constexpr (IS_TEXT<T>)
+				return sizeof(uint32_t) + std::string_view{ arg }.size();
+			else
+				return sizeof(Stored<T>);
+		}
+
+		template <typename T>
+		static char* _encode(char* at, const T& arg) {
+			if constexpr (IS_TEXT<T>) {
+				std::string_view text{ arg };
+				uint32_t size = (uint32_t)text.size();
+
+				std::memcpy(at, &size, sizeof(size));
+				std::memcpy(at + sizeof(size), text.data(), size);
+
+				return at + sizeof(size) + size;
+			}
+			else {
+				static_assert(std::is_trivially_copyable_v<Stored<T>>, "Only text and trivially copyable values can be logged");
+
+				Stored<T> value = arg;
+				std::memcpy(at, &value, sizeof(value));
+
+				return at + sizeof(value);
+			}
+		}
+
+		template <typename S>
+		static S _decode(const char*& at) {
+			if constexpr (std::is_same_v<S, std::string_view>) {
+				uint32_t size;
+				std::memcpy(&size, at, sizeof(size));
+
+				std::string_view text{ at + sizeof(size), size };
+				at += sizeof(size) + size;
+
+				return text;
+			}
+			else {
+				S value;
+				std::memcpy(&value, at, sizeof(value));
+				at += sizeof(value);
+
+				return value;
+			}
+		}
+
+		/**
+		 * @brief Formats the arguments encoded at `args` (as `Stored` types) with `format`, and appends the result to `out`.
+		 */
+		template <typename... S>
+		static void _print(std::string& out, const std::string_view format, [[maybe_unused]] const char* args) {
+			// the elements of a braced initializer are evaluated in order; `args` is not read at all without arguments
+			std::tuple<S...> values{ _decode<S>(args)... };
+
+			std::apply([&](auto&... value) {
+				std::vformat_to(std::back_inserter(out), format, std::make_format_args(value...));
+				}, values);
+		}
+
+	public:
+
+		static constexpr std::chrono::milliseconds INTERVAL{ 10 }; // how often the background thread drains the rings
+
+		Logger(const Logger&) = delete;
+		Logger& operator=(const Logger&) = delete;
+
+		static Logger& global();
+
+		/**
+		 * @brief Queues a message to be formatted and written by the background thread; use the `LOG_*` macros instead, which compile out below `MIN_LOG_LEVEL`. It never blocks: if the ring buffer of the calling thread is full, the message is dropped.
+		 * @param[in] source Where the message comes from; it must outlive the logger (e.g., a string literal.)
+		 * @param[in] format The format string, without line ending.
+		 * @param[in] args The arguments; text is copied, anything else must be trivially copyable.
+		 * @returns void
+		 */
+		template <LogLevel LEVEL, typename... Args>
+		static void write(const char* source, std::format_string<Args...> format, Args&&... args) {
+			LogRing* ring = tRing != nullptr ? tRing : &global()._register();
+
+			size_t size = sizeof(LogRecord) + (_size_of(args) + ... + 0);
+			size = (size + alignof(LogRecord) - 1) / alignof(LogRecord) * alignof(LogRecord);
+
+			char* at = ring->reserve(size);
+
+			if (at == nullptr)
+				return;
+
+			LogRecord record{ (uint32_t)size, LEVEL, source, format.get(), &_print<Stored<Args>...> };
+			std::memcpy(at, &record, sizeof(record));
+
+			[[maybe_unused]] char* cursor = at + sizeof(record);
+			((cursor = _encode(cursor, args)), ...);
+
+			if (ring->commit())
+				global().mWake.notify_one(); // do not wait for the interval to drain it
+		}
+
+		void flush();
+		void redirect(std::ostream&, std::ostream&);
+
+	};
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Bounded lock-free multi-producer single-consumer queue (Vyukov's bounded queue, with a single consumer.) Any thread may `push`; only the owning thread may `pop`. The values live in a ring of cells allocated once, so queueing allocates nothing, and a full queue pushes back on its producers instead of growing.
+	 * @tparam T The type of the queued values. It must be default-constructible (for the empty cells.)
+	 */
+	template <typename T>
+	class Mailbox {
+
+		struct Cell {
+			std::atomic<size_t> sequence; // the position the cell is ready to be pushed to (if equal to it), or popped from (if one past it)
+			T value{};
+		};
+
+		std::unique_ptr<Cell[]> mCells;
+		size_t mMask;
+		alignas(64) std::atomic<size_t> mPushed{ 0 }; // producers claim positions here
+		alignas(64) size_t mPopped = 0; // the consumer removes from here
+
+	public:
+
+		/**
+		 * @param[in] capacity The most values queued at once, rounded up to a power of 2.
+		 */
+		explicit Mailbox(const size_t capacity) : mCells{ std::make_unique<Cell[]>(std::bit_ceil(capacity)) }, mMask{ std::bit_ceil(capacity) - 1 } {
+			for (size_t i = 0; i <= this->mMask; i++)
+				this->mCells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		Mailbox(const Mailbox&) = delete;
+		Mailbox& operator=(const Mailbox&) = delete;
+
+		/**
+		 * @brief Appends `value` to the queue, unless it is full. Safe to call from any thread.
+		 * @param[in,out] value The value; it is only moved from if it has been queued.
+		 * @returns `true` if the value has been queued; `false` if the queue is full.
+		 */
+		bool push(T& value) {
+			size_t position = this->mPushed.load(std::memory_order_relaxed);
+
+			while (true) {
+				Cell& cell = this->mCells[position & this->mMask];
+				intptr_t lag = (intptr_t)(cell.sequence.load(std::memory_order_acquire) - position);
+
+				// the cell is free: claim the position
+				if (lag == 0) {
+					if (this->mPushed.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						cell.value = std::move(value);
+						cell.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				// the cell still holds the value pushed a lap ago
+				else if (lag < 0)
+					return false;
+				// another producer has claimed the position
+				else
+					position = this->mPushed.load(std::memory_order_relaxed);
+			}
+		}
+
+		/**
+		 * @brief Removes the oldest value from the queue. Must only be called by the consumer.
+		 * @param[out] out Where to store the removed value.
+		 * @returns `true` if a value was removed; `false` if the queue is empty (or the producer of the oldest value has not finished its `push` yet, in which case it will signal the consumer afterwards.)
+		 */
+		bool pop(T& out) {
+			Cell& cell = this->mCells[this->mPopped & this->mMask];
+
+			if (cell.sequence.load(std::memory_order_acquire) != this->mPopped + 1)
+				return false;
+
+			out = std::move(cell.value);
+			cell.sequence.store(this->mPopped + this->mMask + 1, std::memory_order_release);
+			this->mPopped++;
+
+			return true;
+		}
+
+	};
+
+}
@@ -0,0 +1,539 @@
+#include "message_log.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "framing.h"
+#include "logger.h"
+
+namespace m0st4fa {
+
+	namespace {
+
+		// size, checksum, sequence, time, length of the channel name
+		constexpr size_t RECORD_HEADER_SIZE = 4 + 4 + 8 + 8 + 1;
+
+		/**
+		 * @brief FNV-1a, enough to tell a torn record from a whole one.
+		 */
+		uint32_t checksum(const char* data, const size_t size)
+		{
+			uint32_t hash = 2166136261u;
+
+			for (size_t i = 0; i < size; i++)
+				hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+
+			return hash;
+		}
+
+		/**
+		 * @brief Parses the record at the beginning of `data`.
+		 * @param[in] data The bytes of the segment from the record on.
+		 * @param[in] sequence The sequence number the record must have.
+		 * @param[out] record The record.
+		 * @returns The size of the record; `0` if there is no whole record with `sequence` there.
+		 */
+		size_t parseRecord(const std::string_view data, const uint64_t sequence, MessageLog::Record& record)
+		{
+			if (data.size() < RECORD_HEADER_SIZE)
+				return 0;
+
+			uint32_t size, sum;
+			int64_t at;
+			std::memcpy(&size, data.data(), 4);
+			std::memcpy(&sum, data.data() + 4, 4);
+			std::memcpy(&record.sequence, data.data() + 8, 8);
+			std::memcpy(&at, data.data() + 16, 8);
+			uint8_t channelLength = (uint8_t)data[24];
+
+			if (size < RECORD_HEADER_SIZE - 8 + channelLength + FrameHeader::SIZE || data.size() - 8 < size)
+				return 0;
+
+			if (record.sequence != sequence || checksum(data.data() + 8, size) != sum)
+				return 0;
+
+			std::string_view frame = data.substr(RECORD_HEADER_SIZE + channelLength, size + 8 - RECORD_HEADER_SIZE - channelLength);
+			FrameHeader header = FrameHeader::decode(frame.data());
+
+			if (header.length != frame.size() - FrameHeader::SIZE)
+				return 0;
+
+			record.at = std::chrono::system_clock::time_point{ std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds{ at }) };
+			record.channel = data.substr(RECORD_HEADER_SIZE, channelLength);
+			record.sender = header.sender;
+			record.payload = frame.substr(FrameHeader::SIZE);
+
+			return size + 8;
+		}
+
+		/**
+		 * @brief Writes all of `data` to `fd`.
+		 * @returns Whether it has been written.
+		 */
+		bool writeAll(const int fd, std::string_view data)
+		{
+			while (!data.empty()) {
+				ssize_t rv = ::write(fd, data.data(), data.size());
+
+				if (rv == -1 && errno == EINTR)
+					continue;
+
+				if (rv == -1)
+					return false;
+
+				data.remove_prefix((size_t)rv);
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Maps the file at `path` for reading.
+		 * @returns The mapped bytes; empty if the file is empty or cannot be mapped.
+		 */
+		std::string_view mapFile(const std::string& path)
+		{
+			int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+			if (fd == -1)
+				return {};
+
+			struct stat info{};
+			void* data = MAP_FAILED;
+
+			if (::fstat(fd, &info) == 0 && info.st_size > 0)
+				data = ::mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+			::close(fd);
+
+			if (data == MAP_FAILED)
+				return {};
+
+			::madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+			return { (const char*)data, (size_t)info.st_size };
+		}
+
+		void unmapFile(const std::string_view data)
+		{
+			if (!data.empty())
+				::munmap((void*)data.data(), data.size());
+		}
+
+	}
+
+	/**
+	 * @returns The path of the file of the segment starting with `first`: the segment itself (`extension` is ".log") or its index (".idx").
+	 */
+	std::string MessageLog::_path_of(const uint64_t first, const char* extension) const
+	{
+		return std::format("{}/{:020}{}", this->mPolicy.directory, first, extension);
+	}
+
+	/**
+	 * @brief Opens the segment starting with `first` (and its index) for appending.
+	 * @param[in] first The sequence number of the first record of the segment.
+	 * @param[in] create Whether the segment is a new one, rather than the last one of the log.
+	 * @returns Whether it has been opened.
+	 */
+	bool MessageLog::_open_segment(const uint64_t first, const bool create)
+	{
+		if (this->mSegmentFd != -1)
+			::close(this->mSegmentFd);
+
+		if (this->mIndexFd != -1)
+			::close(this->mIndexFd);
+
+		// a new segment never overwrites one: it is named after a sequence number the log has not reached yet
+		int flags = O_WRONLY | O_APPEND | O_CLOEXEC;
+		this->mSegmentFd = ::open(_path_of(first, ".log").c_str(), flags | (create ? O_CREAT | O_EXCL : 0), 0644);
+		this->mIndexFd = ::open(_path_of(first, ".idx").c_str(), flags | O_CREAT | (create ? O_TRUNC : 0), 0644);
+
+		if (this->mSegmentFd == -1 || this->mIndexFd == -1) {
+			LOG_CRITICAL("log", "Could not open segment {} in {}: {}", first, this->mPolicy.directory, strerror(errno));
+			return false;
+		}
+
+		if (!create)
+			return true;
+
+		this->mSegments.push_back(first);
+		this->mSegmentSize = 0;
+		this->mIndexed = 0;
+
+		// the new file has to survive a crash as much as what is written to it
+		int dir = ::open(this->mPolicy.directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dir != -1) {
+			::fsync(dir);
+			::close(dir);
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Reads the index of the segment starting with `first`; an entry the process has died while writing is left out.
+	 */
+	std::vector<MessageLog::IndexEntry> MessageLog::_read_index(const uint64_t first) const
+	{
+		std::vector<IndexEntry> index;
+		std::string_view data = mapFile(_path_of(first, ".idx"));
+
+		index.resize(data.size() / sizeof(IndexEntry));
+		std::memcpy(index.data(), data.data(), index.size() * sizeof(IndexEntry));
+		unmapFile(data);
+
+		return index;
+	}
+
+	/**
+	 * @brief Checks an entry of the index of the segment starting with `first` against the segment: the record it points at must be there, whole, with its sequence number (and after the beginning of the segment.)
+	 * @param[in] data The bytes of the segment.
+	 * @param[in] entry The entry.
+	 * @param[in] first The sequence number of the first record of the segment.
+	 * @returns Whether the scan of the segment may start from `entry`.
+	 */
+	bool MessageLog::_points_at_record(const std::string_view data, const IndexEntry& entry, const uint64_t first)
+	{
+		Record record;
+
+		return entry.sequence > first && entry.offset > 0 && entry.offset < data.size() && parseRecord(data.substr(entry.offset), entry.sequence, record) != 0;
+	}
+
+	/**
+	 * @brief Finds where the last segment ends: from its last index entry (rather than from its beginning), it checks the records up to the end, and cuts off the torn one there may be. The index is not synced, so its entries are only trusted once the record they point at has been found there; the index is cut at the first one that does not hold, and the scan starts from the last one that does (or from the beginning of the segment.)
+	 * @returns Whether the last segment is open for appending.
+	 */
+	bool MessageLog::_recover()
+	{
+		if (this->mSegments.empty())
+			return _open_segment(0, true);
+
+		uint64_t first = this->mSegments.back();
+		std::string path = _path_of(first, ".log");
+		std::vector<IndexEntry> index = _read_index(first);
+		std::string_view data = mapFile(path);
+		Record record;
+
+		// entries are only written once the records they point at are synced, but they may have been lost (or the segment cut short) since
+		size_t valid = 0;
+		while (valid < index.size() && _points_at_record(data, index[valid], first))
+			valid++;
+
+		if (valid < index.size())
+			LOG_WARNING("log", "Ignoring {} of the {} entries of the index of {}", index.size() - valid, index.size(), path);
+
+		index.resize(valid);
+
+		IndexEntry start = index.empty() ? IndexEntry{ first, 0 } : index.back();
+		uint64_t offset = start.offset;
+		uint64_t sequence = start.sequence;
+
+		while (size_t length = parseRecord(data.substr(offset), sequence, record)) {
+			offset += length;
+			sequence++;
+		}
+
+		size_t size = data.size();
+		unmapFile(data);
+
+		if (offset < size) {
+			LOG_WARNING("log", "Cutting off {} bytes at the end of {}", size - offset, path);
+
+			if (::truncate(path.c_str(), (off_t)offset) == -1) {
+				LOG_CRITICAL("log", "Could not truncate {}: {}", path, strerror(errno));
+				return false;
+			}
+		}
+
+		if (::truncate(_path_of(first, ".idx").c_str(), (off_t)(index.size() * sizeof(IndexEntry))) == -1 && errno != ENOENT) {
+			LOG_CRITICAL("log", "Could not truncate the index of {}: {}", path, strerror(errno));
+			return false;
+		}
+
+		this->mNextSequence = sequence;
+		this->mSegmentSize = offset;
+		this->mIndexed = start.offset;
+
+		return _open_segment(first, false);
+	}
+
+	/**
+	 * @brief Opens the log in `policy.directory` (creating it if needed), recovers its end, and starts the thread that commits the appended messages.
+	 * @param[in] policy Where the log is and how often it is committed.
+	 * @returns Whether the log can be appended to.
+	 */
+	bool MessageLog::open(const LogPolicy& policy)
+	{
+		this->mPolicy = policy;
+		this->mPolicy.commitMessages = std::max<size_t>(policy.commitMessages, 1);
+
+		std::error_code error;
+		std::filesystem::create_directories(policy.directory, error);
+
+		if (error) {
+			LOG_CRITICAL("log", "Could not create {}: {}", policy.directory, error.message());
+			return false;
+		}
+
+		for (const auto& entry : std::filesystem::directory_iterator(policy.directory, error)) {
+			std::string name = entry.path().filename().string();
+			uint64_t first = 0;
+
+			if (!name.ends_with(".log"))
+				continue;
+
+			auto [end, ec] = std::from_chars(name.data(), name.data() + name.size() - 4, first);
+
+			if (ec == std::errc{} && end == name.data() + name.size() - 4)
+				this->mSegments.push_back(first);
+		}
+
+		std::sort(this->mSegments.begin(), this->mSegments.end());
+
+		if (error || !_recover())
+			return false;
+
+		LOG_INFO("log", "Opened the message log in {}: {} segments, {} messages", policy.directory, this->mSegments.size(), this->mNextSequence);
+
+		this->mThread = std::thread{ &MessageLog::_run, this };
+
+		return true;
+	}
+
+	/**
+	 * @brief Queues the message broadcast in `frame` to `channel` for the next commit. It takes no system call: the log shares the frame, and the message is written with the rest of its batch by the thread of the log.
+	 * @param[in] channel The name of the channel (at most 255 bytes); it must outlive the log.
+	 * @param[in] frame The frame of the message (see `FrameHeader`); only its binary part is written.
+	 * @returns void
+	 */
+	void MessageLog::append(const std::string_view channel, Frame frame)
+	{
+		int64_t at = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		std::lock_guard lock{ this->mMutex };
+
+		if (this->mPending.size() >= MAX_PENDING) {
+			this->mDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		this->mPending.push_back(Pending{ std::move(frame), channel.substr(0, UINT8_MAX), at });
+		this->mAppended.fetch_add(1, std::memory_order_relaxed);
+
+		// the thread of the log is only woken once per batch; otherwise it wakes up on its own after `commitInterval`
+		if (this->mPending.size() == this->mPolicy.commitMessages)
+			this->mWake.notify_one();
+	}
+
+	/**
+	 * @brief Commits the appended messages in batches until the log is closed.
+	 * @returns void
+	 */
+	void MessageLog::_run()
+	{
+		std::unique_lock lock{ this->mMutex };
+
+		while (true) {
+			this->mWake.wait_for(lock, this->mPolicy.commitInterval, [this]() {
+				return this->mStopping || this->mPending.size() >= this->mPolicy.commitMessages;
+				});
+
+			if (this->mPending.empty()) {
+				if (this->mStopping)
+					return;
+
+				continue;
+			}
+
+			this->mBatch.swap(this->mPending);
+
+			lock.unlock();
+			_commit();
+			lock.lock();
+		}
+	}
+
+	/**
+	 * @brief Appends `pending` to the batch being committed.
+	 * @returns void
+	 */
+	void MessageLog::_encode(const Pending& pending)
+	{
+		std::string_view frame = *pending.frame;
+		frame = frame.substr(0, FrameHeader::SIZE + FrameHeader::decode(frame.data()).length);
+
+		uint32_t size = (uint32_t)(RECORD_HEADER_SIZE - 8 + pending.channel.size() + frame.size());
+		size_t at = this->mBuffer.size();
+		this->mBuffer.resize(at + 8 + size);
+
+		char* record = this->mBuffer.data() + at;
+		std::memcpy(record, &size, 4);
+		std::memcpy(record + 8, &this->mNextSequence, 8);
+		std::memcpy(record + 16, &pending.at, 8);
+		record[24] = (char)pending.channel.size();
+		std::memcpy(record + RECORD_HEADER_SIZE, pending.channel.data(), pending.channel.size());
+		std::memcpy(record + RECORD_HEADER_SIZE + pending.channel.size(), frame.data(), frame.size());
+
+		uint32_t sum = checksum(record + 8, size);
+		std::memcpy(record + 4, &sum, 4);
+	}
+
+	/**
+	 * @brief Writes the batch with a single write, syncs it, then indexes it. A log that cannot be written to is fatal: the server would go on losing messages it has promised to keep.
+	 * @returns void
+	 */
+	void MessageLog::_commit()
+	{
+		if (this->mSegmentSize >= this->mPolicy.segmentSize && !_open_segment(this->mNextSequence, true)) {
+			Logger::global().flush();
+			std::abort();
+		}
+
+		std::vector<IndexEntry> entries;
+		this->mBuffer.clear();
+
+		for (const Pending& pending : this->mBatch) {
+			uint64_t offset = this->mSegmentSize + this->mBuffer.size();
+
+			if (offset - this->mIndexed >= INDEX_INTERVAL) {
+				entries.push_back(IndexEntry{ this->mNextSequence, offset });
+				this->mIndexed = offset;
+			}
+
+			_encode(pending);
+			this->mNextSequence++;
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+
+		if (!writeAll(this->mSegmentFd, this->mBuffer) || ::fdatasync(this->mSegmentFd) == -1) {
+			LOG_CRITICAL("log", "Could not write to the message log in {}: {}", this->mPolicy.directory, strerror(errno));
+			Logger::global().flush();
+			std::abort();
+		}
+
+		uint64_t synced = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+
+		// the index is only a hint (see `_recover`), so it is not synced
+		if (!entries.empty())
+			writeAll(this->mIndexFd, std::string_view{ (const char*)entries.data(), entries.size() * sizeof(IndexEntry) });
+
+		this->mSegmentSize += this->mBuffer.size();
+
+		this->mCommitted.fetch_add(this->mBatch.size(), std::memory_order_relaxed);
+		this->mCommits.fetch_add(1, std::memory_order_relaxed);
+		this->mBytes.fetch_add(this->mBuffer.size(), std::memory_order_relaxed);
+		this->mSyncNanoseconds.fetch_add(synced, std::memory_order_relaxed);
+
+		if (synced > this->mMaxSyncNanoseconds.load(std::memory_order_relaxed))
+			this->mMaxSyncNanoseconds.store(synced, std::memory_order_relaxed);
+
+		this->mBatch.clear();
+	}
+
+	/**
+	 * @brief Reads back the last `count` messages of the log, oldest first, through `mmap`. The index of a segment leads to the first of them without parsing what comes before. It must be called before anything is appended.
+	 * @param[in] count The most messages to read.
+	 * @param[in] fn Called with every message.
+	 * @returns The number of messages read.
+	 */
+	size_t MessageLog::readRecent(const size_t count, const std::function<void(const Record&)>& fn) const
+	{
+		uint64_t from = this->mNextSequence - std::min<uint64_t>(count, this->mNextSequence);
+		size_t read = 0;
+
+		// the segment holding `from`, then the ones after it
+		auto segment = std::upper_bound(this->mSegments.begin(), this->mSegments.end(), from);
+
+		if (segment != this->mSegments.begin())
+			segment--;
+
+		for (; segment != this->mSegments.end(); segment++) {
+			IndexEntry start{ *segment, 0 };
+
+			if (*segment < from)
+				for (const IndexEntry& entry : _read_index(*segment)) {
+					if (entry.sequence > from)
+						break;
+
+					start = entry;
+				}
+
+			std::string_view data = mapFile(_path_of(*segment, ".log"));
+
+			// the indexes of the older segments have not been checked (see `_recover`)
+			if (start.offset != 0 && !_points_at_record(data, start, *segment))
+				start = IndexEntry{ *segment, 0 };
+			uint64_t offset = start.offset;
+			uint64_t sequence = start.sequence;
+			Record record;
+
+			while (size_t length = parseRecord(data.substr(std::min<uint64_t>(offset, data.size())), sequence, record)) {
+				if (sequence >= from) {
+					fn(record);
+					read++;
+				}
+
+				offset += length;
+				sequence++;
+			}
+
+			unmapFile(data);
+		}
+
+		return read;
+	}
+
+	/**
+	 * @brief Commits the messages still waiting, then stops the thread of the log.
+	 * @returns void
+	 */
+	void MessageLog::close()
+	{
+		if (this->mThread.joinable()) {
+			{
+				std::lock_guard lock{ this->mMutex };
+				this->mStopping = true;
+			}
+
+			this->mWake.notify_one();
+			this->mThread.join();
+		}
+
+		if (this->mSegmentFd != -1)
+			::close(this->mSegmentFd);
+
+		if (this->mIndexFd != -1)
+			::close(this->mIndexFd);
+
+		this->mSegmentFd = this->mIndexFd = -1;
+	}
+
+	/**
+	 * @brief Gets the counters of the log. It may be called from any thread.
+	 */
+	LogStats MessageLog::stats() const
+	{
+		LogStats stats;
+		stats.appended = this->mAppended.load(std::memory_order_relaxed);
+		stats.dropped = this->mDropped.load(std::memory_order_relaxed);
+		stats.committed = this->mCommitted.load(std::memory_order_relaxed);
+		stats.commits = this->mCommits.load(std::memory_order_relaxed);
+		stats.bytes = this->mBytes.load(std::memory_order_relaxed);
+		stats.syncNanoseconds = this->mSyncNanoseconds.load(std::memory_order_relaxed);
+		stats.maxSyncNanoseconds = this->mMaxSyncNanoseconds.load(std::memory_order_relaxed);
+
+		return stats;
+	}
+
+}
+
+#endif
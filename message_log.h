@@ -0,0 +1,146 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "outbound.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Where a `MessageLog` is kept and how often it is committed.
+	 */
+	struct LogPolicy {
+		std::string directory; // created if it does not exist
+		std::chrono::milliseconds commitInterval{ 10 }; // the longest a message waits to be written and synced
+		size_t commitMessages = 1024; // a commit starts as soon as this many messages are waiting
+		size_t segmentSize = 64 * 1024 * 1024; // a segment that has grown past it is closed, and the next commit starts a new one
+		size_t restoreCount = 4096; // how many of the last messages rebuild the history of the channels on startup
+	};
+
+	/**
+	 * @brief Counters of a `MessageLog`.
+	 */
+	struct LogStats {
+		uint64_t appended = 0; // messages accepted by `append`
+		uint64_t dropped = 0; // messages refused because too many were waiting for the disk
+		uint64_t committed = 0; // messages written and synced
+		uint64_t commits = 0; // writes followed by a sync
+		uint64_t bytes = 0; // written to the segments
+		uint64_t syncNanoseconds = 0; // spent syncing, in total
+		uint64_t maxSyncNanoseconds = 0;
+	};
+
+	/**
+	 * @brief Durable, append-only log of broadcast messages, in segment files named after the sequence number of their first record. Messages are queued by `append` (without any system call) and written by a background thread with group commit: one write and one sync per batch, every `LogPolicy::commitInterval` or `LogPolicy::commitMessages` messages. Every segment has a sparse index of its offsets (one entry every `INDEX_INTERVAL` bytes), so that the end of the log is found and read back (through `mmap`) without parsing whole segments.
+	 *
+	 * A record holds, in the byte order of the host: its size (after the first 8 bytes), a checksum of what follows it, its sequence number, when it has been appended (nanoseconds since the epoch), the length of the channel name, the channel name, then the binary frame of the message (see `FrameHeader`.) A torn record at the end of the log (the process has died while writing it) is cut off when the log is opened.
+	 */
+	class MessageLog {
+
+	public:
+
+		/**
+		 * @brief A message read back from the log; its views point into the mapped segment, and only stay valid during the call it is passed to.
+		 */
+		struct Record {
+			uint64_t sequence = 0;
+			std::chrono::system_clock::time_point at;
+			std::string_view channel;
+			uint32_t sender = 0;
+			std::string_view payload;
+		};
+
+		static constexpr size_t INDEX_INTERVAL = 64 * 1024; // bytes of a segment between two entries of its index
+		static constexpr size_t MAX_PENDING = 1 << 16; // the most messages waiting for the disk; more are dropped
+
+	private:
+
+		/**
+		 * @brief A message waiting for the disk. It shares the frame it has been broadcast in.
+		 */
+		struct Pending {
+			Frame frame;
+			std::string_view channel; // channels live as long as the process
+			int64_t at = 0;
+		};
+
+		/**
+		 * @brief An entry of the index of a segment: where the record with `sequence` starts.
+		 */
+		struct IndexEntry {
+			uint64_t sequence = 0;
+			uint64_t offset = 0;
+		};
+
+		LogPolicy mPolicy;
+
+		// queued by `append`
+		mutable std::mutex mMutex;
+		std::condition_variable mWake;
+		std::vector<Pending> mPending;
+		bool mStopping = false;
+
+		// owned by the writer thread (or by `open`, before it starts)
+		std::vector<Pending> mBatch;
+		std::string mBuffer; // the records of the batch being committed
+		std::vector<uint64_t> mSegments; // the first sequence number of every segment, in order
+		int mSegmentFd = -1;
+		int mIndexFd = -1;
+		uint64_t mSegmentSize = 0;
+		uint64_t mIndexed = 0; // the offset of the last entry of the index of the segment
+		uint64_t mNextSequence = 0;
+		std::thread mThread;
+
+		// written by the writer thread, read by `stats`
+		std::atomic<uint64_t> mAppended{ 0 };
+		std::atomic<uint64_t> mDropped{ 0 };
+		std::atomic<uint64_t> mCommitted{ 0 };
+		std::atomic<uint64_t> mCommits{ 0 };
+		std::atomic<uint64_t> mBytes{ 0 };
+		std::atomic<uint64_t> mSyncNanoseconds{ 0 };
+		std::atomic<uint64_t> mMaxSyncNanoseconds{ 0 };
+
+		std::string _path_of(const uint64_t, const char*) const;
+		bool _open_segment(const uint64_t, const bool);
+		bool _recover();
+		std::vector<IndexEntry> _read_index(const uint64_t) const;
+		static bool _points_at_record(const std::string_view, const IndexEntry&, const uint64_t);
+		void _run();
+		void _commit();
+		void _encode(const Pending&);
+
+	public:
+
+		MessageLog() = default;
+		MessageLog(const MessageLog&) = delete;
+		MessageLog& operator=(const MessageLog&) = delete;
+
+		~MessageLog() {
+			this->close();
+		}
+
+		bool open(const LogPolicy&);
+		void append(const std::string_view, Frame);
+		size_t readRecent(const size_t, const std::function<void(const Record&)>&) const;
+		void close();
+		LogStats stats() const;
+
+		const LogPolicy& policy() const {
+			return this->mPolicy;
+		}
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+#include "outbound.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Queues a copy of `data` behind the bytes already waiting.
+	 * @returns void
+	 */
+	void OutputQueue::append(const std::string_view data)
+	{
+		if (data.empty())
+			return;
+
+		this->append(makeFrame(PooledString{ data }));
+	}
+
+	/**
+	 * @brief Queues `length` bytes of `frame` (all of them by default), from byte `offset` on, behind the bytes already waiting. Nothing is copied.
+	 * @returns void
+	 */
+	void OutputQueue::append(Frame frame, const size_t offset, const size_t length)
+	{
+		if (offset >= frame->size() || length == 0)
+			return;
+
+		size_t end = offset + std::min(length, frame->size() - offset);
+
+		this->mSize += end - offset;
+		this->mSlices.push_back(Slice{ std::move(frame), offset, end });
+	}
+
+	/**
+	 * @brief Describes the bytes at the front of the queue for a gathered send. The described bytes stay valid until they are consumed (or the queue is cleared.)
+	 * @param[out] iov Where to store the descriptions.
+	 * @param[in] max The capacity of `iov`.
+	 * @returns The number of descriptions stored.
+	 */
+	size_t OutputQueue::gather(IoVec* iov, const size_t max) const
+	{
+		size_t count = 0;
+
+		for (auto it = this->mSlices.begin(); it != this->mSlices.end() && count < max; ++it, ++count) {
+			const char* data = it->frame->data() + it->offset;
+			size_t length = it->end - it->offset;
+
+#ifdef _WIN32
+			iov[count].buf = (CHAR*)data;
+			iov[count].len = (ULONG)length;
+#else
+			iov[count].iov_base = (void*)data;
+			iov[count].iov_len = length;
+#endif
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief Removes `n` sent bytes from the front of the queue, releasing the frames that have been sent completely.
+	 * @returns void
+	 */
+	void OutputQueue::consume(size_t n)
+	{
+		this->mSize -= n;
+
+		while (n > 0) {
+			Slice& front = this->mSlices.front();
+			size_t length = front.end - front.offset;
+
+			if (n < length) {
+				front.offset += n;
+				return;
+			}
+
+			n -= length;
+			this->mSlices.pop_front();
+		}
+	}
+
+	/**
+	 * @brief Sends as much of the queue as socket `sockFd` accepts without blocking (the socket must be non-blocking), up to `MAX_IOV` slices per system call. Every send but the last is flagged `SEND_MORE`, so that the kernel does not push out a partial segment between them.
+	 * @param[in] sockFd The socket to send to.
+	 * @returns The number of bytes sent; `-1` if the connection has failed.
+	 */
+	int OutputQueue::flush(const int sockFd)
+	{
+		int total = 0;
+
+		// grows to the largest batch once, rather than being allocated for every flush
+		thread_local std::vector<IoVec> iov;
+		iov.resize(std::min(this->sliceCount(), MAX_IOV));
+
+		while (!this->empty()) {
+			size_t count = this->gather(iov.data(), iov.size());
+			int flags = SEND_NOSIGNAL | (count < this->sliceCount() ? SEND_MORE : 0);
+
+#ifdef _WIN32
+			DWORD sent = 0;
+			int rv = ::WSASend(sockFd, iov.data(), (DWORD)count, &sent, 0, nullptr, nullptr) == 0 ? (int)sent : -1;
+#else
+			msghdr header{};
+			header.msg_iov = iov.data();
+			header.msg_iovlen = count;
+
+			int rv = (int)::sendmsg(sockFd, &header, flags);
+#endif
+
+			if (rv == -1)
+				return wouldBlock(lastSocketError()) ? total : -1;
+
+			this->consume((size_t)rv);
+			total += rv;
+		}
+
+		return total;
+	}
+
+}
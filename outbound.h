@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "common.h"
+#include "pool.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+namespace m0st4fa {
+
+#ifdef MSG_NOSIGNAL
+	inline constexpr int SEND_NOSIGNAL = MSG_NOSIGNAL;
+#else
+	inline constexpr int SEND_NOSIGNAL = 0;
+#endif
+
+#ifdef MSG_MORE
+	inline constexpr int SEND_MORE = MSG_MORE; // more bytes follow at once; the kernel holds back a partial segment
+#else
+	inline constexpr int SEND_MORE = 0;
+#endif
+
+#ifdef _WIN32
+	using IoVec = WSABUF;
+#else
+	using IoVec = iovec;
+#endif
+
+	/**
+	 * @brief Immutable, reference-counted bytes to be sent. A broadcast is built into one frame, which every recipient's output queue shares instead of copying it.
+	 */
+	using Frame = std::shared_ptr<const PooledString>;
+
+	/**
+	 * @brief Turns `data` into a frame. Its bytes and its reference count both come from the buffer pool.
+	 */
+	inline Frame makeFrame(PooledString data) {
+		return std::allocate_shared<PooledString>(PoolAllocator<PooledString>{}, std::move(data));
+	}
+
+	/**
+	 * @brief A frame holding one message in each of its encodings, back to back (see `Server::_make_frame`): the binary frame, then its compressed frame (if any), then its text. Where each one starts is recorded as the frame is built, so that recipients take theirs without parsing the frame.
+	 */
+	struct BroadcastFrame {
+		Frame frame;
+		uint32_t compressedAt = 0; // the end of the binary frame, and the start of the compressed one
+		uint32_t textAt = 0; // the end of the compressed frame (`compressedAt` if there is none), and the start of the text
+	};
+
+	/**
+	 * @brief What to do with a connection whose output queue keeps growing because its peer does not read fast enough.
+	 */
+	struct OutboundPolicy {
+
+		enum class SlowConsumer {
+			DROP, // discard new output until the queue drains below `lowWatermark`
+			DISCONNECT, // close the connection
+		};
+
+		size_t lowWatermark = 64 * 1024; // a dropping connection gets output again below this many queued bytes
+		size_t highWatermark = 1024 * 1024; // the policy applies above this many queued bytes
+		SlowConsumer onSlowConsumer = SlowConsumer::DISCONNECT;
+		std::chrono::milliseconds flushDelay{ 0 }; // the longest output is held back so that more can be sent with it; `0` sends it at the end of every loop iteration
+
+	};
+
+	/**
+	 * @brief Output of a non-blocking socket that could not be sent yet: a list of slices of frames. Slices are appended at the back and sent from the front, several at once, whenever the socket is writable.
+	 */
+	class OutputQueue {
+
+		struct Slice {
+			Frame frame;
+			size_t offset; // where the unsent bytes of `frame` begin
+			size_t end; // where the bytes of `frame` to be sent end
+		};
+
+		std::deque<Slice, PoolAllocator<Slice>> mSlices;
+		size_t mSize = 0; // the number of unsent bytes
+
+	public:
+
+		static constexpr size_t MAX_IOV = 1024; // the most slices gathered by a single send (`IOV_MAX` on Linux)
+
+		void append(const std::string_view);
+		void append(Frame, const size_t = 0, const size_t = std::string_view::npos);
+		size_t gather(IoVec*, const size_t) const;
+		void consume(size_t);
+		int flush(const int);
+
+		/**
+		 * @returns The number of bytes waiting to be sent.
+		 */
+		size_t size() const {
+			return this->mSize;
+		}
+
+		bool empty() const {
+			return this->mSize == 0;
+		}
+
+		size_t sliceCount() const {
+			return this->mSlices.size();
+		}
+
+		void clear() {
+			this->mSlices.clear();
+			this->mSize = 0;
+		}
+
+	};
+
+}
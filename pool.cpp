@@ -0,0 +1,158 @@
+#include "pool.h"
+#include <bit>
+#include <new>
+
+namespace m0st4fa {
+
+	BufferPool::~BufferPool()
+	{
+		for (size_t cls = 0; cls < CLASS_COUNT; cls++) {
+			while (this->mFree[cls] != nullptr) {
+				FreeBlock* block = this->mFree[cls];
+				this->mFree[cls] = block->next;
+				::operator delete(block);
+			}
+		}
+	}
+
+	/**
+	 * @brief Gets the class serving blocks of `size` bytes.
+	 * @returns The class; `CLASS_COUNT` if `size` is too large to be pooled.
+	 */
+	size_t BufferPool::_class_of(const size_t size)
+	{
+		if (size <= MIN_CLASS_SIZE)
+			return 0;
+
+		if (size > MAX_CLASS_SIZE)
+			return CLASS_COUNT;
+
+		return (size_t)std::bit_width(size - 1) - (size_t)std::bit_width(MIN_CLASS_SIZE - 1);
+	}
+
+	/**
+	 * @brief Allocates a block of at least `size` bytes, from the cache if it has one of the right class.
+	 * @param[in] size The size of the block.
+	 * @returns The block; it must be given back with `deallocate`, with the same `size`.
+	 */
+	void* BufferPool::allocate(const size_t size)
+	{
+		size_t cls = _class_of(size);
+
+		if (cls == CLASS_COUNT) {
+			this->mStats.misses++;
+			return ::operator new(size);
+		}
+
+		if (this->mFree[cls] != nullptr || this->_refill(cls)) {
+			FreeBlock* block = this->mFree[cls];
+			this->mFree[cls] = block->next;
+			this->mCached[cls]--;
+			this->mStats.hits++;
+			return block;
+		}
+
+		this->mStats.misses++;
+		return ::operator new(_class_size(cls));
+	}
+
+	/**
+	 * @brief Gives back a block obtained from `allocate` (of any thread's pool.) It is kept in the cache unless the cache of its class is full.
+	 * @param[in] p The block.
+	 * @param[in] size The size it has been allocated with.
+	 * @returns void
+	 */
+	void BufferPool::deallocate(void* p, const size_t size)
+	{
+		size_t cls = _class_of(size);
+
+		if (cls == CLASS_COUNT) {
+			this->mStats.released++;
+			::operator delete(p);
+			return;
+		}
+
+		FreeBlock* block = (FreeBlock*)p;
+		block->next = this->mFree[cls];
+		this->mFree[cls] = block;
+		this->mCached[cls]++;
+		this->mStats.recycled++;
+
+		// blocks released by other threads (e.g., mailbox nodes) keep arriving here; pass them on in batches
+		if (this->mCached[cls] > BATCH && (this->mCached[cls] > CACHE_BLOCKS || this->mCached[cls] * _class_size(cls) > CACHE_BYTES))
+			this->_spill(cls);
+	}
+
+	/**
+	 * @brief Takes a batch of blocks of class `cls` from the depot into the (empty) cache.
+	 * @returns `true` if the depot had one.
+	 */
+	bool BufferPool::_refill(const size_t cls)
+	{
+		Depot& depot = _depot();
+		std::lock_guard lock{ depot.mutex };
+
+		if (depot.batches[cls].empty())
+			return false;
+
+		this->mFree[cls] = depot.batches[cls].back();
+		this->mCached[cls] = BATCH;
+		depot.batches[cls].pop_back();
+		this->mStats.transfers++;
+
+		return true;
+	}
+
+	/**
+	 * @brief Moves a batch of blocks of class `cls` from the (full) cache to the depot, or to the global allocator if the depot is full too.
+	 */
+	void BufferPool::_spill(const size_t cls)
+	{
+		FreeBlock* batch = this->mFree[cls];
+		FreeBlock* last = batch;
+
+		for (size_t i = 1; i < BATCH; i++)
+			last = last->next;
+
+		this->mFree[cls] = last->next;
+		this->mCached[cls] -= BATCH;
+		last->next = nullptr;
+
+		{
+			Depot& depot = _depot();
+			std::lock_guard lock{ depot.mutex };
+
+			if (depot.batches[cls].size() * BATCH * _class_size(cls) < DEPOT_BYTES) {
+				depot.batches[cls].push_back(batch);
+				this->mStats.transfers++;
+				return;
+			}
+		}
+
+		while (batch != nullptr) {
+			FreeBlock* next = batch->next;
+			::operator delete(batch);
+			this->mStats.released++;
+			batch = next;
+		}
+	}
+
+	/**
+	 * @returns The depot shared by the pools of every thread. It is never destroyed, since pools of threads that exit late may still use it.
+	 */
+	BufferPool::Depot& BufferPool::_depot()
+	{
+		static Depot* depot = new Depot();
+		return *depot;
+	}
+
+	/**
+	 * @returns The pool of the calling thread.
+	 */
+	BufferPool& BufferPool::local()
+	{
+		thread_local BufferPool pool;
+		return pool;
+	}
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Counters of a `BufferPool`.
+	 */
+	struct PoolStats {
+		uint64_t hits = 0; // allocations served from the cache
+		uint64_t misses = 0; // allocations that went to the global allocator (the cache was empty, or the size has no class)
+		uint64_t recycled = 0; // deallocations kept in the cache
+		uint64_t released = 0; // deallocations that went to the global allocator (the cache was full, or the size has no class)
+		uint64_t transfers = 0; // batches of blocks moved between the cache and the shared depot
+
+		/**
+		 * @returns The share of allocations served from the cache, between `0` and `1`.
+		 */
+		double hitRate() const {
+			uint64_t total = this->hits + this->misses;
+			return total == 0 ? 0 : (double)this->hits / (double)total;
+		}
+	};
+
+	/**
+	 * @brief Size-classed cache of memory blocks for message buffers. Each thread has its own pool (see `local`), so allocating and deallocating takes no lock. A block may be deallocated on another thread than the one that allocated it (e.g., a broadcast frame released by the last shard sending it), and then joins the cache of that thread; caches that fill up hand batches of blocks to a shared depot, from which empty caches refill. Once the caches are warm, the message path does not call the global allocator.
+	 */
+	class BufferPool {
+
+		struct FreeBlock {
+			FreeBlock* next;
+		};
+
+		static constexpr size_t MIN_CLASS_SIZE = 32; // the smallest block; sizes are rounded up to a power of 2
+		static constexpr size_t CLASS_COUNT = 12; // up to 64 KiB
+		static constexpr size_t CACHE_BYTES = 256 * 1024; // the most memory each class keeps cached per thread
+		static constexpr size_t CACHE_BLOCKS = 256; // the most blocks each class keeps cached per thread
+		static constexpr size_t DEPOT_BYTES = 16 * 1024 * 1024; // the most memory each class keeps in the depot
+		static constexpr size_t BATCH = 32; // blocks moved to or from the depot at once
+
+		/**
+		 * @brief Blocks shared by every thread, in batches of `BATCH` (chained through `FreeBlock::next`.)
+		 */
+		struct Depot {
+			std::mutex mutex;
+			std::array<std::vector<FreeBlock*>, CLASS_COUNT> batches;
+		};
+
+		std::array<FreeBlock*, CLASS_COUNT> mFree{};
+		std::array<size_t, CLASS_COUNT> mCached{}; // the number of blocks in each free list
+		PoolStats mStats{};
+
+		static Depot& _depot();
+		static size_t _class_of(const size_t);
+
+		bool _refill(const size_t);
+		void _spill(const size_t);
+
+		/**
+		 * @returns The size of the blocks of class `cls`.
+		 */
+		static constexpr size_t _class_size(const size_t cls) {
+			return MIN_CLASS_SIZE << cls;
+		}
+
+	public:
+
+		static constexpr size_t MAX_CLASS_SIZE = MIN_CLASS_SIZE << (CLASS_COUNT - 1);
+
+		BufferPool() = default;
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+		~BufferPool();
+
+		void* allocate(const size_t);
+		void deallocate(void*, const size_t);
+
+		const PoolStats& stats() const {
+			return this->mStats;
+		}
+
+		static BufferPool& local();
+
+	};
+
+	/**
+	 * @brief Standard allocator drawing from the pool of the calling thread.
+	 */
+	template <typename T>
+	struct PoolAllocator {
+
+		using value_type = T;
+
+		PoolAllocator() = default;
+
+		template <typename U>
+		PoolAllocator(const PoolAllocator<U>&) {
+		}
+
+		T* allocate(const size_t n) {
+			return (T*)BufferPool::local().allocate(n * sizeof(T));
+		}
+
+		void deallocate(T* p, const size_t n) {
+			BufferPool::local().deallocate(p, n * sizeof(T));
+		}
+
+		template <typename U>
+		bool operator==(const PoolAllocator<U>&) const {
+			return true;
+		}
+
+	};
+
+	/**
+	 * @brief String whose characters live in the buffer pool.
+	 */
+	using PooledString = std::basic_string<char, std::char_traits<char>, PoolAllocator<char>>;
+
+}
@@ -0,0 +1,215 @@
+#include "reactor.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Creates the most efficient backend available on this platform.
+	 * @returns `EpollReactor` on Linux; `PollReactor` otherwise.
+	 */
+	std::unique_ptr<Reactor> Reactor::create()
+	{
+#ifdef __linux__
+		return std::make_unique<EpollReactor>();
+#else
+		return std::make_unique<PollReactor>();
+#endif
+	}
+
+	/**
+	 * @brief Converts a `Reactor::Event` bitmap to a `pollfd` event bitmap.
+	 */
+	static short toPollEvents(const unsigned int interest)
+	{
+		short events = 0;
+
+		if (interest & Reactor::READABLE)
+			events |= POLLIN;
+
+		if (interest & Reactor::WRITABLE)
+			events |= POLLOUT;
+
+		return events;
+	}
+
+	/**
+	 * @brief Registers `fd` for the events in `interest`.
+	 * @param[in] fd The descriptor to be polled.
+	 * @param[in] interest A bitmap of `Reactor::Event`.
+	 * @returns `0` (registration cannot fail for this backend.)
+	 */
+	int PollReactor::add(const int fd, const unsigned int interest)
+	{
+		this->mSockets.add(fd, toPollEvents(interest));
+		return 0;
+	}
+
+	/**
+	 * @brief Changes the events `fd` is polled for.
+	 * @returns `0` on success; `-1` if `fd` is not registered.
+	 */
+	int PollReactor::modify(const int fd, const unsigned int interest)
+	{
+		return this->mSockets.update(fd, toPollEvents(interest));
+	}
+
+	/**
+	 * @brief Stops polling `fd`.
+	 * @returns `0` on success; `-1` if `fd` is not registered.
+	 */
+	int PollReactor::remove(const int fd)
+	{
+		return this->mSockets.remove(fd);
+	}
+
+	/**
+	 * @brief Waits until at least one registered descriptor is ready, then copies the ready ones into `out`.
+	 * @param[out] out Where to store the ready descriptors. Descriptors that do not fit are reported by the next call.
+	 * @param[in] timeoutMs How long to wait, in milliseconds; `-1` waits forever.
+	 * @returns The number of events stored in `out`; `-1` on error.
+	 */
+	int PollReactor::wait(std::span<ReactorEvent> out, const int timeoutMs)
+	{
+#ifdef _WIN32
+		int rv = ::WSAPoll(this->mSockets.getSockets(), (ULONG)this->mSockets.getLength(), timeoutMs);
+#else
+		int rv = ::poll(this->mSockets.getSockets(), this->mSockets.getLength(), timeoutMs);
+#endif
+
+		if (rv <= 0)
+			return rv;
+
+		int count = 0;
+		for (size_t i = 0; i < this->mSockets.getLength() && (size_t)count < out.size(); i++) {
+			pollfd curr = this->mSockets.at(i);
+
+			if (curr.revents == 0)
+				continue;
+
+			unsigned int events = 0;
+
+			if (curr.revents & POLLIN)
+				events |= READABLE;
+			if (curr.revents & POLLOUT)
+				events |= WRITABLE;
+			if (curr.revents & POLLHUP)
+				events |= HANGUP;
+			if (curr.revents & (POLLERR | POLLNVAL))
+				events |= FAILED;
+
+			out[count++] = ReactorEvent{ curr.fd, events };
+		}
+
+		return count;
+	}
+
+#ifdef __linux__
+
+	EpollReactor::EpollReactor() : mEpollFd{ ::epoll_create1(EPOLL_CLOEXEC) }
+	{
+		if (this->mEpollFd == -1) {
+			LOG_CRITICAL("reactor", "Could not create epoll instance: {}", strerror(errno));
+			Logger::global().flush();
+			std::abort();
+		}
+	}
+
+	EpollReactor::~EpollReactor()
+	{
+		::close(this->mEpollFd);
+	}
+
+	/**
+	 * @brief Converts a `Reactor::Event` bitmap to an `epoll_event` event bitmap.
+	 */
+	unsigned int EpollReactor::_to_epoll(const unsigned int interest)
+	{
+		unsigned int events = EPOLLRDHUP;
+
+		if (interest & READABLE)
+			events |= EPOLLIN;
+		if (interest & WRITABLE)
+			events |= EPOLLOUT;
+		if (interest & EDGE)
+			events |= EPOLLET;
+
+		return events;
+	}
+
+	/**
+	 * @brief Converts an `epoll_event` event bitmap to a `Reactor::Event` bitmap.
+	 */
+	unsigned int EpollReactor::_from_epoll(const unsigned int events)
+	{
+		unsigned int rv = 0;
+
+		if (events & EPOLLIN)
+			rv |= READABLE;
+		if (events & EPOLLOUT)
+			rv |= WRITABLE;
+		if (events & (EPOLLHUP | EPOLLRDHUP))
+			rv |= HANGUP | READABLE; // reading is how the owner finds out about the hang-up
+		if (events & EPOLLERR)
+			rv |= FAILED;
+
+		return rv;
+	}
+
+	/**
+	 * @brief Registers `fd` for the events in `interest`.
+	 * @param[in] fd The descriptor to be watched.
+	 * @param[in] interest A bitmap of `Reactor::Event`.
+	 * @returns The value returned by `epoll_ctl`.
+	 */
+	int EpollReactor::add(const int fd, const unsigned int interest)
+	{
+		epoll_event ev{};
+		ev.events = _to_epoll(interest);
+		ev.data.fd = fd;
+
+		return ::epoll_ctl(this->mEpollFd, EPOLL_CTL_ADD, fd, &ev);
+	}
+
+	/**
+	 * @brief Changes the events `fd` is watched for.
+	 * @returns The value returned by `epoll_ctl`.
+	 */
+	int EpollReactor::modify(const int fd, const unsigned int interest)
+	{
+		epoll_event ev{};
+		ev.events = _to_epoll(interest);
+		ev.data.fd = fd;
+
+		return ::epoll_ctl(this->mEpollFd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	/**
+	 * @brief Stops watching `fd`. Must be called before `fd` is closed.
+	 * @returns The value returned by `epoll_ctl`.
+	 */
+	int EpollReactor::remove(const int fd)
+	{
+		return ::epoll_ctl(this->mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+
+	/**
+	 * @brief Waits until at least one registered descriptor is ready, then copies the ready ones into `out`.
+	 * @param[out] out Where to store the ready descriptors.
+	 * @param[in] timeoutMs How long to wait, in milliseconds; `-1` waits forever.
+	 * @returns The number of events stored in `out`; `-1` on error.
+	 */
+	int EpollReactor::wait(std::span<ReactorEvent> out, const int timeoutMs)
+	{
+		if (this->mReady.size() < out.size())
+			this->mReady.resize(out.size());
+
+		int rv = ::epoll_wait(this->mEpollFd, this->mReady.data(), (int)out.size(), timeoutMs);
+
+		for (int i = 0; i < rv; i++)
+			out[i] = ReactorEvent{ this->mReady[i].data.fd, _from_epoll(this->mReady[i].events) };
+
+		return rv;
+	}
+
+#endif
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include "common.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+namespace m0st4fa {
+
+	/**
+	 * @brief A readiness notification reported by a `Reactor`.
+	 */
+	struct ReactorEvent {
+		int fd = -1;
+		unsigned int events = 0;
+	};
+
+	/**
+	 * @brief Readiness-based event demultiplexer. Descriptors are registered once (and changed incrementally), and `wait` reports only the ones that are ready.
+	 */
+	class Reactor {
+
+	public:
+
+		enum Event : unsigned int {
+			READABLE = 1u << 0,
+			WRITABLE = 1u << 1,
+			HANGUP = 1u << 2,
+			FAILED = 1u << 3,
+			EDGE = 1u << 4, // Only report transitions to ready; the owner must then drain the descriptor until it would block.
+		};
+
+		virtual ~Reactor() = default;
+
+		virtual int add(const int, const unsigned int) = 0;
+		virtual int modify(const int, const unsigned int) = 0;
+		virtual int remove(const int) = 0;
+		virtual int wait(std::span<ReactorEvent>, const int) = 0;
+
+		/**
+		 * @returns A short name of the backend, for logging.
+		 */
+		virtual const char* name() const = 0;
+
+		static std::unique_ptr<Reactor> create();
+
+	};
+
+	/**
+	 * @brief Portable backend built on `poll` (`WSAPoll` on Windows.) Each call to `wait` is linear in the number of registered descriptors. `EDGE` is ignored, which is harmless since draining a level-triggered descriptor is always correct.
+	 */
+	class PollReactor : public Reactor {
+
+		Sockets mSockets{};
+
+	public:
+
+		int add(const int, const unsigned int) override;
+		int modify(const int, const unsigned int) override;
+		int remove(const int) override;
+		int wait(std::span<ReactorEvent>, const int) override;
+
+		const char* name() const override {
+			return "poll";
+		}
+
+	};
+
+#ifdef __linux__
+	/**
+	 * @brief Linux backend built on `epoll`. Registration is incremental and each call to `wait` costs time proportional to the number of ready descriptors only.
+	 */
+	class EpollReactor : public Reactor {
+
+		int mEpollFd = -1;
+		std::vector<epoll_event> mReady;
+
+		static unsigned int _to_epoll(const unsigned int);
+		static unsigned int _from_epoll(const unsigned int);
+
+	public:
+
+		EpollReactor();
+		~EpollReactor() override;
+
+		EpollReactor(const EpollReactor&) = delete;
+		EpollReactor& operator=(const EpollReactor&) = delete;
+
+		int add(const int, const unsigned int) override;
+		int modify(const int, const unsigned int) override;
+		int remove(const int) override;
+		int wait(std::span<ReactorEvent>, const int) override;
+
+		const char* name() const override {
+			return "epoll";
+		}
+
+	};
+#endif
+
+}
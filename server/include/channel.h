@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "outbound.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief How much of the history of its channel a connection is replayed when it joins (see `MessageHistory`.)
+	 */
+	struct HistoryPolicy {
+		size_t replayCount = 0; // the most messages replayed (at most `MessageHistory::CAPACITY`); `0` disables the history
+		std::chrono::seconds replayAge{ 0 }; // only the messages broadcast this recently are replayed; `0` for no limit
+	};
+
+	/**
+	 * @brief The last `CAPACITY` messages broadcast to a channel, in a ring that never grows. It holds the frames the messages have been broadcast in (see `Server::_make_frame`), so neither recording nor replaying a message copies it. Every shard records and replays through it, so it is locked; it is only held to copy a few pointers.
+	 */
+	class MessageHistory {
+
+	public:
+
+		static constexpr size_t CAPACITY = 128;
+
+	private:
+
+		struct Entry {
+			BroadcastFrame frame;
+			std::chrono::steady_clock::time_point at; // when it has been broadcast
+		};
+
+		mutable std::mutex mMutex;
+		std::vector<Entry> mEntries; // allocated by the first message recorded; the next one goes to `mRecorded % CAPACITY`
+		uint64_t mRecorded = 0;
+
+	public:
+
+		void record(BroadcastFrame, const std::chrono::steady_clock::time_point);
+		void recent(const size_t, const std::chrono::steady_clock::time_point, std::vector<BroadcastFrame>&) const;
+
+	};
+
+	/**
+	 * @brief What every shard knows about a channel.
+	 */
+	struct ChannelInfo {
+		uint32_t id = 0; // dense, so that shards can index their channels by it
+		std::string name;
+		std::atomic<uint64_t> shards = 0; // bit `i` is set while shard `i` has members in the channel
+		MessageHistory history; // the messages of every shard
+	};
+
+	/**
+	 * @brief Maps channel names to ids, for every shard of the process. It is only consulted when a connection joins a channel; messages refer to channels by id. Channels are never destroyed (every shard indexes its channels by id, and broadcasts in flight refer to them), so at most `MAX_CHANNELS` are created.
+	 */
+	class ChannelRegistry {
+
+		std::mutex mMutex;
+		std::unordered_map<std::string_view, std::unique_ptr<ChannelInfo>> mChannels; // keyed by the name stored in the value
+		uint32_t mNextId = 0;
+
+	public:
+
+		static constexpr size_t MAX_NAME_LENGTH = 32;
+		static constexpr size_t MAX_CHANNELS = 1024; // bounds what clients can make every shard allocate (e.g., histories) by joining new channels
+		static constexpr std::string_view LOBBY = "lobby"; // the channel every connection starts in
+
+		ChannelInfo* intern(const std::string_view);
+		static bool isValidName(const std::string_view);
+		static ChannelRegistry& global();
+
+	};
+
+	/**
+	 * @brief The members a shard has in a channel, packed so that fan-out walks a contiguous array.
+	 */
+	struct Channel {
+		ChannelInfo* info = nullptr; // `nullptr` until a connection of the shard joins the channel
+		std::vector<int> members;
+	};
+
+}
@@ -1,44 +1,589 @@
 // Windows API Headers
 #pragma once
 
+#include <atomic>
+#include <concepts>
 #include <functional>
+#include <memory>
+#include <span>
+#include <thread>
+#include "channel.h"
 #include "common.h"
+#include "compression.h"
+#include "framing.h"
+#include "mailbox.h"
+#include "message_log.h"
+#include "metrics.h"
+#include "nickname.h"
+#include "outbound.h"
+#include "reactor.h"
+#include "slab.h"
+#include "timing_wheel.h"
+#include "token_bucket.h"
+#include "uring.h"
 
 namespace m0st4fa {
 
+	/**
+	 * @brief A message handler (see `Server::start`): it is called with the socket of a recipient and the message.
+	 */
+	template <typename Handler>
+	concept MessageHandler = std::invocable<Handler&, const int, std::string_view>;
+
+	/**
+	 * @brief What the server does about connections that have stopped sending (dead peers, half-open sessions.)
+	 */
+	struct IdlePolicy {
+		std::chrono::seconds timeout{ 0 }; // a connection that has sent nothing for this long is closed; `0` keeps it
+		std::chrono::seconds pingAfter{ 0 }; // a connection that has sent nothing for this long gets a ping (and again after as long), which fails the connection if its peer is gone; `0` for none. Text connections that have not spoken telnet have no invisible ping, and are only closed by `timeout`
+	};
+
+	/**
+	 * @brief How much input the server takes from each connection, so that a client flooding it cannot slow down the others. Messages over the rates are not dropped: the connection is no longer read until it has the tokens for them, which pushes back on the client through TCP flow control.
+	 */
+	struct RatePolicy {
+		double messagesPerSecond = 0; // messages (commands included) a connection may send a second; `0` for no limit
+		double messageBurst = 32; // messages it may send at once, after having been quiet
+		double bytesPerSecond = 0; // bytes of messages it may send a second; `0` for no limit
+		double byteBurst = 64 * 1024;
+		size_t readBudget = 64; // messages handled per connection per loop iteration, before the other connections get their turn; `0` for no limit
+	};
+
+	/**
+	 * @brief How the server takes in new connections, so that a storm of them (e.g., every client reconnecting after a restart) is absorbed rather than dropped.
+	 */
+	struct AdmissionPolicy {
+		int backlog = ConnectionInformation::BACK_LOG; // connections the kernel queues until they are accepted
+		size_t maxConnections = 0; // connections are accepted and closed at once (with a notice) while this many are open; `0` for no limit
+	};
+
+	/**
+	 * @brief Which broadcasts are compressed for the binary clients that have asked for it (see `DEFLATE_HELLO`.) A message is compressed once, when its frame is built, and every such recipient (on any shard) gets the same compressed bytes, so the cost does not grow with the size of the channel; the others get it as it is.
+	 */
+	struct CompressionPolicy {
+		bool enabled = true; // whether `DEFLATE_HELLO` is accepted (it is refused where the build has no zlib)
+		size_t threshold = 512; // messages shorter than this go raw: compressing them would save little and cost a deflate each
+		int level = 1; // the zlib level (1, fastest, to 9, smallest)
+	};
+
 	/**
 	 * @brief Represents a server.
 	 */
 	class Server : public ConnectionInformation {
 
-		std::vector<std::pair<int, sockaddr_storage>> connectedSockets;
-		m0st4fa::Sockets fileDescriptors{};
+	public:
+
+		/**
+		 * @brief The I/O engine driving the main loop.
+		 */
+		enum class Engine {
+			REACTOR, // readiness-based loop (see `Reactor`)
+			URING, // completion-based loop on io_uring (Linux only)
+		};
+
+	private:
+
+		/**
+		 * @brief State the server keeps for each connection.
+		 */
+		struct Connection {
+			sockaddr_storage address{}; // the address of the peer; `AF_UNSPEC` until it is needed, if the engine has not got it with the connection (see `_peer_address`)
+			uint32_t channel = NO_CHANNEL; // the channel the connection is in
+			uint32_t memberIndex = 0; // its position in the member array of `channel`
+			std::string nickname; // registered in `NicknameRegistry`
+			LineBuffer input; // received bytes; complete lines (or frames) are broadcast as soon as they arrive
+			Protocol protocol = Protocol::PENDING; // decided by the first bytes received (see `_negotiate`)
+			bool deflate = false; // binary, and gets the compressed frame of the broadcasts that have one (see `CompressionPolicy`)
+			bool telnet = false; // text, and has sent telnet commands (IAC), so it takes telnet commands without showing them (see `_ping`)
+			bool dropping = false; // output is being discarded (see `OutboundPolicy`)
+			bool doomed = false; // scheduled to be closed at the end of the loop iteration
+
+			// idle connections (see `IdlePolicy`)
+			TimingWheel::TimerId idleTimer; // when the connection is checked next
+			uint64_t lastInput = 0; // when it has last sent anything (see `_now`)
+			uint64_t lastPing = 0; // when it has last been pinged
 
-		static std::string _format_server(const std::string_view);
-		int _set_up_listening_socket() const;
+			// rate limits and read budget (see `RatePolicy`)
+			TokenBucket messageTokens;
+			TokenBucket byteTokens;
+			uint64_t budgetedAt = 0; // the loop iteration `budget` is for
+			size_t budget = 0; // messages that may still be handled during that iteration
+			bool throttled = false; // out of tokens: its input is left alone until a timer resumes it (see `_resume_input`)
+			bool yielded = false; // out of budget: it is in `mYielded`, and resumes next iteration
+
+			OutputQueue output; // bytes the socket has not accepted yet
+
+			// reactor engine
+			bool writeArmed = false; // whether the reactor watches the socket for writability
+
+			// io_uring engine
+#ifdef __linux__
+			msghdr header{}; // describes the send in flight; the kernel reads it (and `iov`) until the send completes
+			std::vector<iovec> iov;
+			PooledString overflow; // received bytes that have not fit in `input` while the connection was stopped (throttled or yielded)
+#endif
+			size_t inFlight = 0; // how many bytes at the front of `output` have been handed to the kernel
+			size_t staged = 0; // how many bytes at the back of `output` have been queued since the last flush
+			bool recvArmed = false; // also while its cancellation is in flight
+			bool dirty = false; // whether the connection is in `mDirty`
+			bool closing = false;
+		};
+
+		Slab<Connection> mConnections; // indexed by socket
+		std::unique_ptr<Reactor> mReactor = Reactor::create();
+		Engine mEngine = Engine::REACTOR;
+		OutboundPolicy mOutboundPolicy{};
+		HistoryPolicy mHistoryPolicy{};
+		IdlePolicy mIdlePolicy{};
+		AdmissionPolicy mAdmissionPolicy{};
+		CompressionPolicy mCompressionPolicy{};
+		int mSpareFd = -1; // a descriptor kept in reserve, given up to accept (and close) connections when the process is out of descriptors
+		uint64_t mAcceptSecond = 0; // the second `mAcceptsThisSecond` is for (see `ServerMetrics::peakAcceptRate`)
+		uint64_t mAcceptsThisSecond = 0;
+		RatePolicy mRatePolicy{};
+		uint64_t mIteration = 0; // loop iterations so far (see `Connection::budget`)
+		std::vector<Slab<Connection>::Handle> mYielded; // connections that have used up their read budget, with input left
+		std::vector<BroadcastFrame> mReplayed; // the frames being replayed to a connection (see `_replay`)
+#ifndef _WIN32
+		MessageLog* mLog = nullptr; // where the messages are kept, if anywhere (see `setMessageLog`)
+#endif
+		std::vector<Slab<Connection>::Handle> mDoomed; // connections to be closed at the end of the loop iteration
+		std::vector<int> mDirty; // connections with staged bytes, sent together at the end of the loop iteration (see `OutboundPolicy::flushDelay`)
+		std::chrono::steady_clock::time_point mFlushDeadline; // when the staged bytes are due, while `mDirty` is not empty
+		std::vector<Channel> mChannels; // indexed by channel id
+		ChannelInfo* mLobby = ChannelRegistry::global().intern(ChannelRegistry::LOBBY); // created first, so never refused
+		ServerMetrics mMetrics;
+		uint64_t mReceivedAt = 0; // when the bytes being handled have been received (see `ServerMetrics::fanOut`)
+		std::vector<uint64_t> mFanOuts; // when the messages broadcast since the last flush have been received
+
+		// timers: the idle checks of the connections (the data of a timer is the socket), and the tasks scheduled with `after`
+		TimingWheel mTimers;
+		std::vector<std::function<void()>> mTasks; // indexed by the data of their timer, without `TASK_TIMER`
+		std::vector<uint32_t> mFreeTasks;
+
+		static constexpr uint64_t TASK_TIMER = 1ull << 63;
+		static constexpr char TELNET_IAC = '\xFF'; // starts every telnet command
+		static constexpr std::string_view TELNET_NOP{ "\xFF\xF1" }; // IAC NOP
+
+		static constexpr uint32_t NO_CHANNEL = UINT32_MAX;
+
+		static constexpr std::string_view SERVER_FULL{ "The server is full; try again later.\r\n" };
+
+		static constexpr size_t MAX_EVENTS = 256; // Maximum number of ready descriptors handled per wakeup
+
+		// a broadcast frame holds the message twice: as a binary frame, then as text: "\b\b" (erases the prompt of the recipient), the message, then "\r\n> "; this reserves room for the header, the text framing and the sender's number
+		static constexpr size_t FRAME_OVERHEAD = FrameHeader::SIZE + 32;
+
+		/**
+		 * @brief The slices of a broadcast frame (see `_make_frame`), one per kind of recipient.
+		 */
+		struct FrameParts {
+			std::string_view binary;
+			std::string_view compressed; // empty if the message has not been compressed
+			std::string_view text;
+		};
+
+		static inline std::atomic<size_t> sDeflateConnections{ 0 }; // connections, on every server of the process, that take compressed frames; while there are none, nothing is compressed
+
+		// connections are edge-triggered wherever receives can be made non-blocking (see `RECV_DONTWAIT`)
+		static constexpr unsigned int CONNECTION_EVENTS = RECV_DONTWAIT != 0 ? Reactor::READABLE | Reactor::EDGE : Reactor::READABLE;
+
+		int _set_up_listening_socket();
 
 		using FnType = std::function<void(const int, std::string_view)>;
+
+		// the message handler passed to `start` (if any), and the fan-out loop instantiated for its type
+		using FanOut = uint64_t(*)(Server&, void*, std::span<const int>, const int, const BroadcastFrame&);
+
+		std::shared_ptr<void> mHandler;
+		FanOut mFanOut = nullptr;
+		int mCaptureFd = -1; // the binary connection the handler is being called for (see `_begin_capture`)
+		PooledString mCaptured; // what the handler has sent to it, after room for a header
+
+		template <MessageHandler Handler>
+		static uint64_t _fan_out(Server&, void*, std::span<const int>, const int, const BroadcastFrame&);
+		void _begin_capture(const int);
+		void _end_capture(const int, const FrameHeader&);
+
+		int _start();
+		int _run_reactor();
+
+		// sharding (see `ShardedServer`)
+		static thread_local Server* tCurrent; // the server running on this thread
+		std::vector<Server*> mPeers; // the other shards
+		size_t mShardIndex = 0; // the position of this shard in its group (see `ChannelInfo::shards`)
+		std::atomic<bool> mWakePending = false; // whether `mWakeFd` has been signalled and not drained yet
+		int mWakeFd = -1;
+
+		/**
+		 * @brief A broadcast posted by another shard.
+		 */
+		struct Post {
+			uint32_t channel = 0;
+			BroadcastFrame frame;
+			Slab<Connection>::Handle recipient{}; // a direct message to this connection alone, rather than a broadcast to `channel`
+		};
+
+		static constexpr size_t MAILBOX_CAPACITY = 16384; // posts queued for a shard at once, before the shards posting to it wait (see `_post`)
+
+		Mailbox<Post> mMailbox{ MAILBOX_CAPACITY }; // broadcasts posted by the other shards
+
+		void _post(Post);
+		void _drain_mailbox();
+
+#ifdef __linux__
+		static constexpr unsigned URING_ENTRIES = 4096;
+		static constexpr unsigned URING_BUFFERS = 1024; // number of provided receive buffers (a power of 2)
+		static constexpr unsigned URING_BUFFER_SIZE = 2048;
+		std::unique_ptr<IoUring> mRing; // only set while the io_uring engine runs
+		__kernel_timespec mFlushTimer{}; // the kernel reads it when the timer is submitted
+		bool mFlushTimerArmed = false;
+		__kernel_timespec mTickTimer{}; // ends the wait for completions at the next tick of `mTimers`
+		bool mTickTimerArmed = false;
+
+		int _run_uring();
+		io_uring_sqe* _uring_sqe();
+		void _uring_arm_recv(const int);
+		void _uring_on_accept(const io_uring_cqe&);
+		void _uring_on_recv(const io_uring_cqe&);
+		void _uring_on_send(const io_uring_cqe&);
+		void _uring_close(const int);
+		void _uring_feed(const int, Connection&, std::string_view);
+		void _uring_resume(const int, Connection&);
+		void _uring_flush();
+#endif
+
 	protected:
 
-		std::string _format(const std::string_view) const override;
-		std::string _format(const std::string_view, const std::string_view) const override;
-		std::string _format(const std::string_view, const std::string_view, const std::string_view) const override;
-		std::string _receive_line(const int, int&);
-		int _accept_connection();
+		const char* _log_source() const override {
+			return "server";
+		}
+
+		void _on_readable(const int);
+		void _on_writable(const int);
+		bool _admit_output(const int, Connection&, const size_t);
+		void _doom(const int, Connection&);
+		void _close_doomed();
+		int _wait_timeout() const;
+		void _expire_timers();
+		void _watch_idle(const int, Connection&);
+		void _check_idle(const int, Connection&);
+		void _ping(const int, Connection&);
+		void _stage(const int, Connection&);
+		int _flush_timeout() const;
+		void _flush_dirty();
+		void _record_fan_outs();
+		static uint64_t _now();
+		void _on_input(const int, LineBuffer&);
+		bool _admit_input(const int, Connection&);
+		void _charge_input(Connection&, const size_t);
+		bool _stopped(const Connection&) const;
+		void _resume_input(const int, Connection&);
+		void _resume_yielded();
+		bool _negotiate(const int, Connection&);
+		void _reply(const int, const Connection&, const std::string_view, const bool = true);
+		void _on_command(const int, Connection&, const std::string_view);
+		void _join(const int, Connection&, ChannelInfo&);
+		void _leave(Connection&);
+		void _switch_channel(const int, Connection&, ChannelInfo&);
+		void _replay(const int, const Connection&, ChannelInfo&);
+		void _send_frame(const int, const Connection&, const BroadcastFrame&);
+		void _rename(const int, Connection&, const std::string_view);
+		void _direct_message(const int, Connection&, const std::string_view);
+		void _deliver(const Slab<Connection>::Handle, const BroadcastFrame&);
+		void _accept_pending();
+		Connection* _admit_connection(const int, const sockaddr_storage*);
+		const sockaddr_storage& _peer_address(const int, Connection&);
+		bool _on_accept_error(const int);
+		void _reject(const int);
 		void _close_connection(const int);
-		void _broadcast(const size_t, FnType, const std::string_view) const;
+		void _forget_connection(const int, const sockaddr_storage&, const uint32_t, const std::string_view);
+		void _broadcast(const uint32_t, const int, const std::string_view);
+		static BroadcastFrame _make_frame(const MessageType, const int, const std::string_view, const std::string_view = {}, const CompressionPolicy* = nullptr);
+		static FrameParts _split_frame(const BroadcastFrame&);
+		void _broadcast_frame(const uint32_t, const int, BroadcastFrame);
+		void _broadcast_local(const uint32_t, const int, const BroadcastFrame&);
+		void _write(const int, const std::string_view, const Frame*);
 
 	public:
 
-		Server(const int myPort = 3490) : ConnectionInformation() {
+		/**
+		 * @param[in] myPort The port to listen on.
+		 * @param[in] engine The I/O engine driving the main loop.
+		 * @param[in] reusePort Whether other servers (shards) may listen on the same port; the kernel spreads incoming connections among them.
+		 */
+		Server(const int myPort = 3490, const Engine engine = Engine::REACTOR, const bool reusePort = false) : ConnectionInformation(), mEngine{ engine } {
 			this->setDeviceAddress(myPort);
-			this->assignSocket();
-			std::cout << _format("Server Information: {}", (this->operator std::string().data())) << "\n";
+			this->assignSocket(reusePort);
+			LOG_INFO("server", "Server Information: {}", this->operator std::string());
 		};
 
-		int start(std::function<void(const int, std::string_view)>);
+		~Server();
+
+		int start(FnType = {});
+		void write(const int, const std::string_view);
+
+		/**
+		 * @brief Like `start(FnType)`, but the type of `handler` is known at compile time, so it is called directly (and may be inlined) in the loop over the recipients of each message, rather than through a `std::function`.
+		 * @param[in] handler Called for every recipient of every message, with the socket of the recipient and the message.
+		 * @returns The value returned by `listen`.
+		 */
+		template <MessageHandler Handler>
+		int start(Handler handler) {
+			this->mHandler = std::make_shared<Handler>(std::move(handler));
+			this->mFanOut = &_fan_out<Handler>;
+
+			return _start();
+		}
+		void setPeers(const std::vector<Server*>&);
+
+		/**
+		 * @brief Sets the limits of the output queues and what happens to connections that exceed them. Must be called before `start`.
+		 */
+		void setOutboundPolicy(const OutboundPolicy& policy) {
+			this->mOutboundPolicy = policy;
+		}
+
+		/**
+		 * @brief Sets when idle connections are pinged and closed. Must be called before `start`.
+		 */
+		void setIdlePolicy(const IdlePolicy& policy) {
+			this->mIdlePolicy = policy;
+		}
+
+		/**
+		 * @brief Sets the listen backlog and the most connections the server takes. Must be called before `start`.
+		 */
+		void setAdmissionPolicy(const AdmissionPolicy& policy) {
+			this->mAdmissionPolicy = policy;
+		}
+
+		/**
+		 * @brief Sets the rate limits and the read budget of the connections. Must be called before `start`.
+		 */
+		void setRatePolicy(const RatePolicy& policy) {
+			this->mRatePolicy = policy;
+		}
+
+		/**
+		 * @brief Sets whether (and which) broadcasts are compressed for the clients asking for it. Must be called before `start`.
+		 */
+		void setCompressionPolicy(const CompressionPolicy& policy) {
+			this->mCompressionPolicy = policy;
+		}
+
+		void after(const std::chrono::milliseconds, std::function<void()>);
+
+		/**
+		 * @brief Sets how many of the recent messages of a channel are replayed to the connections joining it. Must be called before `start`.
+		 */
+		void setHistoryPolicy(const HistoryPolicy& policy) {
+			this->mHistoryPolicy = policy;
+			this->mHistoryPolicy.replayCount = std::min(policy.replayCount, MessageHistory::CAPACITY);
+		}
+
+#ifndef _WIN32
+		/**
+		 * @brief Keeps every message broadcast from now on in `log`, which must outlive the server. Must be called before `start`; see `restoreHistory` for reading the log back.
+		 */
+		void setMessageLog(MessageLog& log) {
+			this->mLog = &log;
+		}
+
+		static size_t restoreHistory(const MessageLog&);
+#endif
+
+		/**
+		 * @brief Gets the metrics of this server and of the other shards of its group. It may be called from any thread.
+		 */
+		MetricsSnapshot metrics() const {
+			MetricsSnapshot snapshot;
+			snapshot.add(this->mMetrics);
+
+			for (const Server* peer : this->mPeers)
+				snapshot.add(peer->mMetrics);
+
+			return snapshot;
+		}
+
+		/**
+		 * @returns The server whose main loop runs on the calling thread; `nullptr` if there is none.
+		 */
+		static Server* current() {
+			return tCurrent;
+		}
 
 	};
 
-}
+	/**
+	 * @brief Runs several `Server`s (shards) on the same port, each with its own thread, listening socket (`SO_REUSEPORT`) and connections. Broadcasts reach the connections of the other shards through their mailboxes.
+	 */
+	class ShardedServer {
+
+		static constexpr size_t MAX_SHARDS = 64; // see `ChannelInfo::shards`
+
+		std::vector<std::unique_ptr<Server>> mShards;
+		std::vector<std::thread> mThreads;
+
+	public:
+
+		ShardedServer(const int myPort = 3490, const size_t shardCount = 1, const Server::Engine engine = Server::Engine::REACTOR);
+
+		int start(std::function<void(const int, std::string_view)> = {});
+
+		/**
+		 * @brief Starts every shard with a copy of `handler` (see `Server::start`): the first one runs on the calling thread, the others on threads of their own.
+		 * @returns The value returned by `Server::start` for the first shard.
+		 */
+		template <MessageHandler Handler>
+		int start(Handler handler) {
+			for (size_t i = 1; i < this->mShards.size(); i++)
+				this->mThreads.emplace_back([shard = this->mShards[i].get(), handler]() mutable {
+					shard->start(std::move(handler));
+					});
+
+			int rv = this->mShards.front()->start(std::move(handler));
+
+			for (std::thread& thread : this->mThreads)
+				thread.join();
 
+			return rv;
+		}
+
+		/**
+		 * @brief Sends `msg` to connection `sockFd`. Must be called from a shard's thread (e.g., from the message handler), which owns the connection.
+		 */
+		void write(const int sockFd, const std::string_view msg) {
+			Server::current()->write(sockFd, msg);
+		}
+
+		/**
+		 * @brief Sets the output queue policy of every shard. Must be called before `start`.
+		 */
+		void setOutboundPolicy(const OutboundPolicy& policy) {
+			for (auto& shard : this->mShards)
+				shard->setOutboundPolicy(policy);
+		}
+
+		/**
+		 * @brief Sets the idle policy of every shard. Must be called before `start`.
+		 */
+		void setIdlePolicy(const IdlePolicy& policy) {
+			for (auto& shard : this->mShards)
+				shard->setIdlePolicy(policy);
+		}
+
+		/**
+		 * @brief Sets the admission policy of every shard. `policy.maxConnections` is for the whole group, so every shard takes its share of it (each listening socket gets its own backlog.) Must be called before `start`.
+		 */
+		void setAdmissionPolicy(AdmissionPolicy policy) {
+			size_t count = this->mShards.size();
+			policy.maxConnections = (policy.maxConnections + count - 1) / count;
+
+			for (auto& shard : this->mShards)
+				shard->setAdmissionPolicy(policy);
+		}
+
+		/**
+		 * @brief Sets the rate policy of every shard. Must be called before `start`.
+		 */
+		void setRatePolicy(const RatePolicy& policy) {
+			for (auto& shard : this->mShards)
+				shard->setRatePolicy(policy);
+		}
+
+		/**
+		 * @brief Sets the compression policy of every shard. Must be called before `start`.
+		 */
+		void setCompressionPolicy(const CompressionPolicy& policy) {
+			for (auto& shard : this->mShards)
+				shard->setCompressionPolicy(policy);
+		}
+
+		/**
+		 * @brief Sets the history policy of every shard. Must be called before `start`.
+		 */
+		void setHistoryPolicy(const HistoryPolicy& policy) {
+			for (auto& shard : this->mShards)
+				shard->setHistoryPolicy(policy);
+		}
+
+#ifndef _WIN32
+		/**
+		 * @brief Rebuilds the history of the channels from the end of `log` (see `Server::restoreHistory`), then has every shard keep its messages in it. Must be called before `start`.
+		 */
+		void setMessageLog(MessageLog& log) {
+			Server::restoreHistory(log);
+
+			for (auto& shard : this->mShards)
+				shard->setMessageLog(log);
+		}
+#endif
+
+		/**
+		 * @brief Gets the metrics of every shard. It may be called from any thread.
+		 */
+		MetricsSnapshot metrics() const {
+			return this->mShards.front()->metrics();
+		}
+
+		size_t getShardCount() const {
+			return this->mShards.size();
+		}
+
+	};
+
+	/**
+	 * @brief The loop over the members of a channel when a message handler is set (see `Server::start`), instantiated for the type of the handler. Every member but the sender gets what the handler sends for the message, in its protocol: text members get it between the "\b\b" and the "\r\n> " of the text of the frame (slices of the shared frame, so the framing copies nothing), binary members get it as the payload of one binary frame. A text sender only gets the prompt, a binary one nothing.
+	 * @param[in] server The server.
+	 * @param[in] state The handler.
+	 * @param[in] members The sockets of the members.
+	 * @param[in] senderFd The socket sending the message.
+	 * @param[in] frame The frame of the message (see `_make_frame`); the handler is passed its text, without the framing.
+	 * @returns The number of recipients.
+	 */
+	template <MessageHandler Handler>
+	uint64_t Server::_fan_out(Server& server, void* state, std::span<const int> members, const int senderFd, const BroadcastFrame& frame)
+	{
+		Handler& handler = *(Handler*)state;
+		uint64_t recipients = 0;
+
+		FrameParts parts = _split_frame(frame);
+		FrameHeader header = FrameHeader::decode(parts.binary.data());
+		std::string_view text = parts.text;
+		std::string_view msg = text.substr(2, text.size() - 6); // without "\b\b" and "\r\n> "
+		std::string_view end = text.substr(text.size() - 4);
+
+		for (int sock : members) {
+			const Connection* conn = server.mConnections.find(sock);
+
+			if (conn == nullptr)
+				continue;
+
+			if (conn->protocol == Protocol::BINARY) {
+				if (sock == senderFd)
+					continue;
+
+				recipients++;
+				server._begin_capture(sock);
+				handler(sock, msg);
+				server._end_capture(sock, header);
+				continue;
+			}
+
+			// the sending socket is skipped
+			if (sock == senderFd) {
+				server._write(sock, end.substr(2), &frame.frame);
+				continue;
+			}
+
+			recipients++;
+			server._write(sock, text.substr(0, 2), &frame.frame);
+			handler(sock, msg);
+			server._write(sock, end, &frame.frame);
+		}
+
+		return recipients;
+	}
+
+}
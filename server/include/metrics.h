@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "histogram.h"
+#include "pool.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief A counter that only one thread updates, while any thread may read it. Updates are a plain load and store rather than an atomic read-modify-write, so counting costs about as much as with an ordinary integer.
+	 */
+	class SingleWriterCounter {
+
+		std::atomic<uint64_t> mValue{ 0 };
+
+	public:
+
+		SingleWriterCounter& operator+=(const uint64_t n) {
+			this->mValue.store(this->mValue.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+			return *this;
+		}
+
+		SingleWriterCounter& operator-=(const uint64_t n) {
+			this->mValue.store(this->mValue.load(std::memory_order_relaxed) - n, std::memory_order_relaxed);
+			return *this;
+		}
+
+		SingleWriterCounter& operator=(const uint64_t n) {
+			this->mValue.store(n, std::memory_order_relaxed);
+			return *this;
+		}
+
+		operator uint64_t() const {
+			return this->mValue.load(std::memory_order_relaxed);
+		}
+
+	};
+
+	/**
+	 * @brief What a server (shard) has done since it started. The thread running the server is the only one updating them; any thread may read them (see `MetricsSnapshot`.)
+	 */
+	struct ServerMetrics {
+		SingleWriterCounter accepted; // connections
+		SingleWriterCounter rejected; // connections closed as soon as accepted, for being over `AdmissionPolicy::maxConnections` or out of descriptors
+		SingleWriterCounter acceptFailures; // failed calls to accept
+		SingleWriterCounter peakAcceptRate; // the most connections accepted within a second
+		SingleWriterCounter closed; // connections
+		SingleWriterCounter idleClosed; // connections closed for having sent nothing for too long (see `IdlePolicy`)
+		SingleWriterCounter messagesIn; // lines or frames received, commands included
+		SingleWriterCounter messagesOut; // broadcasts to a recipient (the sender excluded)
+		SingleWriterCounter bytesIn;
+		SingleWriterCounter bytesOut;
+		SingleWriterCounter compressed; // broadcasts compressed (once each, whatever the number of recipients)
+		SingleWriterCounter compressedOut; // compressed frames sent to a recipient
+		SingleWriterCounter bytesSaved; // by sending compressed frames rather than the messages as they are
+		SingleWriterCounter queued; // bytes in the output queues (a gauge)
+		SingleWriterCounter slowConsumers; // times the outbound policy has applied
+		SingleWriterCounter throttled; // times a connection has been stopped for sending faster than the rate policy allows
+		SingleWriterCounter yielded; // times a connection has used up its read budget, letting the others have their turn
+		SingleWriterCounter mailboxWaits; // times the server has found the mailbox of another shard full, and waited for room
+		SingleWriterCounter wakeups; // iterations of the main loop
+		SingleWriterCounter poolHits; // buffer allocations of the thread served from its pool (a copy of `PoolStats::hits`, taken every iteration)
+		SingleWriterCounter poolMisses; // buffer allocations of the thread that went to the global allocator (see `PoolStats::misses`)
+		BasicLatencyHistogram<SingleWriterCounter> fanOut; // from receiving a message to handing its last copy to the kernel, in nanoseconds
+
+		/**
+		 * @brief Copies the counters of the buffer pool of the calling thread, which only that thread may read.
+		 */
+		void samplePool() {
+			const PoolStats& stats = BufferPool::local().stats();
+			this->poolHits = stats.hits;
+			this->poolMisses = stats.misses;
+		}
+	};
+
+	/**
+	 * @brief The metrics of one or more servers (e.g., every shard of a `ShardedServer`) at some point in time.
+	 */
+	struct MetricsSnapshot {
+		size_t servers = 0;
+		uint64_t accepted = 0;
+		uint64_t rejected = 0;
+		uint64_t acceptFailures = 0;
+		uint64_t peakAcceptRate = 0; // summed over the servers
+		uint64_t closed = 0;
+		uint64_t idleClosed = 0;
+		uint64_t messagesIn = 0;
+		uint64_t messagesOut = 0;
+		uint64_t bytesIn = 0;
+		uint64_t bytesOut = 0;
+		uint64_t compressed = 0;
+		uint64_t compressedOut = 0;
+		uint64_t bytesSaved = 0;
+		uint64_t queued = 0;
+		uint64_t slowConsumers = 0;
+		uint64_t throttled = 0;
+		uint64_t yielded = 0;
+		uint64_t mailboxWaits = 0;
+		uint64_t wakeups = 0;
+		PoolStats pool; // the hits and misses of the buffer pools of the servers
+		LatencyHistogram fanOut;
+
+		void add(const ServerMetrics&);
+		std::string toString() const;
+	};
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace m0st4fa {
+
+	class Server;
+
+	/**
+	 * @brief The connection a nickname belongs to: the shard owning it, its socket, and the generation of its slot (which tells it apart from a later connection reusing the socket; see `Slab::Handle`.)
+	 */
+	struct NicknameOwner {
+		Server* shard = nullptr;
+		int fd = -1;
+		uint32_t generation = 0;
+	};
+
+	/**
+	 * @brief Maps the nicknames of the connections of every shard of the process to their connections, so that a direct message finds its recipient with one hash lookup, however many connections there are. Nicknames are unique regardless of case. Every connection gets a guest nickname (`GUEST_PREFIX` followed by its socket, which no other open connection has) when it is accepted, and may pick another with `/nick`.
+	 */
+	class NicknameRegistry {
+
+		struct Entry {
+			std::string name; // as it has been registered; the key is folded to lower case
+			NicknameOwner owner;
+		};
+
+		// looks names up by `std::string_view`, without building a `std::string`
+		struct Hash {
+			using is_transparent = void;
+
+			size_t operator()(const std::string_view name) const {
+				return std::hash<std::string_view>{}(name);
+			}
+		};
+
+		mutable std::mutex mMutex;
+		std::unordered_map<std::string, Entry, Hash, std::equal_to<>> mNames;
+
+	public:
+
+		static constexpr size_t MAX_NAME_LENGTH = 20;
+		static constexpr std::string_view GUEST_PREFIX = "guest";
+
+		bool claim(const std::string_view, const NicknameOwner&);
+		bool rename(const std::string_view, const std::string_view, const NicknameOwner&);
+		void release(const std::string_view);
+		bool find(const std::string_view, NicknameOwner&) const;
+		static bool isValidName(const std::string_view);
+		static NicknameRegistry& global();
+
+	};
+
+}
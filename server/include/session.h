@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include "common.h"
+#include "event_loop.h"
+#include "framing.h"
+#include "outbound.h"
+#include "task.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief A connection accepted by a `SessionServer`, as its handler sees it: lines are read and bytes written by awaiting coroutines, so a stateful protocol is written as straight-line code rather than as a state machine.
+	 *
+	 * A session is cheap while it waits: its buffers are only held while they hold bytes (they come from the buffer pool), so a session waiting for its next line costs its coroutine frames and little more. At most one coroutine at a time may read from it, and one write to it.
+	 */
+	class Session {
+
+		EventLoop& mLoop;
+		int mFd;
+		sockaddr_storage mAddress;
+		std::optional<LineBuffer> mInput; // only while it holds received bytes
+		std::optional<OutputQueue> mOutput; // only while it holds bytes the socket has not taken yet
+		IoStatus mStatus = IoStatus::DONE;
+
+		void _fail(const int);
+		void _flush();
+		Task<IoStatus> _written();
+
+	public:
+
+		Session(EventLoop& loop, const int fd, const sockaddr_storage& address) : mLoop{ loop }, mFd{ fd }, mAddress{ address } {
+		}
+
+		Session(const Session&) = delete;
+		Session& operator=(const Session&) = delete;
+
+		Task<IoStatus> readLine(std::string_view&);
+		Task<IoStatus> write(const std::string_view);
+		void close();
+
+		/**
+		 * @returns The socket of the connection (which identifies it among the sessions); `-1` once it has been closed.
+		 */
+		int fd() const {
+			return this->mFd;
+		}
+
+		const sockaddr_storage& address() const {
+			return this->mAddress;
+		}
+
+	};
+
+	/**
+	 * @brief A server that runs every accepted connection as a coroutine (see `Session`), on a single-threaded `EventLoop`: `co_await session.readLine(line)`, `co_await session.write(...)`. The connection is closed when the coroutine returns.
+	 */
+	class SessionServer : public ConnectionInformation {
+
+	public:
+
+		using Handler = std::function<Task<void>(Session&)>;
+
+	private:
+
+		EventLoop mLoop;
+		Handler mHandler;
+		size_t mSessions = 0; // sessions whose coroutine has not returned
+
+		Task<void> _accept_all();
+		Task<void> _run(const int, const sockaddr_storage);
+
+	protected:
+
+		const char* _log_source() const override {
+			return "sessions";
+		}
+
+	public:
+
+		/**
+		 * @param[in] myPort The port to listen on.
+		 */
+		SessionServer(const int myPort = 3490) : ConnectionInformation() {
+			this->setDeviceAddress(myPort);
+			this->assignSocket();
+			LOG_INFO("sessions", "Server Information: {}", this->operator std::string());
+		}
+
+		int start(Handler);
+
+		/**
+		 * @returns The loop running the sessions, e.g., for a handler to `sleep` on.
+		 */
+		EventLoop& loop() {
+			return this->mLoop;
+		}
+
+		/**
+		 * @returns The number of sessions whose coroutine has not returned.
+		 */
+		size_t sessionCount() const {
+			return this->mSessions;
+		}
+
+	};
+
+}
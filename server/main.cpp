@@ -1,18 +1,66 @@
-﻿#include "include/interface.h"
+﻿#include <cstring>
+#include "include/interface.h"
 
-static void fn(const int sockFd, std::string_view recvData) {
-	m0st4fa::ConnectionInformation::send(sockFd, recvData);
-};
-
-int main()
+int main(int argc, char* argv[])
 {
 
 	// setup winsock and discard error code :)
 	m0st4fa::setupWinsock();
 
-	m0st4fa::Server server{3490};
+	// usage: server [port] [reactor|uring] [threads] [flush delay in ms] [messages replayed to joining connections] [message log directory, or -] [idle timeout in s] [messages per connection per s] [max connections] [compression threshold in bytes, or 0 for none]
+	int port = argc > 1 ? std::atoi(argv[1]) : 3490;
+	m0st4fa::Server::Engine engine = argc > 2 && std::strcmp(argv[2], "uring") == 0 ? m0st4fa::Server::Engine::URING : m0st4fa::Server::Engine::REACTOR;
+	size_t threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1;
+
+#ifndef _WIN32
+	m0st4fa::MessageLog log; // outlives the server, which appends to it until it is destroyed
+#endif
+
+	m0st4fa::ShardedServer server{ port, threads, engine };
+
+	m0st4fa::OutboundPolicy policy;
+	policy.flushDelay = std::chrono::milliseconds{ argc > 4 ? std::atoi(argv[4]) : 0 };
+	server.setOutboundPolicy(policy);
+
+	m0st4fa::HistoryPolicy history;
+	history.replayCount = argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 20;
+	server.setHistoryPolicy(history);
+
+	// idle connections are pinged halfway through their timeout, so that dead peers fail before it
+	m0st4fa::IdlePolicy idle;
+	idle.timeout = std::chrono::seconds{ argc > 7 ? std::atoi(argv[7]) : 0 };
+	idle.pingAfter = idle.timeout / 2;
+	server.setIdlePolicy(idle);
+
+	m0st4fa::RatePolicy rate;
+	rate.messagesPerSecond = argc > 8 ? std::atof(argv[8]) : 0;
+	server.setRatePolicy(rate);
+
+	m0st4fa::AdmissionPolicy admission;
+	admission.maxConnections = argc > 9 ? std::strtoul(argv[9], nullptr, 10) : 0;
+	server.setAdmissionPolicy(admission);
+
+	m0st4fa::CompressionPolicy compression;
+	if (argc > 10) {
+		compression.threshold = std::strtoul(argv[10], nullptr, 10);
+		compression.enabled = compression.threshold != 0;
+	}
+	server.setCompressionPolicy(compression);
+
+#ifndef _WIN32
+	if (argc > 6 && std::strcmp(argv[6], "-") != 0) {
+		m0st4fa::LogPolicy logPolicy;
+		logPolicy.directory = argv[6];
+
+		if (!log.open(logPolicy))
+			return -1;
+
+		server.setMessageLog(log);
+	}
+#endif
 
-	server.start(fn);
+	// messages are relayed as they are, so no handler is needed
+	server.start();
 
 	return 0;
 }
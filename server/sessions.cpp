@@ -0,0 +1,54 @@
+#include <cstdlib>
+#include <string>
+#include "include/session.h"
+
+// A stateful line protocol on coroutine sessions (see `SessionServer`): every connection is asked for a name, then has
+// its lines echoed back, numbered and signed with it, until it sends "/quit" (or disconnects.)
+//
+// usage: sessions [port]
+
+namespace {
+
+	m0st4fa::Task<void> greeter(m0st4fa::Session& session)
+	{
+		using m0st4fa::IoStatus;
+
+		std::string_view line;
+
+		IoStatus status = co_await session.write("What is your name?\r\n");
+
+		if (status == IoStatus::DONE)
+			status = co_await session.readLine(line);
+
+		if (status != IoStatus::DONE)
+			co_return;
+
+		std::string name{ line.empty() ? std::string_view{ "stranger" } : line };
+		status = co_await session.write(std::format("Hello, {}! Lines are echoed back until \"/quit\".\r\n", name));
+
+		for (size_t count = 1; status == IoStatus::DONE; count++) {
+			status = co_await session.readLine(line);
+
+			if (status != IoStatus::DONE)
+				break;
+
+			if (line == "/quit") {
+				status = co_await session.write(std::format("Goodbye, {}.\r\n", name));
+				break;
+			}
+
+			status = co_await session.write(std::format("{} {}: {}\r\n", count, name, line));
+		}
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	m0st4fa::setupWinsock();
+
+	m0st4fa::SessionServer server{ argc > 1 ? std::atoi(argv[1]) : 3490 };
+	server.start(greeter);
+
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <utility>
+#include "include/channel.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Gets the channel named `name`, creating it if it does not exist yet. Channels are never destroyed, so the result stays valid.
+	 * @param[in] name The name of the channel (see `isValidName`.)
+	 * @returns The channel; `nullptr` if it does not exist and `MAX_CHANNELS` have been created.
+	 */
+	ChannelInfo* ChannelRegistry::intern(const std::string_view name)
+	{
+		std::lock_guard lock{ this->mMutex };
+
+		auto it = this->mChannels.find(name);
+		if (it != this->mChannels.end())
+			return it->second.get();
+
+		if (this->mChannels.size() >= MAX_CHANNELS)
+			return nullptr;
+
+		auto info = std::make_unique<ChannelInfo>();
+		info->id = this->mNextId++;
+		info->name = name;
+
+		ChannelInfo* ref = info.get();
+		this->mChannels.emplace(ref->name, std::move(info));
+
+		return ref;
+	}
+
+	/**
+	 * @brief Checks whether `name` may name a channel: 1 to `MAX_NAME_LENGTH` printable characters, without spaces.
+	 */
+	bool ChannelRegistry::isValidName(const std::string_view name)
+	{
+		if (name.empty() || name.size() > MAX_NAME_LENGTH)
+			return false;
+
+		for (char c : name)
+			if (c <= ' ' || c == 0x7f)
+				return false;
+
+		return true;
+	}
+
+	/**
+	 * @returns The registry shared by every shard of the process. It is never destroyed, since the histories of its channels hold frames of the thread-local buffer pools, which are gone by the time statics are destroyed at exit.
+	 */
+	ChannelRegistry& ChannelRegistry::global()
+	{
+		static ChannelRegistry* registry = new ChannelRegistry();
+		return *registry;
+	}
+
+	/**
+	 * @brief Records the message broadcast in `frame`, overwriting the oldest one once the ring is full.
+	 * @param[in] frame The frame of the message, which the history shares.
+	 * @param[in] at When the message has been broadcast.
+	 * @returns void
+	 */
+	void MessageHistory::record(BroadcastFrame frame, const std::chrono::steady_clock::time_point at)
+	{
+		BroadcastFrame evicted;
+
+		{
+			std::lock_guard lock{ this->mMutex };
+
+			if (this->mEntries.empty())
+				this->mEntries.resize(CAPACITY);
+
+			Entry& entry = this->mEntries[this->mRecorded++ % CAPACITY];
+			evicted = std::exchange(entry.frame, std::move(frame));
+			entry.at = at;
+		}
+
+		// the evicted frame may be the last reference to its buffer, which goes back to the pool outside of the lock
+	}
+
+	/**
+	 * @brief Gets the most recent messages, oldest first.
+	 * @param[in] count The most messages to get.
+	 * @param[in] since Messages broadcast before it are left out.
+	 * @param[out] frames The frames of the messages are appended to it.
+	 * @returns void
+	 */
+	void MessageHistory::recent(const size_t count, const std::chrono::steady_clock::time_point since, std::vector<BroadcastFrame>& frames) const
+	{
+		std::lock_guard lock{ this->mMutex };
+
+		uint64_t first = this->mRecorded - std::min<uint64_t>({ count, CAPACITY, this->mRecorded });
+
+		// the entries are in the order they have been recorded in, so the recent enough ones are at the end
+		while (first < this->mRecorded && this->mEntries[first % CAPACITY].at < since)
+			first++;
+
+		for (uint64_t i = first; i < this->mRecorded; i++)
+			frames.push_back(this->mEntries[i % CAPACITY].frame);
+	}
+
+}
@@ -1,126 +1,737 @@
+#include <charconv>
 #include <functional>
 #include "include/interface.h"
 
 namespace m0st4fa {
 
-	/**
-	 * @brief Formats `msg` for standard server stream.
-	 * @param[in] msg The message to be formatted.
-	 * @returns A string formatted for standard server stream.
-	 */
-	std::string Server::_format_server(const std::string_view msg)
-	{
-		std::string temp = "[server] ";
-		temp += msg;
-		return temp;
-	}
-
 	/**
 	 * @brief Creats and binds listening socket.
 	 * @returns void
 	 * @returns The value returned by `listen`.
 	 */
-	int Server::_set_up_listening_socket() const
+	int Server::_set_up_listening_socket()
 	{
 
-		int listenRv = ::listen(pMySockFd, ConnectionInformation::BACK_LOG);
+		int listenRv = ::listen(pMySockFd, this->mAdmissionPolicy.backlog);
 		int e = errno;
 
 		if (listenRv == -1) {
-			std::cerr << _format("Could not listen on socket {}: {}.\n", std::to_string(pMySockFd), strerror(e));
+			LOG_CRITICAL("server", "Could not listen on socket {}: {}.", pMySockFd, strerror(e));
+			exit(-1);
+		}
+
+		// the listening socket is drained on every wakeup, so it must never block
+		if (setNonBlocking(pMySockFd) == -1) {
+			LOG_CRITICAL("server", "Could not make socket {} non-blocking: {}.", pMySockFd, strerror(errno));
 			exit(-1);
 		}
 
-		std::cout << _format("Listening on port {}\n", std::to_string(this->getBoundPort()));
-		std::cout << _format("Waiting for incoming connections...\n");
+#ifndef _WIN32
+		// see `_on_accept_error`
+		this->mSpareFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
+
+		LOG_INFO("server", "Listening on port {}", this->getBoundPort());
+		LOG_INFO("server", "Waiting for incoming connections...");
 
 		return listenRv;
 	}
 
 	/**
-	 * @brief Implements formatting for standard server stream with 0 format arguments.
-	 * @param[in] msg The message to be formatted.
-	 * @returns A string formatted for standard server stream.
+	 * @brief Receives everything socket `fd` has available into its line buffer and broadcasts every complete line. It never blocks: a partial line stays in the buffer until the rest of it arrives. It stops early if the connection is out of tokens or out of read budget (see `RatePolicy`); the rest stays in the buffer and in the socket until the connection is resumed. The connection is closed if the peer has closed it (or it has failed.)
+	 * @param[in] fd The readable socket.
+	 * @returns void
+	 */
+	void Server::_on_readable(const int fd)
+	{
+		Connection* conn = this->mConnections.find(fd);
+
+		// the connection is about to be closed anyway, or it is not being read for now
+		if (conn == nullptr || conn->doomed || _stopped(*conn))
+			return;
+
+		LineBuffer& input = conn->input;
+
+		// the messages left in the buffer when the connection was stopped come first
+		if (input.size() != 0) {
+			_on_input(fd, input);
+
+			if (conn->doomed || _stopped(*conn))
+				return;
+		}
+
+		while (true) {
+			int rd = input.receive(fd);
+
+			if (rd > 0) {
+				this->mMetrics.bytesIn += (uint64_t)rd;
+				this->mReceivedAt = _now();
+				conn->lastInput = this->mReceivedAt;
+
+				_on_input(fd, input);
+
+				// a protocol error, or the connection has been stopped; the rest of the input is not read
+				if (conn->doomed || _stopped(*conn))
+					return;
+
+				// without non-blocking receives, another receive could block; the descriptor is level-triggered then anyway
+				if (RECV_DONTWAIT == 0)
+					return;
+
+				continue;
+			}
+
+			if (rd == -1 && wouldBlock(lastSocketError()))
+				return; // drained
+
+			_close_connection(fd);
+			return;
+		}
+	}
+
+	/**
+	 * @brief Sends as much of the output queue of socket `fd` as it accepts now, and stops watching it for writability once the queue is empty.
+	 * @param[in] fd The writable socket.
+	 * @returns void
 	 */
-	std::string Server::_format(const std::string_view msg) const
+	void Server::_on_writable(const int fd)
 	{
-		return _format_server(msg);
+		Connection* conn = this->mConnections.find(fd);
+
+		if (conn == nullptr || conn->doomed)
+			return;
+
+		int sent = conn->output.flush(fd);
+
+		if (sent == -1) {
+			_doom(fd, *conn);
+			return;
+		}
+
+		this->mMetrics.bytesOut += (uint64_t)sent;
+		this->mMetrics.queued -= (uint64_t)sent;
+
+		// staged bytes may have gone out with the backlog
+		conn->staged = std::min(conn->staged, conn->output.size());
+
+		if (conn->output.empty() && conn->writeArmed) {
+			conn->writeArmed = false;
+			this->mReactor->modify(fd, CONNECTION_EVENTS);
+		}
 	}
 
 	/**
-	 * @brief Implements formatting for standard server stream with 1 format arguments.
-	 * @param[in] msg The message to be formatted.
-	 * @param[in] arg1 The first formatting argument.
-	 * @returns A string formatted for standard server stream.
+	 * @brief Applies the outbound policy before `size` more bytes are queued for connection `fd`.
+	 * @returns `true` if the bytes may be queued; `false` if they must be discarded (the connection may have been doomed.)
 	 */
-	std::string Server::_format(const std::string_view msg, const std::string_view arg1) const
+	bool Server::_admit_output(const int fd, Connection& conn, const size_t size)
 	{
-		return std::vformat(_format_server(msg).data(), std::make_format_args(arg1));
+		// output is handed to the kernel at the end of the loop iteration (or later, see `OutboundPolicy::flushDelay`);
+		// so neither the bytes in flight nor those staged since the last flush count as queued
+		size_t queued = conn.output.size() - conn.inFlight - conn.staged;
+
+		if (conn.dropping) {
+			if (queued > this->mOutboundPolicy.lowWatermark)
+				return false;
+
+			conn.dropping = false; // the consumer has caught up
+		}
+
+		if (queued + size <= this->mOutboundPolicy.highWatermark)
+			return true;
+
+		this->mMetrics.slowConsumers += 1;
+
+		if (this->mOutboundPolicy.onSlowConsumer == OutboundPolicy::SlowConsumer::DROP) {
+			LOG_WARNING("server", "Dropping output to slow consumer {}", fd);
+			conn.dropping = true;
+			return false;
+		}
+
+		LOG_WARNING("server", "Disconnecting slow consumer {}", fd);
+		_doom(fd, conn);
+
+		return false;
 	}
 
 	/**
-	 * @brief Implements formatting for standard server stream with 1 format arguments.
-	 * @param[in] msg The message to be formatted.
-	 * @param[in] arg1 The first formatting argument.
-	 * @param[in] arg2 The second formatting argument.
-	 * @returns A string formatted for standard server stream.
+	 * @brief Schedules connection `fd` to be closed at the end of the loop iteration. Connections cannot be closed right away while a broadcast iterates over them.
 	 */
-	std::string Server::_format(const std::string_view msg, const std::string_view arg1, const std::string_view arg2) const
+	void Server::_doom(const int fd, Connection& conn)
 	{
-		return std::vformat(_format_server(msg).data(), std::make_format_args(arg1, arg2));
+		if (conn.doomed)
+			return;
+
+		conn.doomed = true;
+		this->mDoomed.push_back(this->mConnections.handle(fd));
 	}
 
 	/**
-	 * @brief Receives every character from socket `fd` until `\r\n` is sent.
-	 * @param[in] fd The socket from which to receive data.
-	 * @param[out] nbytes The number of received bytes. Use this to check whether the client has closed the connection or not.
-	 * @returns The line received from socket `fd`.
+	 * @brief Closes every connection doomed during this loop iteration.
+	 * @returns void
 	 */
-	std::string Server::_receive_line(const int fd, int& nbytes)
+	void Server::_close_doomed()
 	{
-		std::string msg;
-		nbytes = 0; // initialize to 0 as we have not read anything already. This is also useful for when connection is closed.
+		// closing broadcasts a notice, which may doom more connections
+		while (!this->mDoomed.empty()) {
+			std::vector<Slab<Connection>::Handle> doomed;
+			doomed.swap(this->mDoomed);
+
+			for (Slab<Connection>::Handle handle : doomed) {
+				int fd = handle.key;
 
-		while (!msg.ends_with("\r\n")) { // the second case for when the connection is closed, since nothing is sent by definition (and that's why nbytes is 0)
-			int temp = 0;
-			msg += ConnectionInformation::receive(fd, 200, temp);
+				// it has been closed already (its number may have been reused since, by a connection that is not doomed)
+				if (this->mConnections.find(handle) == nullptr)
+					continue;
 
-			if (temp == 0)
-				break; // in this case, `nbytes` must already be initialized to 0 from above.
-			else nbytes += temp; // augment these new characters to `nbytes`
+#ifdef __linux__
+				if (this->mRing != nullptr) {
+					_uring_close(fd);
+					continue;
+				}
+#endif
+
+				_close_connection(fd);
+			}
 		}
+	}
 
-		return msg;
+	/**
+	 * @returns How many milliseconds the main loop may wait for events: until the staged output is due or the next tick of the timers, whichever comes first; `-1` if neither; `0` if connections have yielded.
+	 */
+	int Server::_wait_timeout() const
+	{
+		// the connections that have used up their read budget go on at once
+		if (!this->mYielded.empty())
+			return 0;
+
+		int flush = _flush_timeout();
+		int tick = this->mTimers.timeout(std::chrono::steady_clock::now());
+
+		if (flush == -1 || tick == -1)
+			return std::max(flush, tick);
+
+		return std::min(flush, tick);
 	}
 
 	/**
-	 * @brief Accepts incoming connection.
-	 * @returns The socket to be used to communicate with the new connection.
+	 * @brief Expires the timers that are due: checks the connections that may have become idle, and runs the tasks scheduled with `after`. Only the timers of the elapsed ticks are visited, not every connection.
+	 * @returns void
 	 */
-	int Server::_accept_connection()
+	void Server::_expire_timers()
 	{
-		connectedSockets.push_back(std::pair{ 0, sockaddr_storage{} });
-		int length = sizeof sockaddr_storage;
-		
-		int newSocket = ::accept(this->pMySockFd, (sockaddr*)&this->connectedSockets.back().second, &length);
-		int e = errno;
+		if (this->mTimers.size() == 0)
+			return;
 
-		connectedSockets.back().first = newSocket;
+		this->mTimers.advance(std::chrono::steady_clock::now(), [this](const uint64_t data) {
+			if (data & TASK_TIMER) {
+				uint32_t index = (uint32_t)(data & ~TASK_TIMER);
+				std::function<void()> task = std::move(this->mTasks[index]);
 
-		if (newSocket == -1) {
-			std::cout << _format("Error while accepting connection: {}\n", strerror(e));
-			std::exit(-1);
+				this->mTasks[index] = nullptr;
+				this->mFreeTasks.push_back(index);
+
+				task();
+				return;
+			}
+
+			int fd = (int)data;
+			Connection* conn = this->mConnections.find(fd);
+
+			if (conn != nullptr)
+				_check_idle(fd, *conn);
+			});
+	}
+
+	/**
+	 * @brief Starts checking the new connection `fd` for idleness, if the idle policy asks for it.
+	 * @returns void
+	 */
+	void Server::_watch_idle(const int fd, Connection& conn)
+	{
+		if (this->mIdlePolicy.timeout.count() == 0 && this->mIdlePolicy.pingAfter.count() == 0)
+			return;
+
+		conn.lastInput = conn.lastPing = _now();
+		_check_idle(fd, conn);
+	}
+
+	/**
+	 * @brief Closes connection `fd` if it has sent nothing for too long, pings it if it is due, and arms the timer of its next check. Input leaves the timer alone, it only records when it has arrived (see `Connection::lastInput`), so a busy connection costs one check per period rather than one timer update per message.
+	 * @returns void
+	 */
+	void Server::_check_idle(const int fd, Connection& conn)
+	{
+		if (conn.doomed || conn.closing)
+			return;
+
+		uint64_t now = _now();
+		uint64_t timeout = (uint64_t)std::chrono::nanoseconds{ this->mIdlePolicy.timeout }.count();
+		uint64_t pingAfter = (uint64_t)std::chrono::nanoseconds{ this->mIdlePolicy.pingAfter }.count();
+
+		if (timeout != 0 && now - conn.lastInput >= timeout) {
+			LOG_INFO("server", "Closing connection {}: it has sent nothing for {}s", fd, this->mIdlePolicy.timeout.count());
+			this->mMetrics.idleClosed += 1;
+			_doom(fd, conn);
+			return;
+		}
+
+		uint64_t quietSince = std::max(conn.lastInput, conn.lastPing);
+
+		if (pingAfter != 0 && now - quietSince >= pingAfter) {
+			_ping(fd, conn);
+			conn.lastPing = quietSince = now;
+		}
+
+		uint64_t next = UINT64_MAX;
+
+		if (timeout != 0)
+			next = conn.lastInput + timeout;
+
+		if (pingAfter != 0)
+			next = std::min(next, quietSince + pingAfter);
+
+		auto when = std::chrono::steady_clock::time_point{ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds{ next }) };
+		conn.idleTimer = this->mTimers.arm(when, (uint64_t)fd);
+	}
+
+	/**
+	 * @brief Sends a ping to connection `fd`: a `PING` frame to binary connections, and a telnet NOP (which telnet clients do not show) to text connections that have sent telnet commands. Other clients (e.g., netcat) would show whatever is sent, so they get nothing, and are left to the idle timeout. Sending to a peer that is gone fails the connection, which is then closed.
+	 * @returns void
+	 */
+	void Server::_ping(const int fd, Connection& conn)
+	{
+		if (conn.protocol == Protocol::BINARY) {
+			char ping[FrameHeader::SIZE];
+			FrameHeader{ 0, MessageType::PING, 0 }.encode(ping);
+			this->_write(fd, std::string_view{ ping, sizeof(ping) }, nullptr);
+		}
+		else if (conn.telnet)
+			this->_write(fd, TELNET_NOP, nullptr);
+	}
+
+	/**
+	 * @brief Runs `task` on the thread of the server once `delay` has passed (within a tick of its timers.) It must be called from that thread (e.g., from a message handler, or from another task.)
+	 * @param[in] delay How long to wait.
+	 * @param[in] task The task.
+	 * @returns void
+	 */
+	void Server::after(const std::chrono::milliseconds delay, std::function<void()> task)
+	{
+		uint32_t index;
+
+		if (!this->mFreeTasks.empty()) {
+			index = this->mFreeTasks.back();
+			this->mFreeTasks.pop_back();
+			this->mTasks[index] = std::move(task);
+		}
+		else {
+			index = (uint32_t)this->mTasks.size();
+			this->mTasks.push_back(std::move(task));
+		}
+
+		this->mTimers.arm(std::chrono::steady_clock::now() + delay, TASK_TIMER | index);
+	}
+
+	/**
+	 * @brief Checks whether connection `fd` may have its next message, which has been received whole, handled now: it must have read budget left for this loop iteration, and the tokens for a message and for at least a byte. Otherwise it is stopped: it yields until the next iteration (out of budget), or is throttled until it has the tokens (see `RatePolicy`.) The size of the message is charged afterwards, by `_charge_input`, since it is not known before the message has been parsed.
+	 * @returns `true` if the message may be handled.
+	 */
+	bool Server::_admit_input(const int fd, Connection& conn)
+	{
+		const RatePolicy& policy = this->mRatePolicy;
+
+		if (policy.readBudget != 0) {
+			if (conn.budgetedAt != this->mIteration) {
+				conn.budgetedAt = this->mIteration;
+				conn.budget = policy.readBudget;
+			}
+
+			if (conn.budget == 0) {
+				conn.yielded = true;
+				this->mYielded.push_back(this->mConnections.handle(fd));
+				this->mMetrics.yielded += 1;
+				return false;
+			}
+		}
+
+		if (policy.messagesPerSecond == 0 && policy.bytesPerSecond == 0)
+			return true;
+
+		// the time the input has been received at is good enough, and saves reading the clock for every message
+		uint64_t now = this->mReceivedAt;
+		uint64_t delay = 0;
+
+		if (conn.messageTokens.refilledAt == 0) {
+			conn.messageTokens.fill(policy.messageBurst, now);
+			conn.byteTokens.fill(policy.byteBurst, now);
+		}
+
+		if (policy.messagesPerSecond != 0) {
+			conn.messageTokens.refill(policy.messagesPerSecond, policy.messageBurst, now);
+			delay = conn.messageTokens.delay(policy.messagesPerSecond, 1);
+		}
+
+		if (policy.bytesPerSecond != 0) {
+			conn.byteTokens.refill(policy.bytesPerSecond, policy.byteBurst, now);
+			delay = std::max(delay, conn.byteTokens.delay(policy.bytesPerSecond, 1));
+		}
+
+		if (delay == 0)
+			return true;
+
+		conn.throttled = true;
+		this->mMetrics.throttled += 1;
+
+		// the connection is found by its handle, in case it is closed meanwhile and its number reused
+		auto wait = std::chrono::ceil<std::chrono::milliseconds>(std::chrono::nanoseconds{ delay });
+
+		this->after(wait, [this, handle = this->mConnections.handle(fd)]() {
+			Connection* throttled = this->mConnections.find(handle);
+
+			if (throttled == nullptr)
+				return;
+
+			throttled->throttled = false;
+			_resume_input(handle.key, *throttled);
+			});
+
+		return false;
+	}
+
+	/**
+	 * @brief Charges connection `fd` for a message of `size` bytes it has had handled (see `_admit_input`.)
+	 * @returns void
+	 */
+	void Server::_charge_input(Connection& conn, const size_t size)
+	{
+		conn.budget -= conn.budget != 0;
+		conn.messageTokens.take(1);
+		conn.byteTokens.take((double)size);
+	}
+
+	/**
+	 * @returns Whether the input of `conn` is left alone for now, for being out of tokens or out of read budget.
+	 */
+	bool Server::_stopped(const Connection& conn) const
+	{
+		return conn.throttled || conn.yielded;
+	}
+
+	/**
+	 * @brief Goes on reading connection `fd`, which has been stopped (see `_admit_input`): the messages left in its buffer first, then those the socket has received meanwhile.
+	 * @returns void
+	 */
+	void Server::_resume_input(const int fd, Connection& conn)
+	{
+#ifdef __linux__
+		if (this->mRing != nullptr) {
+			_uring_resume(fd, conn);
+			return;
+		}
+#endif
+
+		this->mReceivedAt = _now();
+		_on_readable(fd);
+	}
+
+	/**
+	 * @brief Resumes the connections that have yielded during the last loop iteration, with a fresh read budget.
+	 * @returns void
+	 */
+	void Server::_resume_yielded()
+	{
+		if (this->mYielded.empty())
+			return;
+
+		std::vector<Slab<Connection>::Handle> yielded;
+		yielded.swap(this->mYielded);
+
+		for (Slab<Connection>::Handle handle : yielded) {
+			Connection* conn = this->mConnections.find(handle);
+
+			if (conn == nullptr)
+				continue;
+
+			// its budget has been used up during this iteration, which is not over yet
+			conn->yielded = false;
+			conn->budgetedAt = this->mIteration;
+			conn->budget = this->mRatePolicy.readBudget;
+
+			_resume_input(handle.key, *conn);
+		}
+	}
+
+	/**
+	 * @brief Broadcasts every complete message buffered in `input` (lines, or frames if the connection has switched to the binary protocol) to the channel of its connection, and carries out the messages that are commands (they start with '/'.) A malformed frame dooms the connection.
+	 * @param[in] fd The socket the messages have been received from.
+	 * @param[in] input The line buffer of the socket.
+	 * @returns void
+	 */
+	void Server::_on_input(const int fd, LineBuffer& input)
+	{
+		Connection& conn = *this->mConnections.find(fd);
+
+		if (!_negotiate(fd, conn))
+			return;
+
+		if (conn.protocol == Protocol::TEXT) {
+			std::string_view line;
+
+			// a connection is only stopped for a message it has sent, not for the next one that may never come
+			while (input.hasLine() && _admit_input(fd, conn)) {
+				input.nextLine(line);
+				this->mMetrics.messagesIn += 1;
+				_charge_input(conn, line.size());
+
+				if (!conn.telnet && line.contains(TELNET_IAC))
+					conn.telnet = true;
+
+				if (line.starts_with('/'))
+					_on_command(fd, conn, line);
+				else {
+					this->mFanOuts.push_back(this->mReceivedAt);
+					_broadcast_frame(conn.channel, fd, _make_frame(MessageType::MESSAGE, fd, line, conn.nickname, &this->mCompressionPolicy));
+				}
+			}
+
+			return;
+		}
+
+		FrameHeader header;
+		std::string_view payload;
+
+		while (input.hasFrame() && _admit_input(fd, conn)) {
+			if (input.nextFrame(header, payload) != FrameStatus::COMPLETE || header.type != MessageType::MESSAGE) {
+				LOG_WARNING("server", "Closing connection {}: malformed frame", fd);
+				_doom(fd, conn);
+				return;
+			}
+
+			this->mMetrics.messagesIn += 1;
+			_charge_input(conn, payload.size());
+
+			if (payload.starts_with('/'))
+				_on_command(fd, conn, payload);
+			else {
+				this->mFanOuts.push_back(this->mReceivedAt);
+				_broadcast_frame(conn.channel, fd, _make_frame(MessageType::MESSAGE, fd, payload, conn.nickname, &this->mCompressionPolicy));
+			}
+		}
+	}
+
+	/**
+	 * @brief Decides the protocol of a connection from the first bytes it sends: `BINARY_HELLO` (and a nonce) switches it to binary frames, which is acknowledged with a `HELLO` frame carrying the nonce; `DEFLATE_HELLO` does too, and also gets it compressed frames if the compression policy allows (the `HELLO` frame then says so); anything else keeps it on text lines.
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection.
+	 * @returns `true` once the protocol is known; `false` while the beginning of the hello is all that has been received.
+	 */
+	bool Server::_negotiate(const int fd, Connection& conn)
+	{
+		if (conn.protocol != Protocol::PENDING)
+			return true;
+
+		std::string_view received = conn.input.pending();
+		size_t compared = std::min(received.size(), BINARY_HELLO.size());
+		bool binary = received.substr(0, compared) == BINARY_HELLO.substr(0, compared);
+
+		if (!binary && received.substr(0, compared) != DEFLATE_HELLO.substr(0, compared)) {
+			conn.protocol = Protocol::TEXT;
+			return true;
+		}
+
+		if (received.size() < BINARY_HELLO.size() + NONCE_SIZE)
+			return false;
+
+		conn.protocol = Protocol::BINARY;
+		conn.deflate = !binary && this->mCompressionPolicy.enabled && compressionAvailable();
+
+		// the codec, if the connection gets compressed frames, then the nonce
+		char hello[FrameHeader::SIZE + DEFLATE_CODEC.size() + NONCE_SIZE];
+		size_t length = FrameHeader::SIZE;
+
+		if (conn.deflate) {
+			sDeflateConnections.fetch_add(1, std::memory_order_relaxed);
+			std::memcpy(hello + length, DEFLATE_CODEC.data(), DEFLATE_CODEC.size());
+			length += DEFLATE_CODEC.size();
+		}
+
+		std::memcpy(hello + length, received.data() + BINARY_HELLO.size(), NONCE_SIZE);
+		length += NONCE_SIZE;
+		FrameHeader{ (uint32_t)(length - FrameHeader::SIZE), MessageType::HELLO, (uint32_t)fd }.encode(hello);
+
+		conn.input.discard(BINARY_HELLO.size() + NONCE_SIZE);
+		this->_write(fd, std::string_view{ hello, length }, nullptr);
+
+		return true;
+	}
+
+	/**
+	 * @brief Sends `msg` to connection `fd` only, as a notice in the protocol of the connection (e.g., replies to commands.)
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection.
+	 * @param[in] msg The message, without line ending.
+	 * @param[in] prompt Whether text connections get the prompt after it (not if a broadcast brings the prompt right after it.)
+	 * @returns void
+	 */
+	void Server::_reply(const int fd, const Connection& conn, const std::string_view msg, const bool prompt)
+	{
+		PooledString reply;
+
+		if (conn.protocol == Protocol::BINARY) {
+			reply.resize(FrameHeader::SIZE);
+			FrameHeader{ (uint32_t)msg.size(), MessageType::NOTICE, 0 }.encode(reply.data());
+			reply.append(msg);
+		}
+		else
+			reply.append(msg).append(prompt ? "\r\n> " : "\r\n");
+
+		this->_write(fd, reply, nullptr);
+	}
+
+	/**
+	 * @brief Accepts every pending connection from the (non-blocking, edge-triggered) listening socket, until its queue is drained, and starts watching them.
+	 * @returns void
+	 */
+	void Server::_accept_pending()
+	{
+		while (true) {
+			sockaddr_storage addr{};
+			int newSocket = acceptNonBlocking(this->pMySockFd, &addr);
+
+			if (newSocket == -1) {
+				int e = lastSocketError();
+
+				// the queue of pending connections has been drained
+				if (wouldBlock(e) || !_on_accept_error(e))
+					return;
+
+				continue;
+			}
+
+			if (_admit_connection(newSocket, &addr) != nullptr)
+				this->mReactor->add(newSocket, CONNECTION_EVENTS);
+		}
+	}
+
+	/**
+	 * @brief Registers the accepted connection `fd`: it is welcomed, gets its guest nickname (see `NicknameRegistry`), joins the lobby and gets its recent messages. It is rejected instead (see `_reject`) if the server already has `AdmissionPolicy::maxConnections` open.
+	 * @param[in] fd The accepted socket.
+	 * @param[in] addr The address of the peer; `nullptr` if the engine has not got it (see `_peer_address`.)
+	 * @returns The new connection; `nullptr` if it has been rejected, or has failed already.
+	 */
+	Server::Connection* Server::_admit_connection(const int fd, const sockaddr_storage* addr)
+	{
+		size_t max = this->mAdmissionPolicy.maxConnections;
+
+		if (max != 0 && this->mConnections.size() >= max) {
+			_reject(fd);
+			return nullptr;
+		}
+
+		Connection& conn = this->mConnections.insert(fd);
+		this->mMetrics.accepted += 1;
+
+		if (addr != nullptr)
+			conn.address = *addr;
+
+		LOG_INFO("server", "Accepted connection from {}", toString(&_peer_address(fd, conn)));
+
+		// queued like any output, so that it goes out with the next flush without blocking; a peer that is gone already fails then, and is closed
+		this->_write(fd, std::format("Welcome {}!\r\n> ", fd), nullptr);
+
+		// the socket is unique among the open connections of every shard, so the guest nickname is free
+		conn.nickname = std::format("{}{}", NicknameRegistry::GUEST_PREFIX, fd);
+		NicknameRegistry::global().claim(conn.nickname, NicknameOwner{ this, fd, this->mConnections.handle(fd).generation });
+
+		uint64_t second = _now() / 1000000000;
+
+		if (second != this->mAcceptSecond) {
+			this->mAcceptSecond = second;
+			this->mAcceptsThisSecond = 0;
 		}
 
-		int sendRv = _initialize_connection(newSocket, &connectedSockets.back().second);
+		if (++this->mAcceptsThisSecond > this->mMetrics.peakAcceptRate)
+			this->mMetrics.peakAcceptRate = this->mAcceptsThisSecond;
 
-		// handle errors while sending welcoming words
-		if (sendRv > 0) {
-			std::cout << _format("Error while sending the welcoming words to a new connection: {}\n", strerror(errno));
+		_join(fd, conn, *this->mLobby);
+		_replay(fd, conn, *this->mLobby);
+		_watch_idle(fd, conn);
+
+		return &conn;
+	}
+
+	/**
+	 * @brief Gets the address of the peer of connection `fd`, looking it up the first time if the engine has not got it with the connection (the io_uring engine does not ask for it, since it is only logged.)
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection, which keeps the address.
+	 * @returns The address; `AF_UNSPEC` if it cannot be looked up.
+	 */
+	const sockaddr_storage& Server::_peer_address(const int fd, Connection& conn)
+	{
+		if (conn.address.ss_family == AF_UNSPEC) {
+			socklen_t length = sizeof(conn.address);
+
+			if (::getpeername(fd, (sockaddr*)&conn.address, &length) != 0)
+				conn.address = sockaddr_storage{};
+		}
+
+		return conn.address;
+	}
+
+	/**
+	 * @brief Handles a failed accept.
+	 * @param[in] e The error.
+	 * @returns `true` if the next pending connection may be accepted right away; `false` if accepting has to wait for the next wakeup.
+	 */
+	bool Server::_on_accept_error(const int e)
+	{
+		this->mMetrics.acceptFailures += 1;
+
+		if (isTransientAcceptError(e))
+			return true;
+
+#ifndef _WIN32
+		// out of descriptors: the pending connections would stay queued (and the listening socket would not signal them again), so the spare descriptor is given up to accept one and close it
+		if ((e == EMFILE || e == ENFILE) && this->mSpareFd != -1) {
+			LOG_WARNING("server", "Out of descriptors; rejecting a connection");
+
+			::close(this->mSpareFd);
+			int newSocket = ::accept(this->pMySockFd, nullptr, nullptr);
+
+			if (newSocket != -1) {
+				::close(newSocket);
+				this->mMetrics.rejected += 1;
+			}
+
+			this->mSpareFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+			return newSocket != -1;
+		}
+
+		// the listening socket itself is broken; nothing can be accepted anymore
+		if (e == EBADF || e == ENOTSOCK || e == EINVAL) {
+			LOG_CRITICAL("server", "Error while accepting connection: {}", strerror(e));
 			std::exit(-1);
 		}
-		
-		return newSocket;
+#endif
+
+		// e.g., out of memory for the socket: the pending connections wait in the queue
+		LOG_WARNING("server", "Error while accepting connection: {}", ConnectionInformation::formatFckingMSErrorMessages(e));
+		return false;
+	}
+
+	/**
+	 * @brief Rejects the accepted connection `fd`: it gets a notice (if its socket takes it at once) and is closed, without being registered. Rejecting takes two system calls, so a server at its limit sheds a storm of connections quickly, and the clients learn at once to try again later, rather than when their connection attempt times out.
+	 * @returns void
+	 */
+	void Server::_reject(const int fd)
+	{
+		// the socket is non-blocking (as are the flags of the send, where sockets cannot be), so a peer that does not take the notice at once does not get it
+		::send(fd, SERVER_FULL.data(), (int)SERVER_FULL.size(), SEND_NOSIGNAL | RECV_DONTWAIT);
+		::closesocket(fd);
+
+		this->mMetrics.rejected += 1;
 	}
 
 	/**
@@ -128,113 +739,570 @@ namespace m0st4fa {
 	 */
 	void Server::_close_connection(const int sockFd)
 	{
-		// tell everyone that `sockFd` has quit
-		this->_broadcast(sockFd, [sockFd](int s, std::string_view msg) {
-			m0st4fa::ConnectionInformation::send(s, std::to_string(sockFd) + " has disconnected.");
-			}, "");
+		Connection& conn = *this->mConnections.find(sockFd);
+		sockaddr_storage address = conn.address;
+		uint32_t channel = conn.channel;
+		std::string nickname = std::move(conn.nickname);
+
+		_leave(conn);
+
+		// released before the socket is closed, since the guest nickname of a connection reusing its number (on any shard) is the same
+		NicknameRegistry::global().release(nickname);
+
+		this->mTimers.cancel(conn.idleTimer);
+
+		if (conn.deflate)
+			sDeflateConnections.fetch_sub(1, std::memory_order_relaxed);
 
 		// remove socket from being polled
-		this->fileDescriptors.remove(sockFd);
-
-		// TODO: You can make this more efficient if both have the same index (although will also require modification of `remove`
-		// remove connection information of socket
-		auto it = std::find_if(
-			this->connectedSockets.begin(), this->connectedSockets.end(),
-			[&sockFd](const std::pair<int, sockaddr_storage>& pair) {
-				return pair.first == sockFd;
-			});
+		this->mReactor->remove(sockFd);
+		::closesocket(sockFd);
+		this->mMetrics.queued -= conn.output.size();
+		this->mMetrics.closed += 1;
+		this->mConnections.erase(sockFd);
+
+		this->_forget_connection(sockFd, address, channel, nickname);
+	}
 
-		std::cout << _format("Removed connection {}\n", toString(&it->second));
+	/**
+	 * @brief Tells the channel `sockFd` was in that it has quit. The socket itself is closed by the caller, which also removes it from the channel.
+	 * @param[in] sockFd The socket that has quit.
+	 * @param[in] address The address of its peer.
+	 * @param[in] channel The channel it was in.
+	 * @param[in] nickname The nickname it had.
+	 */
+	void Server::_forget_connection(const int sockFd, const sockaddr_storage& address, const uint32_t channel, const std::string_view nickname)
+	{
+		LOG_INFO("server", "Removed connection {}", toString(&address));
 
-		this->connectedSockets.erase(it, it);
+		// tell everyone that `sockFd` has quit
+		this->_broadcast(channel, sockFd, std::format("{} has disconnected.", nickname));
 
 	}
 
 	/**
-	 * @brief Calls function `fn` with the argument `msg` for each connection of the server. It is intended to broadcast `msg` to every connection of the server at the time of making the call.
-	 * @param[in] sockIndex The index of the socket sending the data.
-	 * @param[in] fn The function to be called for each socket connected to the server.
-	 * @param[in] msg The message passed to `fn` as argument.
+	 * @brief Broadcasts the notice `msg` to every member of `channel` at the time of making the call.
+	 * @param[in] channel The channel to broadcast to.
+	 * @param[in] senderFd The socket the notice is about.
+	 * @param[in] msg The notice to be broadcast.
 	 * @returns void
 	 */
-	void Server::_broadcast(const size_t sockIndex, FnType fn, const std::string_view msg) const
+	void Server::_broadcast(const uint32_t channel, const int senderFd, const std::string_view msg)
 	{
-		for (size_t j = 0; j < this->fileDescriptors.getLength(); j++) {
-			int sock = this->fileDescriptors.at(j).fd;
+		this->_broadcast_frame(channel, senderFd, _make_frame(MessageType::NOTICE, senderFd, msg));
+	}
 
-			// this socket and the listening socket are skipped
-			if (j != sockIndex && j != this->pMySockFd) {
-				ConnectionInformation::send(sock, "\b\b");
-				fn(sock, msg);
-				ConnectionInformation::send(sock, "\r\n");
+	/**
+	 * @brief Builds the frame of a broadcast (see `FRAME_OVERHEAD`) in place, in a buffer from the pool: the binary frame, then (if `compression` is given, and the message is worth compressing) a `COMPRESSED` frame of it, then the text "\b\b<sender>: <payload>\r\n> " for messages, "\b\b<sender> (private): <payload>\r\n> " for direct messages or "\b\b<payload>\r\n> " for notices. Recipients get a slice of it in their protocol (see `_split_frame`), so it is only built (and compressed) once whatever the mix of protocols.
+	 * @param[in] type The type of the message.
+	 * @param[in] senderFd The socket the message comes from (or is about.)
+	 * @param[in] payload The message.
+	 * @param[in] senderName The nickname of the sender, shown in the text; its socket is shown if it is empty (e.g., for messages read back from the message log.)
+	 * @param[in] compression Whether and how to compress the message; `nullptr` to leave it raw.
+	 * @returns The frame, with where its parts start.
+	 */
+	BroadcastFrame Server::_make_frame(const MessageType type, const int senderFd, const std::string_view payload, const std::string_view senderName, const CompressionPolicy* compression)
+	{
+		constexpr size_t COMPRESSED_OVERHEAD = FrameHeader::SIZE + COMPRESSED_PREFIX_SIZE;
+
+		// nobody would get the compressed frame, or it could not be smaller than the message
+		bool compress = compression != nullptr && payload.size() >= compression->threshold && payload.size() > COMPRESSED_PREFIX_SIZE + 1
+			&& sDeflateConnections.load(std::memory_order_relaxed) != 0;
+
+		PooledString frame;
+		frame.reserve(FRAME_OVERHEAD + senderName.size() + (compress ? COMPRESSED_OVERHEAD + 3 * payload.size() : 2 * payload.size()));
+
+		frame.resize(FrameHeader::SIZE);
+		FrameHeader{ (uint32_t)payload.size(), type, (uint32_t)senderFd }.encode(frame.data());
+		frame.append(payload);
+
+		size_t compressedAt = frame.size();
+
+		if (compress) {
+			size_t offset = frame.size();
+			size_t capacity = payload.size() - COMPRESSED_PREFIX_SIZE - 1; // so that the compressed frame is smaller than the binary frame
+
+			frame.resize(offset + COMPRESSED_OVERHEAD + capacity);
+			size_t size = deflateRaw(payload, frame.data() + offset + COMPRESSED_OVERHEAD, capacity, compression->level);
+
+			if (size == 0)
+				frame.resize(offset);
+			else {
+				frame.resize(offset + COMPRESSED_OVERHEAD + size);
+
+				char* out = frame.data() + offset;
+				FrameHeader{ (uint32_t)(COMPRESSED_PREFIX_SIZE + size), MessageType::COMPRESSED, (uint32_t)senderFd }.encode(out);
+
+				out += FrameHeader::SIZE;
+				out[0] = (char)type;
+				out[1] = (char)(payload.size() >> 24);
+				out[2] = (char)(payload.size() >> 16);
+				out[3] = (char)(payload.size() >> 8);
+				out[4] = (char)payload.size();
 			}
+		}
+
+		size_t textAt = frame.size();
+		frame.append("\b\b");
+
+		if (type == MessageType::MESSAGE || type == MessageType::PRIVATE) {
+			char sender[16];
+			char* senderEnd = std::to_chars(sender, sender + sizeof(sender), senderFd).ptr;
 
-			if (j != this->pMySockFd)
-				ConnectionInformation::send(sock, "> "); // The client already supplies \r\n these when they return, so no need to add more
+			if (senderName.empty())
+				frame.append(sender, senderEnd);
+			else
+				frame.append(senderName);
+
+			frame.append(type == MessageType::PRIVATE ? " (private): " : ": ");
 		}
+
+		frame.append(payload).append("\r\n> ");
+
+		return BroadcastFrame{ makeFrame(std::move(frame)), (uint32_t)compressedAt, (uint32_t)textAt };
+	}
+
+	/**
+	 * @brief Slices a frame built by `_make_frame` at the boundaries it has recorded.
+	 * @param[in] frame The frame.
+	 * @returns Its slices.
+	 */
+	Server::FrameParts Server::_split_frame(const BroadcastFrame& frame)
+	{
+		std::string_view framed = *frame.frame;
+
+		return FrameParts{
+			framed.substr(0, frame.compressedAt),
+			framed.substr(frame.compressedAt, frame.textAt - frame.compressedAt),
+			framed.substr(frame.textAt),
+		};
+	}
+
+	/**
+	 * @brief Broadcasts `frame` (see `FRAME_OVERHEAD`) to every member of `channel`: the members on this shard are served at once, and the other shards that have members get it through their mailboxes.
+	 * @param[in] channel The channel to broadcast to.
+	 * @param[in] senderFd The socket sending the data.
+	 * @param[in] frame The framed message; every recipient (and every shard) shares it.
+	 * @returns void
+	 */
+	void Server::_broadcast_frame(const uint32_t channel, const int senderFd, BroadcastFrame frame)
+	{
+		FrameParts parts = _split_frame(frame);
+
+		if (!parts.compressed.empty())
+			this->mMetrics.compressed += 1;
+
+		// only messages are kept (and replayed to the connections joining later), not notices
+		if (FrameHeader::decode(parts.binary.data()).type == MessageType::MESSAGE) {
+			ChannelInfo& info = *this->mChannels[channel].info;
+
+			if (this->mHistoryPolicy.replayCount != 0)
+				info.history.record(frame, std::chrono::steady_clock::now());
+
+#ifndef _WIN32
+			if (this->mLog != nullptr)
+				this->mLog->append(info.name, frame.frame);
+#endif
+		}
+
+		this->_broadcast_local(channel, senderFd, frame);
+
+		if (this->mPeers.empty())
+			return;
+
+		uint64_t shards = this->mChannels[channel].info->shards.load(std::memory_order_relaxed);
+
+		for (Server* peer : this->mPeers)
+			if (shards & (1ull << peer->mShardIndex))
+				peer->_post(Post{ channel, frame });
+	}
+
+	/**
+	 * @brief Sends `frame` to each member of `channel` on this shard, with a single send per member. The sender only gets the prompt. If a message handler has been passed to `start`, it is called with the message for each member instead.
+	 * @param[in] channel The channel to broadcast to.
+	 * @param[in] senderFd The socket sending the data (`-1` if it belongs to another shard.)
+	 * @param[in] frame The framed message.
+	 * @returns void
+	 */
+	void Server::_broadcast_local(const uint32_t channel, const int senderFd, const BroadcastFrame& frame)
+	{
+		// no connection of this shard has ever joined the channel
+		if (channel >= this->mChannels.size())
+			return;
+
+		const std::vector<int>& members = this->mChannels[channel].members;
+		auto [binary, compressed, text] = _split_frame(frame);
+		std::string_view prompt = text.substr(text.size() - 2); // The client already supplies \r\n these when they return, so no need to add more
+		uint64_t recipients = 0;
+
+		if (this->mFanOut == nullptr) {
+			uint64_t compressedRecipients = 0;
+
+			for (int sock : members) {
+				// binary senders get nothing back, not even a prompt
+				recipients += sock != senderFd;
+
+				const Connection& conn = *this->mConnections.find(sock);
+
+				if (conn.protocol == Protocol::BINARY) {
+					if (sock == senderFd)
+						continue;
+
+					bool deflate = conn.deflate && !compressed.empty();
+					compressedRecipients += deflate;
+					this->_write(sock, deflate ? compressed : binary, &frame.frame);
+				}
+				else
+					this->_write(sock, sock != senderFd ? text : prompt, &frame.frame);
+			}
+
+			this->mMetrics.messagesOut += recipients;
+
+			if (compressedRecipients != 0) {
+				this->mMetrics.compressedOut += compressedRecipients;
+				this->mMetrics.bytesSaved += compressedRecipients * (binary.size() - compressed.size());
+			}
+
+			return;
+		}
+
+		this->mMetrics.messagesOut += this->mFanOut(*this, this->mHandler.get(), members, senderFd, frame);
+	}
+
+	/**
+	 * @brief Replays the recent messages of `info` (see `HistoryPolicy`) to the connection of `fd`, which has just joined it. They are queued like any broadcast, sharing the frames they have been broadcast in, and sent by the next flush, so a long history neither copies nor blocks (and the outbound policy applies to it.) A connection that has not chosen its protocol yet gets text, which binary clients skip.
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection.
+	 * @param[in] info The channel it has joined.
+	 * @returns void
+	 */
+	void Server::_replay(const int fd, const Connection& conn, ChannelInfo& info)
+	{
+		if (this->mHistoryPolicy.replayCount == 0)
+			return;
+
+		auto since = std::chrono::steady_clock::time_point::min();
+
+		if (this->mHistoryPolicy.replayAge.count() != 0)
+			since = std::chrono::steady_clock::now() - this->mHistoryPolicy.replayAge;
+
+		info.history.recent(this->mHistoryPolicy.replayCount, since, this->mReplayed);
+
+		for (const BroadcastFrame& frame : this->mReplayed)
+			_send_frame(fd, conn, frame);
+
+		this->mReplayed.clear();
+	}
+
+	/**
+	 * @brief Sends `frame` (see `_make_frame`) to the connection of `fd` alone, in its protocol (compressed, if it takes compressed frames and the frame has one), sharing the frame; or through the message handler, if one has been passed to `start`.
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection.
+	 * @param[in] frame The framed message.
+	 * @returns void
+	 */
+	void Server::_send_frame(const int fd, const Connection& conn, const BroadcastFrame& frame)
+	{
+		if (this->mFanOut != nullptr) {
+			this->mMetrics.messagesOut += this->mFanOut(*this, this->mHandler.get(), std::span<const int>{ &fd, 1 }, -1, frame);
+			return;
+		}
+
+		auto [binary, compressed, text] = _split_frame(frame);
+
+		this->mMetrics.messagesOut += 1;
+
+		if (conn.protocol != Protocol::BINARY) {
+			this->_write(fd, text, &frame.frame);
+			return;
+		}
+
+		if (conn.deflate && !compressed.empty()) {
+			this->_write(fd, compressed, &frame.frame);
+			this->mMetrics.compressedOut += 1;
+			this->mMetrics.bytesSaved += binary.size() - compressed.size();
+			return;
+		}
+
+		this->_write(fd, binary, &frame.frame);
+	}
+
+	/**
+	 * @brief Sends `msg` to connection `sockFd` through the engine driving the server, without blocking. Whatever the socket does not accept right away is queued (subject to the outbound policy.) Message handlers should send through this function.
+	 * @param[in] sockFd The connection to send to.
+	 * @param[in] msg The message to be sent.
+	 * @returns void
+	 */
+	void Server::write(const int sockFd, const std::string_view msg)
+	{
+		// a binary recipient gets what the handler sends as the payload of a single frame (see `_fan_out`)
+		if (sockFd == this->mCaptureFd) {
+			this->mCaptured.append(msg);
+			return;
+		}
+
+		this->_write(sockFd, msg, nullptr);
+	}
+
+	/**
+	 * @brief Starts collecting what the message handler sends to the binary connection of `fd` (see `_fan_out`.)
+	 * @returns void
+	 */
+	void Server::_begin_capture(const int fd)
+	{
+		this->mCaptureFd = fd;
+		this->mCaptured.resize(FrameHeader::SIZE);
+	}
+
+	/**
+	 * @brief Sends what the message handler has sent to the connection of `fd` since `_begin_capture` as one binary frame, of the type and sender of the message it has been called for.
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] message The header of the binary frame of the message.
+	 * @returns void
+	 */
+	void Server::_end_capture(const int fd, const FrameHeader& message)
+	{
+		this->mCaptureFd = -1;
+		FrameHeader{ (uint32_t)(this->mCaptured.size() - FrameHeader::SIZE), message.type, message.sender }.encode(this->mCaptured.data());
+
+		Frame frame = makeFrame(std::exchange(this->mCaptured, PooledString{}));
+		this->_write(fd, *frame, &frame);
+	}
+
+	/**
+	 * @brief Sends `data` to connection `sockFd`, queueing whatever the socket does not accept right away.
+	 * @param[in] sockFd The connection to send to.
+	 * @param[in] data The bytes to be sent.
+	 * @param[in] frame The frame `data` is part of, which is then queued without copying; `nullptr` if `data` must be copied to be queued.
+	 * @returns void
+	 */
+	void Server::_write(const int sockFd, const std::string_view data, const Frame* frame)
+	{
+		Connection* found = this->mConnections.find(sockFd);
+
+		if (found == nullptr || data.empty())
+			return;
+
+		Connection& conn = *found;
+
+		if (conn.doomed || conn.closing || !_admit_output(sockFd, conn, data.size()))
+			return;
+
+		// queued bytes are sent together at the end of the loop iteration (see `_flush_dirty` and `_uring_flush`)
+		if (frame != nullptr)
+			conn.output.append(*frame, data.data() - (*frame)->data(), data.size());
+		else
+			conn.output.append(data);
+
+		conn.staged += data.size();
+		this->mMetrics.queued += data.size();
+		_stage(sockFd, conn);
+	}
+
+	/**
+	 * @brief Marks connection `fd` as having staged output, to be sent by the next flush.
+	 * @returns void
+	 */
+	void Server::_stage(const int fd, Connection& conn)
+	{
+		if (conn.dirty)
+			return;
+
+		conn.dirty = true;
+
+		// the first staged bytes start the batch
+		if (this->mDirty.empty() && this->mOutboundPolicy.flushDelay.count() != 0)
+			this->mFlushDeadline = std::chrono::steady_clock::now() + this->mOutboundPolicy.flushDelay;
+
+		this->mDirty.push_back(fd);
+	}
+
+	/**
+	 * @returns How many milliseconds the staged output may still wait for more; `0` if it is due, `-1` if nothing is staged.
+	 */
+	int Server::_flush_timeout() const
+	{
+		if (this->mDirty.empty())
+			return -1;
+
+		if (this->mOutboundPolicy.flushDelay.count() == 0)
+			return 0;
+
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(this->mFlushDeadline - std::chrono::steady_clock::now());
+
+		return left.count() > 0 ? (int)left.count() : 0;
+	}
+
+	/**
+	 * @brief Sends the output staged for every dirty connection with as few system calls as the socket allows (see `OutputQueue::flush`), once it is due. Whatever a socket does not accept is sent when it becomes writable.
+	 * @returns void
+	 */
+	void Server::_flush_dirty()
+	{
+		if (_flush_timeout() > 0)
+			return;
+
+		for (int fd : this->mDirty) {
+			Connection* found = this->mConnections.find(fd);
+
+			if (found == nullptr)
+				continue;
+
+			Connection& conn = *found;
+			conn.dirty = false;
+			conn.staged = 0;
+
+			// the socket is full already; `_on_writable` sends the rest
+			if (conn.doomed || conn.writeArmed)
+				continue;
+
+			int sent = conn.output.flush(fd);
+
+			if (sent == -1) {
+				_doom(fd, conn);
+				continue;
+			}
+
+			this->mMetrics.bytesOut += (uint64_t)sent;
+			this->mMetrics.queued -= (uint64_t)sent;
+
+			if (!conn.output.empty()) {
+				conn.writeArmed = true;
+				this->mReactor->modify(fd, CONNECTION_EVENTS | Reactor::WRITABLE);
+			}
+		}
+
+		this->mDirty.clear();
+		_record_fan_outs();
+	}
+
+	/**
+	 * @brief Records the latency of every message broadcast since the last flush, which has just handed the last of their copies to the kernel (or has queued them, for sockets that are full.)
+	 * @returns void
+	 */
+	void Server::_record_fan_outs()
+	{
+		if (this->mFanOuts.empty())
+			return;
+
+		uint64_t now = _now();
+
+		for (uint64_t receivedAt : this->mFanOuts)
+			this->mMetrics.fanOut.record(now > receivedAt ? now - receivedAt : 0);
+
+		this->mFanOuts.clear();
+	}
+
+	/**
+	 * @returns The time in nanoseconds, on a monotonic clock.
+	 */
+	uint64_t Server::_now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 	}
 
 	/**
 	* @brief Listens on the bound address (There must exist one before calling this) and accepts incoming	connections. It aborts the process in case listen returns -1;
-	* @param[in] fn Function expected to take a socket descriptor and received data and returns nothing (void.)
+	* @param[in] fn Function expected to take a socket descriptor and received data and returns nothing (void.) It is called for every recipient of every message; without it, each message is framed once and sent to every recipient as is. A handler whose type is known at compile time is better passed to `start<Handler>`, which calls it without type erasure.
 	* @returns The value returned by `listen` (important for error checking).
 	*/
 	int Server::start(FnType fn)
+	{
+		if (fn)
+			return this->start<FnType>(std::move(fn));
+
+		return _start();
+	}
+
+	/**
+	 * @brief Sets up the listening socket and runs the main loop of the engine, with the handler set by `start` (if any.)
+	 * @returns The value returned by `listen`.
+	 */
+	int Server::_start()
 	{
 		int listenRv = _set_up_listening_socket();
-		int e = errno;
 
-		this->fileDescriptors.add(this->pMySockFd, POLLIN); // add the listening socket and poll for received data
+		tCurrent = this;
+
+#ifdef __linux__
+		if (this->mEngine == Engine::URING)
+			return _run_uring() == 0 ? listenRv : -1;
+#endif
+
+		_run_reactor();
+
+		return listenRv;
+	}
+
+	/**
+	 * @brief Runs the readiness-based main loop on `mReactor`. It only returns if polling fails.
+	 * @returns `0`
+	 */
+	int Server::_run_reactor()
+	{
+		int e = 0;
+
+		this->mReactor->add(this->pMySockFd, Reactor::READABLE | Reactor::EDGE); // add the listening socket and wait for incoming connections
+		LOG_INFO("server", "Using the {} event loop backend", this->mReactor->name());
+
+		if (this->mWakeFd != -1)
+			this->mReactor->add(this->mWakeFd, Reactor::READABLE); // broadcasts posted by the other shards
+
+		std::vector<ReactorEvent> events(MAX_EVENTS);
 
 		// get into the main loop
 		while (true) {
 
-			int pollrv = ::WSAPoll(this->fileDescriptors.getSockets(), this->fileDescriptors.getLength(), -1);
-			e = WSAGetLastError();
+			// wake up when the staged output or a timer is due, if nothing else happens before
+			int ready = this->mReactor->wait(events, _wait_timeout());
+			e = lastSocketError();
 
-			// report errors after poll returns
-			if (pollrv == -1) {
-				std::cout << _format("Error while polling for sockets: {}\n", ConnectionInformation::formatFckingMSErrorMessages(e));
+			this->mMetrics.wakeups += 1;
+			this->mMetrics.samplePool();
+			this->mIteration++;
 
-				std::exit(-1);
-			}
+			// report errors after the wait returns
+			if (ready == -1) {
+				if (e == EINTR)
+					continue;
 
-			// if timed out
-			if (pollrv == 0) {
-				std::cout << _format("Timed out while polling for sockets\n");
-				continue;
-			}
+				LOG_CRITICAL("server", "Error while polling for sockets: {}", ConnectionInformation::formatFckingMSErrorMessages(e));
 
-			// no error nor time out at this point. at this point, pollrv = the number of sockets with events.
-			for (size_t i = 0; i < this->fileDescriptors.getLength(); i++) {
-				pollfd curr = this->fileDescriptors.at(i);
+				std::exit(-1);
+			}
 
-				if (curr.revents == 0) // if no event has been detected for this socket
-					continue;
+			// only the ready sockets are visited
+			for (int i = 0; i < ready; i++) {
+				const ReactorEvent& curr = events[i];
 
-				if (curr.fd == this->pMySockFd) // if this socket is the listening socket
-					this->fileDescriptors.add(_accept_connection(), POLLIN); // accept incoming connection
+				if (curr.fd == this->mWakeFd) // if other shards have posted broadcasts
+					_drain_mailbox();
+				else if (curr.fd == this->pMySockFd) { // if this socket is the listening socket
+					// accept every pending connection, since the listening socket is edge-triggered
+					_accept_pending();
+				}
 				else { // if this socket is not the listening socket
-					int recvBytes = 0;
-					char* buf = new char[500];
-					//std::string_view rd = _receive_sentence(curr.fd, buf, 500, recvBytes);
-					std::string rd = _receive_line(curr.fd, recvBytes);
-					std::string msg = std::format("{}: {}", curr.fd, rd.substr(0, rd.length() - 2));
-
-					if (recvBytes == 0) // if no bytes have been received (the client has closed)
-						_close_connection(curr.fd);
-					else // if at least one byte has been received
-						_broadcast(i, fn, msg);
-					
-					delete[] buf;
+					if (curr.events & Reactor::WRITABLE)
+						_on_writable(curr.fd);
+
+					if (curr.events & ~Reactor::WRITABLE)
+						_on_readable(curr.fd);
 				}
-				// else DO NOTHING
 
 			}
 
+			// the connections that have used up their read budget go after those that have not
+			_resume_yielded();
+			_expire_timers();
+			_close_doomed();
+			_flush_dirty();
+
+			// connections that failed while flushing; the notices about them are flushed in the next iteration, which does not wait
+			_close_doomed();
+
 		}
 
-		return listenRv;
+		return 0;
 	}
 
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include <format>
+#include "include/metrics.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Adds the metrics of a server to the snapshot. The counters are read one by one while the server keeps running, so they may be slightly apart in time.
+	 * @param[in] metrics The metrics of the server.
+	 * @returns void
+	 */
+	void MetricsSnapshot::add(const ServerMetrics& metrics)
+	{
+		this->servers++;
+		this->accepted += metrics.accepted;
+		this->rejected += metrics.rejected;
+		this->acceptFailures += metrics.acceptFailures;
+		this->peakAcceptRate += metrics.peakAcceptRate;
+		this->closed += metrics.closed;
+		this->idleClosed += metrics.idleClosed;
+		this->messagesIn += metrics.messagesIn;
+		this->messagesOut += metrics.messagesOut;
+		this->bytesIn += metrics.bytesIn;
+		this->bytesOut += metrics.bytesOut;
+		this->compressed += metrics.compressed;
+		this->compressedOut += metrics.compressedOut;
+		this->bytesSaved += metrics.bytesSaved;
+		this->queued += metrics.queued;
+		this->slowConsumers += metrics.slowConsumers;
+		this->throttled += metrics.throttled;
+		this->yielded += metrics.yielded;
+		this->mailboxWaits += metrics.mailboxWaits;
+		this->wakeups += metrics.wakeups;
+		this->pool.hits += metrics.poolHits;
+		this->pool.misses += metrics.poolMisses;
+		this->fanOut.merge(metrics.fanOut);
+	}
+
+	/**
+	 * @returns The snapshot as lines of text (separated by "\r\n", without a line ending at the end.)
+	 */
+	std::string MetricsSnapshot::toString() const
+	{
+		// the connections may be counted as closed before they are counted as accepted, if they are read in between
+		uint64_t open = this->accepted > this->closed ? this->accepted - this->closed : 0;
+
+		return std::format(
+			"threads: {}, wakeups: {}\r\n"
+			"connections: {} open, {} accepted (at most {}/s), {} rejected, {} closed ({} idle), {} failed accepts\r\n"
+			"messages: {} in, {} out\r\n"
+			"bytes: {} in, {} out, {} queued\r\n"
+			"compression: {} messages compressed, {} sent compressed, {} bytes saved\r\n"
+			"slow consumers: {}, throttled senders: {}, read budget used up: {}, full mailboxes waited on: {}\r\n"
+			"buffer pool: {:.1f}% hits ({} hits, {} misses)\r\n"
+			"fan-out latency (us): p50 {}, p90 {}, p99 {}, p99.9 {}, max {} ({} messages)",
+			this->servers, this->wakeups,
+			open, this->accepted, this->peakAcceptRate, this->rejected, this->closed, this->idleClosed, this->acceptFailures,
+			this->messagesIn, this->messagesOut,
+			this->bytesIn, this->bytesOut, this->queued,
+			this->compressed, this->compressedOut, this->bytesSaved,
+			this->slowConsumers, this->throttled, this->yielded, this->mailboxWaits,
+			100 * this->pool.hitRate(), this->pool.hits, this->pool.misses,
+			this->fanOut.percentile(0.5) / 1000, this->fanOut.percentile(0.9) / 1000, this->fanOut.percentile(0.99) / 1000,
+			this->fanOut.percentile(0.999) / 1000, this->fanOut.max() / 1000, this->fanOut.count());
+	}
+
+}
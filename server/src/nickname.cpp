@@ -0,0 +1,149 @@
+#include <algorithm>
+#include "include/nickname.h"
+
+namespace m0st4fa {
+
+	namespace {
+
+		/**
+		 * @brief Folds `name` (at most `NicknameRegistry::MAX_NAME_LENGTH` characters) to lower case into `buffer`.
+		 * @returns The folded name.
+		 */
+		std::string_view fold(const std::string_view name, char* const buffer)
+		{
+			size_t length = std::min(name.size(), NicknameRegistry::MAX_NAME_LENGTH);
+
+			for (size_t i = 0; i < length; i++)
+				buffer[i] = name[i] >= 'A' && name[i] <= 'Z' ? (char)(name[i] - 'A' + 'a') : name[i];
+
+			return std::string_view{ buffer, length };
+		}
+
+	}
+
+	/**
+	 * @brief Registers `name` for `owner`, unless another connection has it (in any case.)
+	 * @param[in] name The nickname.
+	 * @param[in] owner The connection taking it.
+	 * @returns `true` if it has been registered.
+	 */
+	bool NicknameRegistry::claim(const std::string_view name, const NicknameOwner& owner)
+	{
+		char buffer[MAX_NAME_LENGTH];
+		std::string_view key = fold(name, buffer);
+
+		std::lock_guard lock{ this->mMutex };
+
+		if (this->mNames.find(key) != this->mNames.end())
+			return false;
+
+		this->mNames.emplace(std::string{ key }, Entry{ std::string{ name }, owner });
+
+		return true;
+	}
+
+	/**
+	 * @brief Replaces the nickname `from` of `owner` with `to`, at once, unless another connection has `to` (in any case.) `to` may differ from `from` in case only.
+	 * @param[in] from The nickname `owner` has.
+	 * @param[in] to The nickname it takes.
+	 * @param[in] owner The connection.
+	 * @returns `true` if it has been renamed.
+	 */
+	bool NicknameRegistry::rename(const std::string_view from, const std::string_view to, const NicknameOwner& owner)
+	{
+		char fromBuffer[MAX_NAME_LENGTH];
+		char toBuffer[MAX_NAME_LENGTH];
+		std::string_view fromKey = fold(from, fromBuffer);
+		std::string_view toKey = fold(to, toBuffer);
+
+		std::lock_guard lock{ this->mMutex };
+
+		if (toKey != fromKey && this->mNames.find(toKey) != this->mNames.end())
+			return false;
+
+		auto it = this->mNames.find(fromKey);
+		if (it != this->mNames.end())
+			this->mNames.erase(it);
+
+		this->mNames.emplace(std::string{ toKey }, Entry{ std::string{ to }, owner });
+
+		return true;
+	}
+
+	/**
+	 * @brief Unregisters `name`, so that any connection may claim it again.
+	 */
+	void NicknameRegistry::release(const std::string_view name)
+	{
+		char buffer[MAX_NAME_LENGTH];
+		std::string_view key = fold(name, buffer);
+
+		std::lock_guard lock{ this->mMutex };
+
+		auto it = this->mNames.find(key);
+		if (it != this->mNames.end())
+			this->mNames.erase(it);
+	}
+
+	/**
+	 * @brief Looks up the connection `name` belongs to (in any case.)
+	 * @param[in] name The nickname.
+	 * @param[out] owner The connection.
+	 * @returns `true` if the nickname is registered.
+	 */
+	bool NicknameRegistry::find(const std::string_view name, NicknameOwner& owner) const
+	{
+		if (name.size() > MAX_NAME_LENGTH)
+			return false;
+
+		char buffer[MAX_NAME_LENGTH];
+		std::string_view key = fold(name, buffer);
+
+		std::lock_guard lock{ this->mMutex };
+
+		auto it = this->mNames.find(key);
+		if (it == this->mNames.end())
+			return false;
+
+		owner = it->second.owner;
+
+		return true;
+	}
+
+	/**
+	 * @brief Checks whether a connection may pick `name`: 1 to `MAX_NAME_LENGTH` letters, digits, '_' or '-', starting with a letter, and not a guest nickname (`GUEST_PREFIX` followed by digits.)
+	 */
+	bool NicknameRegistry::isValidName(const std::string_view name)
+	{
+		if (name.empty() || name.size() > MAX_NAME_LENGTH)
+			return false;
+
+		auto isLetter = [](const char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
+		auto isDigit = [](const char c) { return c >= '0' && c <= '9'; };
+
+		if (!isLetter(name.front()))
+			return false;
+
+		for (char c : name)
+			if (!isLetter(c) && !isDigit(c) && c != '_' && c != '-')
+				return false;
+
+		char buffer[MAX_NAME_LENGTH];
+		std::string_view folded = fold(name, buffer);
+
+		if (folded.starts_with(GUEST_PREFIX) && folded.size() > GUEST_PREFIX.size() && std::all_of(folded.begin() + GUEST_PREFIX.size(), folded.end(), isDigit))
+			return false;
+
+		return true;
+	}
+
+	/**
+	 * @returns The registry shared by every shard of the process.
+	 */
+	NicknameRegistry& NicknameRegistry::global()
+	{
+		static NicknameRegistry registry;
+		return registry;
+	}
+
+}
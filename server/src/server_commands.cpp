@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <utility>
+#include "include/channel.h"
+#include "include/interface.h"
+
+namespace m0st4fa {
+
+#ifndef _WIN32
+	/**
+	 * @brief Rebuilds the history of the channels from the last messages of `log` (see `LogPolicy::restoreCount`), as if they had just been broadcast by this process, at the times they were. Channels that have had no message among them start empty.
+	 * @param[in] log The log, which nothing has been appended to yet.
+	 * @returns The number of messages restored.
+	 */
+	size_t Server::restoreHistory(const MessageLog& log)
+	{
+		auto steadyNow = std::chrono::steady_clock::now();
+		auto systemNow = std::chrono::system_clock::now();
+
+		size_t restored = log.readRecent(log.policy().restoreCount, [&](const MessageLog::Record& record) {
+			if (!ChannelRegistry::isValidName(record.channel))
+				return;
+
+			ChannelInfo* info = ChannelRegistry::global().intern(record.channel);
+
+			if (info == nullptr)
+				return;
+
+			auto age = std::chrono::duration_cast<std::chrono::steady_clock::duration>(systemNow - record.at);
+
+			info->history.record(_make_frame(MessageType::MESSAGE, (int)record.sender, record.payload), steadyNow - age);
+			});
+
+		LOG_INFO("server", "Restored {} messages from the message log", restored);
+
+		return restored;
+	}
+#endif
+
+	/**
+	 * @brief Carries out a command line (one starting with '/') received from `fd`: `/join <channel>` moves the connection to `channel`, `/part` moves it back to the lobby, `/nick <nickname>` changes its nickname, `/msg <nickname> <message>` sends a message to one connection alone, and `/stats` replies with the metrics of the server (see `MetricsSnapshot`.)
+	 * @param[in] fd The socket the command has been received from.
+	 * @param[in] conn The connection of the socket.
+	 * @param[in] line The command line.
+	 * @returns void
+	 */
+	void Server::_on_command(const int fd, Connection& conn, const std::string_view line)
+	{
+		constexpr std::string_view SPACES = " \t\r";
+
+		std::string_view command = line.substr(0, line.find_first_of(SPACES));
+		std::string_view argument = line.substr(command.size());
+		argument.remove_prefix(std::min(argument.find_first_not_of(SPACES), argument.size()));
+		argument = argument.substr(0, argument.find_last_not_of(SPACES) + 1);
+
+		if (command == "/join") {
+			ChannelInfo* info = nullptr;
+
+			if (!ChannelRegistry::isValidName(argument))
+				this->_reply(fd, conn, std::format("Usage: /join <channel> (at most {} characters, without spaces.)", ChannelRegistry::MAX_NAME_LENGTH));
+			else if ((info = ChannelRegistry::global().intern(argument)) == nullptr)
+				this->_reply(fd, conn, std::format("There are {} channels already; join one of them.", ChannelRegistry::MAX_CHANNELS));
+			else
+				this->_switch_channel(fd, conn, *info);
+		}
+		else if (command == "/part") {
+			if (conn.channel == this->mLobby->id)
+				this->_reply(fd, conn, "You are in the lobby already.");
+			else
+				this->_switch_channel(fd, conn, *this->mLobby);
+		}
+		else if (command == "/nick")
+			this->_rename(fd, conn, argument);
+		else if (command == "/msg")
+			this->_direct_message(fd, conn, argument);
+		else if (command == "/stats")
+			this->_reply(fd, conn, this->metrics().toString());
+		else
+			this->_reply(fd, conn, std::format("Unknown command {}; try /join <channel>, /part, /nick <nickname>, /msg <nickname> <message> or /stats.", command));
+	}
+
+	/**
+	 * @brief Changes the nickname of the connection of `fd` to `name`, if no other connection has it, and tells its channel.
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection.
+	 * @param[in] name The new nickname (see `NicknameRegistry::isValidName`.)
+	 * @returns void
+	 */
+	void Server::_rename(const int fd, Connection& conn, const std::string_view name)
+	{
+		if (!NicknameRegistry::isValidName(name)) {
+			this->_reply(fd, conn, std::format("Usage: /nick <nickname> (at most {} letters, digits, '_' or '-', starting with a letter.)", NicknameRegistry::MAX_NAME_LENGTH));
+			return;
+		}
+
+		if (name == conn.nickname) {
+			this->_reply(fd, conn, std::format("You are {} already.", name));
+			return;
+		}
+
+		if (!NicknameRegistry::global().rename(conn.nickname, name, NicknameOwner{ this, fd, this->mConnections.handle(fd).generation })) {
+			this->_reply(fd, conn, std::format("{} is taken.", name));
+			return;
+		}
+
+		std::string old = std::exchange(conn.nickname, std::string{ name });
+
+		// the prompt comes with the notice below
+		this->_reply(fd, conn, std::format("You are now {}.", name), false);
+		this->_broadcast(conn.channel, fd, std::format("{} is now known as {}.", old, name));
+	}
+
+	/**
+	 * @brief Carries out `/msg <nickname> <message>`: sends the message to the connection with the nickname alone, on whichever shard it is. The recipient is found with a single lookup in the `NicknameRegistry`, however many connections there are; one on another shard gets it through the mailbox of its shard.
+	 * @param[in] fd The socket of the sender.
+	 * @param[in] conn The connection of the sender.
+	 * @param[in] argument What follows the command.
+	 * @returns void
+	 */
+	void Server::_direct_message(const int fd, Connection& conn, const std::string_view argument)
+	{
+		constexpr std::string_view SPACES = " \t\r";
+
+		std::string_view name = argument.substr(0, argument.find_first_of(SPACES));
+		std::string_view message = argument.substr(name.size());
+		message.remove_prefix(std::min(message.find_first_not_of(SPACES), message.size()));
+
+		if (name.empty() || message.empty()) {
+			this->_reply(fd, conn, "Usage: /msg <nickname> <message>");
+			return;
+		}
+
+		NicknameOwner owner;
+
+		if (!NicknameRegistry::global().find(name, owner)) {
+			this->_reply(fd, conn, std::format("There is no {}.", name));
+			return;
+		}
+
+		BroadcastFrame frame = _make_frame(MessageType::PRIVATE, fd, message, conn.nickname);
+		Slab<Connection>::Handle recipient{ owner.fd, owner.generation };
+
+		if (owner.shard == this)
+			this->_deliver(recipient, frame);
+		else
+			owner.shard->_post(Post{ NO_CHANNEL, std::move(frame), recipient });
+
+		this->_reply(fd, conn, std::format("To {}: {}", name, message));
+	}
+
+	/**
+	 * @brief Sends a direct message to the connection `recipient` of this shard, unless it has been closed since it has been looked up.
+	 * @param[in] recipient The connection.
+	 * @param[in] frame The framed message.
+	 * @returns void
+	 */
+	void Server::_deliver(const Slab<Connection>::Handle recipient, const BroadcastFrame& frame)
+	{
+		Connection* conn = this->mConnections.find(recipient);
+
+		if (conn == nullptr || conn->doomed || conn->closing)
+			return;
+
+		this->_send_frame(recipient.key, *conn, frame);
+	}
+
+	/**
+	 * @brief Adds the connection of `fd` to the members of `info` on this shard. The connection must not be in a channel.
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection.
+	 * @param[in] info The channel to join.
+	 * @returns void
+	 */
+	void Server::_join(const int fd, Connection& conn, ChannelInfo& info)
+	{
+		if (this->mChannels.size() <= info.id)
+			this->mChannels.resize(info.id + 1);
+
+		Channel& channel = this->mChannels[info.id];
+		channel.info = &info;
+
+		conn.channel = info.id;
+		conn.memberIndex = (uint32_t)channel.members.size();
+		channel.members.push_back(fd);
+
+		// the other shards post the broadcasts of this channel to this one from now on
+		if (channel.members.size() == 1)
+			info.shards.fetch_or(1ull << this->mShardIndex, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Removes a connection from the members of its channel, if it is in one.
+	 * @param[in] conn The connection.
+	 * @returns void
+	 */
+	void Server::_leave(Connection& conn)
+	{
+		if (conn.channel == NO_CHANNEL)
+			return;
+
+		Channel& channel = this->mChannels[conn.channel];
+
+		// move the last member into the hole, to keep the members packed
+		int last = channel.members.back();
+		channel.members[conn.memberIndex] = last;
+		this->mConnections.find(last)->memberIndex = conn.memberIndex;
+		channel.members.pop_back();
+
+		if (channel.members.empty())
+			channel.info->shards.fetch_and(~(1ull << this->mShardIndex), std::memory_order_relaxed);
+
+		conn.channel = NO_CHANNEL;
+	}
+
+	/**
+	 * @brief Moves the connection of `fd` from its channel to `info`, telling the members of both.
+	 * @param[in] fd The socket of the connection.
+	 * @param[in] conn The connection.
+	 * @param[in] info The channel to move to.
+	 * @returns void
+	 */
+	void Server::_switch_channel(const int fd, Connection& conn, ChannelInfo& info)
+	{
+		if (conn.channel == info.id) {
+			this->_reply(fd, conn, std::format("You are in {} already.", info.name));
+			return;
+		}
+
+		ChannelInfo& old = *this->mChannels[conn.channel].info;
+
+		this->_leave(conn);
+		this->_broadcast(old.id, fd, std::format("{} has left {}.", conn.nickname, old.name));
+
+		// the prompt comes with the notice below
+		this->_reply(fd, conn, std::format("You are now in {}.", info.name), false);
+		this->_join(fd, conn, info);
+		this->_broadcast(info.id, fd, std::format("{} has joined {}.", conn.nickname, info.name));
+
+		// each replayed message erases the prompt before it, as broadcasts do
+		this->_replay(fd, conn, info);
+	}
+
+}
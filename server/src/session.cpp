@@ -0,0 +1,227 @@
+#include "include/session.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Receives the next line.
+	 * @param[out] line The line, without its "\r\n" (or "\n"); it stays valid until the next call to `readLine`.
+	 * @returns `DONE` if a line has been received; `CLOSED` if the peer has closed the connection (the lines received before are still handed out first); `FAILED` if the connection has failed; `CANCELLED` if the session has been closed meanwhile.
+	 */
+	Task<IoStatus> Session::readLine(std::string_view& line)
+	{
+		while (!this->mInput || !this->mInput->nextLine(line)) {
+			if (this->mStatus != IoStatus::DONE)
+				co_return this->mStatus;
+
+			// the replies to the previous lines go out before the session waits for the next one
+			if (this->mOutput)
+				this->_flush();
+
+			if (!this->mInput)
+				this->mInput.emplace();
+
+			int rd = this->mInput->receive(this->mFd);
+
+			if (rd > 0)
+				continue;
+
+			if (rd == 0) {
+				this->mStatus = IoStatus::CLOSED;
+				continue;
+			}
+
+			int e = lastSocketError();
+
+			if (!wouldBlock(e)) {
+				this->_fail(e);
+				continue;
+			}
+
+			// an idle session does not hold on to a buffer
+			if (this->mInput->size() == 0)
+				this->mInput.reset();
+
+			bool ready = co_await this->mLoop.readable(this->mFd);
+
+			if (!ready)
+				co_return IoStatus::CANCELLED;
+		}
+
+		co_return IoStatus::DONE;
+	}
+
+	/**
+	 * @brief Sends `data`: as much of it as the socket takes right away, before returning; the rest is queued, and sent while the returned task is awaited (or before the next line is read.)
+	 * @param[in] data The bytes to be sent; what is queued is copied.
+	 * @returns A task that finishes once every queued byte has been handed to the kernel: `DONE`; `FAILED` if the connection has failed; `CANCELLED` if the session has been closed meanwhile.
+	 */
+	Task<IoStatus> Session::write(std::string_view data)
+	{
+		if (this->mStatus != IoStatus::FAILED && this->mFd != -1) {
+			// nothing is queued ahead of it, so it may go out directly
+			if (!this->mOutput) {
+				int rv = (int)::send(this->mFd, data.data(), (int)data.size(), SEND_NOSIGNAL);
+
+				if (rv == -1 && !wouldBlock(lastSocketError()))
+					this->_fail(lastSocketError());
+				else if (rv > 0)
+					data.remove_prefix((size_t)rv);
+			}
+
+			if (!data.empty() && this->mStatus != IoStatus::FAILED) {
+				if (!this->mOutput)
+					this->mOutput.emplace();
+
+				this->mOutput->append(data);
+			}
+		}
+
+		return this->_written();
+	}
+
+	/**
+	 * @brief Waits until the queued output has been handed to the kernel.
+	 * @returns See `write`.
+	 */
+	Task<IoStatus> Session::_written()
+	{
+		while (this->mOutput) {
+			bool ready = co_await this->mLoop.writable(this->mFd);
+
+			if (!ready)
+				co_return IoStatus::CANCELLED;
+
+			this->_flush();
+		}
+
+		// the peer may have stopped sending and still be receiving, so only a failure fails writes
+		co_return this->mStatus == IoStatus::FAILED || this->mFd == -1 ? IoStatus::FAILED : IoStatus::DONE;
+	}
+
+	/**
+	 * @brief Sends as much of the queued output as the socket takes without blocking.
+	 * @returns void
+	 */
+	void Session::_flush()
+	{
+		if (this->mOutput->flush(this->mFd) == -1) {
+			this->_fail(lastSocketError());
+			return;
+		}
+
+		if (this->mOutput->empty())
+			this->mOutput.reset();
+	}
+
+	/**
+	 * @brief Marks the connection as failed with `error`: every operation on it reports it from now on, and the queued output is discarded.
+	 * @returns void
+	 */
+	void Session::_fail(const int error)
+	{
+		LOG_WARNING("sessions", "Connection {} has failed: {}", this->mFd, ConnectionInformation::formatFckingMSErrorMessages(error));
+
+		this->mStatus = IoStatus::FAILED;
+		this->mOutput.reset();
+	}
+
+	/**
+	 * @brief Closes the connection. The operations in progress finish with `CANCELLED`, and the output still queued is discarded.
+	 * @returns void
+	 */
+	void Session::close()
+	{
+		if (this->mFd == -1)
+			return;
+
+		LOG_INFO("sessions", "Removed connection {}", toString(&this->mAddress));
+
+		this->mLoop.forget(this->mFd);
+		::closesocket(this->mFd);
+
+		this->mFd = -1;
+		this->mStatus = IoStatus::CLOSED;
+		this->mInput.reset();
+		this->mOutput.reset();
+	}
+
+	/**
+	 * @brief Runs the session of the accepted connection `fd` until its handler returns, then closes it. The session lives in the coroutine frame, so it takes no allocation of its own.
+	 */
+	Task<void> SessionServer::_run(const int fd, const sockaddr_storage address)
+	{
+		Session session{ this->mLoop, fd, address };
+
+		this->mSessions++;
+		co_await this->mHandler(session);
+		this->mSessions--;
+
+		session.close();
+	}
+
+	/**
+	 * @brief Accepts the incoming connections as they arrive and starts a session for each of them.
+	 */
+	Task<void> SessionServer::_accept_all()
+	{
+		while (true) {
+			sockaddr_storage addr{};
+			int newSocket = acceptNonBlocking(this->pMySockFd, &addr);
+
+			if (newSocket == -1) {
+				int e = lastSocketError();
+
+				if (isTransientAcceptError(e))
+					continue;
+
+				if (!wouldBlock(e)) {
+					LOG_CRITICAL("sessions", "Error while accepting connection: {}", strerror(e));
+					std::exit(-1);
+				}
+
+				// the queue of pending connections has been drained
+				bool ready = co_await this->mLoop.readable(this->pMySockFd);
+
+				if (!ready)
+					co_return;
+
+				continue;
+			}
+
+			LOG_INFO("sessions", "Accepted connection from {}", toString(&addr));
+
+			this->mLoop.spawn(_run(newSocket, addr));
+		}
+	}
+
+	/**
+	 * @brief Listens on the bound address and runs `handler` as the coroutine of every accepted connection. It only returns if polling fails.
+	 * @param[in] handler Called with the session of every accepted connection; the connection is closed when the coroutine it returns finishes.
+	 * @returns The value returned by `listen`.
+	 */
+	int SessionServer::start(Handler handler)
+	{
+		this->mHandler = std::move(handler);
+
+		int listenRv = ::listen(pMySockFd, ConnectionInformation::BACK_LOG);
+
+		if (listenRv == -1) {
+			LOG_CRITICAL("sessions", "Could not listen on socket {}: {}.", pMySockFd, strerror(errno));
+			std::exit(-1);
+		}
+
+		// the listening socket is drained on every wakeup, so it must never block
+		if (setNonBlocking(pMySockFd) == -1) {
+			LOG_CRITICAL("sessions", "Could not make socket {} non-blocking: {}.", pMySockFd, strerror(errno));
+			std::exit(-1);
+		}
+
+		LOG_INFO("sessions", "Listening on port {}", this->getBoundPort());
+
+		this->mLoop.spawn(_accept_all());
+		this->mLoop.run();
+
+		return listenRv;
+	}
+
+}
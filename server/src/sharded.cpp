@@ -0,0 +1,129 @@
+#include "include/interface.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+namespace m0st4fa {
+
+	thread_local Server* Server::tCurrent = nullptr;
+
+	Server::~Server()
+	{
+		if (this->mWakeFd != -1)
+			::closesocket(this->mWakeFd);
+
+#ifndef _WIN32
+		if (this->mSpareFd != -1)
+			::close(this->mSpareFd);
+#endif
+	}
+
+	/**
+	 * @brief Makes this server a shard of a group: its broadcasts are posted to `peers` too, and it accepts broadcasts posted by them. Must be called before any shard starts.
+	 * @param[in] peers Every shard of the group (this one is skipped.)
+	 * @returns void
+	 */
+	void Server::setPeers(const std::vector<Server*>& peers)
+	{
+		this->mPeers.clear();
+
+		for (size_t i = 0; i < peers.size(); i++) {
+			if (peers[i] != this)
+				this->mPeers.push_back(peers[i]);
+			else
+				this->mShardIndex = i;
+		}
+
+#ifdef __linux__
+		if (!this->mPeers.empty() && this->mWakeFd == -1)
+			this->mWakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+	}
+
+	/**
+	 * @brief Queues a broadcast to the members of a channel on this shard. It is called by the other shards, from their own threads. While the mailbox of this shard is full, the calling shard waits for room, taking the posts waiting in its own mailbox in the meantime, so that two shards posting to each other cannot wait on each other.
+	 * @param[in] post The channel and the framed message, which is shared by every shard it was posted to.
+	 * @returns void
+	 */
+	void Server::_post(Post post)
+	{
+		if (!this->mMailbox.push(post)) {
+			Server* poster = Server::current();
+
+			if (poster != nullptr)
+				poster->mMetrics.mailboxWaits += 1;
+
+			// this shard has been woken up already (it has not drained the mailbox since), so it only needs time
+			do {
+				if (poster != nullptr)
+					poster->_drain_mailbox();
+
+				std::this_thread::yield();
+			} while (!this->mMailbox.push(post));
+		}
+
+		// only the first post after the last drain needs to wake the shard up
+		if (!this->mWakePending.exchange(true)) {
+			uint64_t one = 1;
+			[[maybe_unused]] ssize_t rv = ::write(this->mWakeFd, &one, sizeof(one));
+		}
+	}
+
+	/**
+	 * @brief Broadcasts everything the other shards have posted to the connections of this shard, and delivers the direct messages they have posted to them.
+	 * @returns void
+	 */
+	void Server::_drain_mailbox()
+	{
+		uint64_t count = 0;
+		[[maybe_unused]] ssize_t rv = ::read(this->mWakeFd, &count, sizeof(count));
+
+		// cleared before draining, so that a post racing with the drain signals again
+		this->mWakePending.store(false);
+
+		Post post;
+		while (this->mMailbox.pop(post)) {
+			if (post.recipient.key != -1)
+				this->_deliver(post.recipient, post.frame);
+			else
+				this->_broadcast_local(post.channel, -1, post.frame);
+		}
+	}
+
+	/**
+	 * @brief Creates `shardCount` servers listening on `myPort`.
+	 * @param[in] myPort The port to listen on.
+	 * @param[in] shardCount The number of shards (and threads), up to `MAX_SHARDS`; sharding is only supported on Linux, so it is always 1 elsewhere.
+	 * @param[in] engine The I/O engine driving each shard.
+	 */
+	ShardedServer::ShardedServer(const int myPort, const size_t shardCount, const Server::Engine engine)
+	{
+		size_t count = std::clamp<size_t>(shardCount, 1, MAX_SHARDS);
+
+#ifndef __linux__
+		count = 1;
+#endif
+
+		for (size_t i = 0; i < count; i++)
+			this->mShards.push_back(std::make_unique<Server>(myPort, engine, count > 1));
+
+		std::vector<Server*> shards;
+		for (auto& shard : this->mShards)
+			shards.push_back(shard.get());
+
+		for (Server* shard : shards)
+			shard->setPeers(shards);
+	}
+
+	/**
+	 * @brief Starts every shard: the first one runs on the calling thread, the others on threads of their own.
+	 * @param[in] fn Function expected to take a socket descriptor and received data and returns nothing (void.) It is called on the thread of the shard that owns the socket. It may be empty (see `Server::start`.)
+	 * @returns The value returned by `Server::start` for the first shard.
+	 */
+	int ShardedServer::start(std::function<void(const int, std::string_view)> fn)
+	{
+		return this->start<std::function<void(const int, std::string_view)>>(std::move(fn));
+	}
+
+}
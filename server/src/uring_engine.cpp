@@ -0,0 +1,363 @@
+#include "include/interface.h"
+
+#ifdef __linux__
+
+namespace m0st4fa {
+
+	namespace {
+
+		// what a completion belongs to (stored in the upper half of `user_data`)
+		enum UringOp : uint64_t {
+			OP_ACCEPT = 1,
+			OP_RECV = 2,
+			OP_SEND = 3,
+			OP_WAKE = 4,
+			OP_TIMER = 5,
+			OP_TICK = 6,
+			OP_CANCEL = 7,
+		};
+
+		uint64_t encode(const UringOp op, const int fd) {
+			return (op << 32) | (uint32_t)fd;
+		}
+
+		UringOp opOf(const uint64_t userData) {
+			return (UringOp)(userData >> 32);
+		}
+
+		int fdOf(const uint64_t userData) {
+			return (int)(uint32_t)userData;
+		}
+
+	}
+
+	/**
+	 * @brief Gets a submission entry, flushing the submission queue to the kernel first if it is full.
+	 * @returns A zeroed submission entry.
+	 */
+	io_uring_sqe* Server::_uring_sqe()
+	{
+		io_uring_sqe* sqe = this->mRing->getSqe();
+
+		while (sqe == nullptr) {
+			this->mRing->submit();
+			sqe = this->mRing->getSqe();
+		}
+
+		return sqe;
+	}
+
+	/**
+	 * @brief (Re-)arms the multishot receive of connection `fd`.
+	 */
+	void Server::_uring_arm_recv(const int fd)
+	{
+		this->mRing->prepareMultishotRecv(_uring_sqe(), fd, encode(OP_RECV, fd));
+		this->mConnections.find(fd)->recvArmed = true;
+	}
+
+	/**
+	 * @brief Handles a completion of the multishot accept: admits the new connection (see `_admit_connection`) and starts receiving from it. The accept does not ask for the address of the peer, which is only looked up if it is logged (see `_peer_address`.)
+	 */
+	void Server::_uring_on_accept(const io_uring_cqe& cqe)
+	{
+		// the kernel stops a multishot request when it fails; start it over
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			this->mRing->prepareMultishotAccept(_uring_sqe(), this->pMySockFd, encode(OP_ACCEPT, this->pMySockFd));
+
+		if (cqe.res < 0) {
+			_on_accept_error(-cqe.res);
+			return;
+		}
+
+		if (_admit_connection(cqe.res, nullptr) != nullptr)
+			_uring_arm_recv(cqe.res);
+	}
+
+	/**
+	 * @brief Handles a completion of a multishot receive: feeds the received bytes to the line buffer of the connection and broadcasts every complete line.
+	 */
+	void Server::_uring_on_recv(const io_uring_cqe& cqe)
+	{
+		int fd = fdOf(cqe.user_data);
+		Connection& conn = *this->mConnections.find(fd);
+		bool more = cqe.flags & IORING_CQE_F_MORE;
+
+		if (!more)
+			conn.recvArmed = false;
+
+		// the receive has been cancelled, since the connection has been stopped; it is armed again when it resumes, unless that has happened already
+		if (cqe.res == -ECANCELED) {
+			if (conn.closing)
+				_uring_close(fd);
+			else if (!_stopped(conn))
+				_uring_arm_recv(fd);
+
+			return;
+		}
+
+		// the connection has been closed by the peer (or has failed)
+		if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS)) {
+			_uring_close(fd);
+			return;
+		}
+
+		// we ran out of provided buffers (-ENOBUFS) or the kernel ended the request; receive again
+		if (!more && !conn.closing && !_stopped(conn))
+			_uring_arm_recv(fd);
+
+		if (cqe.res > 0) {
+			unsigned short bid = (unsigned short)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			std::string_view data{ this->mRing->bufferAt(bid), (size_t)cqe.res };
+
+			this->mMetrics.bytesIn += (uint64_t)cqe.res;
+			this->mReceivedAt = _now();
+			conn.lastInput = this->mReceivedAt;
+
+			// bytes that arrive after the connection has been stopped (before the receive is cancelled) wait with the rest
+			if (_stopped(conn))
+				conn.overflow.append(data);
+			else
+				_uring_feed(fd, conn, data);
+
+			this->mRing->recycleBuffer(bid);
+		}
+	}
+
+	/**
+	 * @brief Copies `data` into the line buffer of connection `fd` (in pieces if it does not fit) and handles its messages, until the connection is stopped (see `_admit_input`.) Then the receive is cancelled, so that the rest of the input waits in the socket, and what is left of `data` is kept in `Connection::overflow`.
+	 */
+	void Server::_uring_feed(const int fd, Connection& conn, std::string_view data)
+	{
+		while (!data.empty() && !conn.doomed && !_stopped(conn)) {
+			data.remove_prefix(conn.input.append(data));
+			_on_input(fd, conn.input);
+		}
+
+		if (!_stopped(conn) || conn.doomed)
+			return;
+
+		conn.overflow.append(data);
+
+		if (conn.recvArmed)
+			this->mRing->prepareCancel(_uring_sqe(), encode(OP_RECV, fd), encode(OP_CANCEL, fd));
+	}
+
+	/**
+	 * @brief Goes on reading connection `fd`, which has been stopped: the messages left in its line buffer, then the bytes kept in `Connection::overflow`, then the receive is armed again.
+	 */
+	void Server::_uring_resume(const int fd, Connection& conn)
+	{
+		if (conn.doomed || conn.closing || _stopped(conn))
+			return;
+
+		this->mReceivedAt = _now();
+		_on_input(fd, conn.input);
+
+		PooledString overflow;
+		overflow.swap(conn.overflow);
+
+		// stopping again keeps what is left in `overflow` (and cancels the receive, if it has been armed since)
+		if (!conn.doomed && !_stopped(conn))
+			_uring_feed(fd, conn, overflow);
+		else
+			conn.overflow.swap(overflow);
+
+		if (!conn.doomed && !_stopped(conn) && !conn.recvArmed)
+			_uring_arm_recv(fd);
+	}
+
+	/**
+	 * @brief Handles a completion of a send: releases the sent bytes, and has the rest (after a short write) and whatever was queued meanwhile sent at the end of the loop iteration.
+	 */
+	void Server::_uring_on_send(const io_uring_cqe& cqe)
+	{
+		int fd = fdOf(cqe.user_data);
+		Connection& conn = *this->mConnections.find(fd);
+
+		conn.inFlight = 0;
+
+		if (cqe.res < 0) {
+			_uring_close(fd);
+			return;
+		}
+
+		conn.output.consume((size_t)cqe.res);
+		this->mMetrics.bytesOut += (uint64_t)cqe.res;
+		this->mMetrics.queued -= (uint64_t)cqe.res;
+
+		if (conn.closing) {
+			_uring_close(fd);
+			return;
+		}
+
+		if (!conn.output.empty())
+			_stage(fd, conn);
+	}
+
+	/**
+	 * @brief Closes connection `fd`. The socket is shut down at once, but only closed after the kernel no longer uses it (no armed receive, no send in flight), so that its number cannot be reused while completions for it are still pending.
+	 */
+	void Server::_uring_close(const int fd)
+	{
+		Connection& conn = *this->mConnections.find(fd);
+
+		if (!conn.closing) {
+			conn.closing = true;
+			::shutdown(fd, SHUT_RDWR);
+			this->mTimers.cancel(conn.idleTimer);
+
+			if (conn.deflate)
+				sDeflateConnections.fetch_sub(1, std::memory_order_relaxed);
+
+			uint32_t channel = conn.channel;
+			_leave(conn);
+
+			NicknameRegistry::global().release(conn.nickname);
+			this->_forget_connection(fd, conn.address, channel, conn.nickname);
+		}
+
+		if (!conn.recvArmed && conn.inFlight == 0) {
+			::close(fd);
+			this->mMetrics.queued -= conn.output.size();
+			this->mMetrics.closed += 1;
+			this->mConnections.erase(fd);
+		}
+	}
+
+	/**
+	 * @brief Hands the bytes queued by `write` during this loop iteration to the kernel, one gathered send per connection (of up to `OutputQueue::MAX_IOV` slices.) They are all submitted together by the next `submit`.
+	 */
+	void Server::_uring_flush()
+	{
+		int timeout = _flush_timeout();
+
+		// the staged output may wait for more; the timer ends the wait for completions when it is due
+		if (timeout > 0) {
+			if (!this->mFlushTimerArmed) {
+				this->mFlushTimer.tv_sec = timeout / 1000;
+				this->mFlushTimer.tv_nsec = (long long)(timeout % 1000) * 1000000;
+				this->mRing->prepareTimeout(_uring_sqe(), &this->mFlushTimer, encode(OP_TIMER, -1));
+				this->mFlushTimerArmed = true;
+			}
+
+			return;
+		}
+
+		for (int fd : this->mDirty) {
+			Connection* found = this->mConnections.find(fd);
+
+			if (found == nullptr)
+				continue;
+
+			Connection& conn = *found;
+			conn.dirty = false;
+			conn.staged = 0;
+
+			// a send is still in flight; its completion stages the rest
+			if (conn.closing || conn.inFlight != 0 || conn.output.empty())
+				continue;
+
+			conn.iov.resize(std::min(conn.output.sliceCount(), OutputQueue::MAX_IOV));
+			size_t count = conn.output.gather(conn.iov.data(), conn.iov.size());
+
+			for (size_t i = 0; i < count; i++)
+				conn.inFlight += conn.iov[i].iov_len;
+
+			conn.header = msghdr{};
+			conn.header.msg_iov = conn.iov.data();
+			conn.header.msg_iovlen = count;
+
+			// the rest of the queue is sent when this send completes
+			this->mRing->prepareSendmsg(_uring_sqe(), fd, &conn.header, encode(OP_SEND, fd), count < conn.output.sliceCount() ? SEND_MORE : 0);
+		}
+
+		this->mDirty.clear();
+		_record_fan_outs();
+	}
+
+	/**
+	 * @brief Runs the completion-based main loop on io_uring: one multishot accept, one multishot receive per connection (into kernel-provided buffers), and all sends of a loop iteration submitted with a single system call. It only returns if the ring fails.
+	 * @returns `-1` on failure.
+	 */
+	int Server::_run_uring()
+	{
+		this->mRing = std::make_unique<IoUring>(URING_ENTRIES);
+
+		if (this->mRing->setupBufferRing(0, URING_BUFFERS, URING_BUFFER_SIZE) != 0) {
+			LOG_CRITICAL("server", "Could not register the receive buffers: {}", strerror(errno));
+			this->mRing.reset();
+			return -1;
+		}
+
+		LOG_INFO("server", "Using the io_uring event loop backend");
+
+		this->mRing->prepareMultishotAccept(_uring_sqe(), this->pMySockFd, encode(OP_ACCEPT, this->pMySockFd));
+
+		// broadcasts posted by the other shards
+		if (this->mWakeFd != -1)
+			this->mRing->prepareMultishotPoll(_uring_sqe(), this->mWakeFd, POLLIN, encode(OP_WAKE, this->mWakeFd));
+
+		while (true) {
+
+			// submit everything queued during the previous iteration and wait for at least one completion (unless connections have yielded, which go on at once)
+			if (this->mRing->submit(this->mYielded.empty() ? 1 : 0) == -1) {
+				LOG_CRITICAL("server", "Error while waiting for completions: {}", strerror(errno));
+				this->mRing.reset();
+				return -1;
+			}
+
+			this->mMetrics.wakeups += 1;
+			this->mMetrics.samplePool();
+			this->mIteration++;
+
+			this->mRing->forEachCompletion([this](const io_uring_cqe& cqe) {
+				switch (opOf(cqe.user_data)) {
+				case OP_ACCEPT:
+					_uring_on_accept(cqe);
+					break;
+				case OP_RECV:
+					_uring_on_recv(cqe);
+					break;
+				case OP_SEND:
+					_uring_on_send(cqe);
+					break;
+				case OP_WAKE:
+					if (!(cqe.flags & IORING_CQE_F_MORE))
+						this->mRing->prepareMultishotPoll(_uring_sqe(), this->mWakeFd, POLLIN, encode(OP_WAKE, this->mWakeFd));
+
+					_drain_mailbox();
+					break;
+				case OP_TIMER:
+					this->mFlushTimerArmed = false;
+					break;
+				case OP_TICK:
+					this->mTickTimerArmed = false;
+					break;
+				case OP_CANCEL:
+					break;
+				}
+				});
+
+			_resume_yielded();
+			_expire_timers();
+			_close_doomed();
+			_uring_flush();
+
+			// wake up at the next tick of the timers, if nothing else happens before
+			int tick = this->mTimers.timeout(std::chrono::steady_clock::now());
+
+			if (tick != -1 && !this->mTickTimerArmed) {
+				this->mTickTimer.tv_sec = tick / 1000;
+				this->mTickTimer.tv_nsec = (long long)(tick % 1000) * 1000000;
+				this->mRing->prepareTimeout(_uring_sqe(), &this->mTickTimer, encode(OP_TICK, -1));
+				this->mTickTimerArmed = true;
+			}
+		}
+
+		return 0;
+	}
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Records indexed by small non-negative integer keys (descriptors.) Lookup, insertion and removal are O(1); the keys in use are kept packed, so iterating over them does not visit free slots. Records live in fixed-size pages and never move, so pointers to them (e.g., held by the kernel) stay valid until they are erased.
+	 * @tparam T The type of the records. It must be default-constructible.
+	 */
+	template <typename T>
+	class Slab {
+
+	public:
+
+		/**
+		 * @brief A key together with the generation of its slot. It tells a record apart from a later one that reuses the same key.
+		 */
+		struct Handle {
+			int key = -1;
+			uint32_t generation = 0;
+		};
+
+	private:
+
+		static constexpr size_t PAGE_SIZE = 256; // records per page
+		static constexpr uint32_t FREE = UINT32_MAX;
+
+		struct Slot {
+			std::optional<T> value; // only constructed while the slot is in use
+			uint32_t generation = 0; // bumped whenever the slot is taken
+			uint32_t position = FREE; // index of the key in `mKeys`; `FREE` if the slot is not in use
+		};
+
+		std::vector<std::unique_ptr<Slot[]>> mPages;
+		std::vector<int> mKeys; // the keys in use, packed
+
+		Slot* _slot(const int key) const {
+			size_t page = (size_t)key / PAGE_SIZE;
+
+			if (key < 0 || page >= this->mPages.size())
+				return nullptr;
+
+			return &this->mPages[page][(size_t)key % PAGE_SIZE];
+		}
+
+	public:
+
+		/**
+		 * @brief Gets the record of `key`.
+		 * @returns The record; `nullptr` if `key` is not in use.
+		 */
+		T* find(const int key) const {
+			Slot* slot = this->_slot(key);
+			return slot != nullptr && slot->position != FREE ? &*slot->value : nullptr;
+		}
+
+		/**
+		 * @brief Gets the record `handle` refers to.
+		 * @returns The record; `nullptr` if it has been erased (even if its key has been reused since.)
+		 */
+		T* find(const Handle handle) const {
+			Slot* slot = this->_slot(handle.key);
+			return slot != nullptr && slot->position != FREE && slot->generation == handle.generation ? &*slot->value : nullptr;
+		}
+
+		/**
+		 * @returns The handle of the record of `key`, which must be in use.
+		 */
+		Handle handle(const int key) const {
+			return Handle{ key, this->_slot(key)->generation };
+		}
+
+		/**
+		 * @brief Takes the slot of `key` (a fresh, default-constructed record), unless it is in use already.
+		 * @returns The record of `key`.
+		 */
+		T& insert(const int key) {
+			size_t page = (size_t)key / PAGE_SIZE;
+
+			while (this->mPages.size() <= page)
+				this->mPages.push_back(std::make_unique<Slot[]>(PAGE_SIZE));
+
+			Slot& slot = this->mPages[page][(size_t)key % PAGE_SIZE];
+
+			if (slot.position == FREE) {
+				slot.generation++;
+				slot.position = (uint32_t)this->mKeys.size();
+				this->mKeys.push_back(key);
+				slot.value.emplace();
+			}
+
+			return *slot.value;
+		}
+
+		/**
+		 * @brief Frees the slot of `key`, destroying its record (its memory is released right away.)
+		 * @returns `true` if `key` was in use.
+		 */
+		bool erase(const int key) {
+			Slot* slot = this->_slot(key);
+
+			if (slot == nullptr || slot->position == FREE)
+				return false;
+
+			// move the last key into the hole, to keep the keys packed
+			int last = this->mKeys.back();
+			this->mKeys[slot->position] = last;
+			this->_slot(last)->position = slot->position;
+			this->mKeys.pop_back();
+
+			slot->position = FREE;
+			slot->value.reset();
+
+			return true;
+		}
+
+		/**
+		 * @brief Gets the keys in use, in no particular order. Inserting or erasing invalidates it.
+		 */
+		const std::vector<int>& keys() const {
+			return this->mKeys;
+		}
+
+		size_t size() const {
+			return this->mKeys.size();
+		}
+
+	};
+
+}
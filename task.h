@@ -0,0 +1,168 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "pool.h"
+
+namespace m0st4fa {
+
+	template <typename T>
+	class Task;
+
+	/**
+	 * @brief What the promises of every `Task` share: the coroutine awaiting it, which is resumed (by symmetric transfer, so that long chains of tasks do not grow the stack) when the task finishes.
+	 */
+	class TaskPromiseBase {
+
+		struct FinalAwaiter {
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept {
+				std::coroutine_handle<> continuation = handle.promise().mContinuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept {
+			}
+		};
+
+		std::coroutine_handle<> mContinuation;
+
+		template <typename T>
+		friend class Task;
+
+	public:
+
+		// tasks are lazy: they start when they are awaited
+		std::suspend_always initial_suspend() const noexcept {
+			return {};
+		}
+
+		FinalAwaiter final_suspend() const noexcept {
+			return {};
+		}
+
+		// errors are reported through the results, as everywhere else in the code base
+		void unhandled_exception() const noexcept {
+			std::terminate();
+		}
+
+		// coroutine frames are small and short-lived (one or more per connection), so they come from the buffer pool
+		static void* operator new(const size_t size) {
+			return BufferPool::local().allocate(size);
+		}
+
+		static void operator delete(void* frame, const size_t size) {
+			BufferPool::local().deallocate(frame, size);
+		}
+
+	};
+
+	template <typename T>
+	class TaskPromise : public TaskPromiseBase {
+
+		std::optional<T> mValue;
+
+		template <typename>
+		friend class Task;
+
+	public:
+
+		Task<T> get_return_object() noexcept;
+
+		void return_value(T value) {
+			this->mValue.emplace(std::move(value));
+		}
+
+	};
+
+	template <>
+	class TaskPromise<void> : public TaskPromiseBase {
+
+	public:
+
+		Task<void> get_return_object() noexcept;
+
+		void return_void() const noexcept {
+		}
+
+	};
+
+	/**
+	 * @brief A coroutine that produces a `T` (lazily: it starts when it is awaited, and the awaiting coroutine resumes when it finishes.) It owns its coroutine frame. Top-level tasks are run by `EventLoop::spawn`.
+	 *
+	 * GCC 12 miscompiles a `co_await` in the condition of an `if`, `while` or `switch` (the coroutine is never resumed); await into a variable and test that instead.
+	 */
+	template <typename T = void>
+	class [[nodiscard]] Task {
+
+	public:
+
+		using promise_type = TaskPromise<T>;
+
+	private:
+
+		std::coroutine_handle<promise_type> mHandle;
+
+	public:
+
+		explicit Task(std::coroutine_handle<promise_type> handle) noexcept : mHandle{ handle } {
+		}
+
+		Task(Task&& other) noexcept : mHandle{ std::exchange(other.mHandle, {}) } {
+		}
+
+		Task& operator=(Task&& other) noexcept {
+			if (this != &other) {
+				if (this->mHandle)
+					this->mHandle.destroy();
+
+				this->mHandle = std::exchange(other.mHandle, {});
+			}
+
+			return *this;
+		}
+
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+
+		~Task() {
+			if (this->mHandle)
+				this->mHandle.destroy();
+		}
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		/**
+		 * @brief Starts the task; `awaiting` resumes when it finishes.
+		 */
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+			this->mHandle.promise().mContinuation = awaiting;
+			return this->mHandle;
+		}
+
+		T await_resume() {
+			if constexpr (!std::is_void_v<T>)
+				return std::move(*this->mHandle.promise().mValue);
+		}
+
+	};
+
+	template <typename T>
+	Task<T> TaskPromise<T>::get_return_object() noexcept {
+		return Task<T>{ std::coroutine_handle<TaskPromise<T>>::from_promise(*this) };
+	}
+
+	inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+		return Task<void>{ std::coroutine_handle<TaskPromise<void>>::from_promise(*this) };
+	}
+
+}
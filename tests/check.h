@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string_view>
+
+// A minimal test harness: `CHECK` records a failure (with where it happened) and carries on, so one run reports every
+// broken expectation; `RUN` runs a test function and names it. `main` returns `m0st4fa::test::exitCode()`.
+
+namespace m0st4fa::test {
+
+	inline int& failures() {
+		static int count = 0;
+		return count;
+	}
+
+	inline void fail(const std::string_view expression, const char* file, const int line) {
+		std::cerr << std::format("{}:{}: CHECK({}) failed\n", file, line, expression);
+		failures()++;
+	}
+
+	inline int exitCode() {
+		if (failures() != 0)
+			std::cerr << std::format("{} check(s) failed\n", failures());
+
+		return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+			m0st4fa::test::fail(#condition, __FILE__, __LINE__); \
+	} while (false)
+
+#define RUN(test) \
+	do { \
+		std::cerr << "[ run ] " #test "\n"; \
+		test(); \
+	} while (false)
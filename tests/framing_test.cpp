@@ -0,0 +1,167 @@
+#include <string>
+#include <string_view>
+#include "check.h"
+#include "framing.h"
+
+// Checks the input buffer of a connection: lines and frames split across receives come out whole, a line too long
+// for the buffer comes out in pieces rather than stalling the connection, a partial line survives the buffer being
+// compacted, and frames that cannot fit are reported as such.
+
+namespace {
+
+	std::string frameOf(const std::string_view payload, const m0st4fa::MessageType type = m0st4fa::MessageType::MESSAGE)
+	{
+		std::string frame(m0st4fa::FrameHeader::SIZE, '\0');
+		m0st4fa::FrameHeader{ (uint32_t)payload.size(), type, 3 }.encode(frame.data());
+
+		return frame.append(payload);
+	}
+
+	void testLines()
+	{
+		m0st4fa::LineBuffer buffer;
+		std::string_view line;
+
+		CHECK(buffer.append("one\r\ntwo\nthr") == 12);
+
+		CHECK(buffer.hasLine());
+		CHECK(buffer.hasLine()); // checking does not take the line
+		CHECK(buffer.nextLine(line) && line == "one");
+		CHECK(buffer.nextLine(line) && line == "two");
+		CHECK(!buffer.hasLine());
+		CHECK(!buffer.nextLine(line));
+		CHECK(buffer.pending() == "thr");
+
+		buffer.append("ee\r\n\r\n");
+		CHECK(buffer.nextLine(line) && line == "three");
+		CHECK(buffer.nextLine(line) && line.empty());
+		CHECK(buffer.size() == 0);
+	}
+
+	void testLineByteByByte()
+	{
+		m0st4fa::LineBuffer buffer;
+		std::string_view line;
+		std::string_view stream = "hello world\r\n";
+
+		for (size_t i = 0; i + 1 < stream.size(); i++) {
+			buffer.append(stream.substr(i, 1));
+			CHECK(!buffer.hasLine());
+		}
+
+		buffer.append(stream.substr(stream.size() - 1));
+		CHECK(buffer.hasLine());
+		CHECK(buffer.nextLine(line) && line == "hello world");
+	}
+
+	void testOversizedLine()
+	{
+		m0st4fa::LineBuffer buffer{ 16 };
+		std::string_view line;
+		std::string stream = std::string(40, 'x') + "\r\nnext\r\n";
+
+		// the buffer takes what fits; a full buffer without a line ending is handed out as a piece of the line
+		size_t taken = buffer.append(stream);
+		CHECK(taken == 16);
+		CHECK(buffer.hasLine());
+		CHECK(buffer.nextLine(line) && line == std::string(16, 'x'));
+
+		std::string_view rest = std::string_view{ stream }.substr(taken);
+		rest.remove_prefix(buffer.append(rest));
+		CHECK(buffer.nextLine(line) && line == std::string(16, 'x'));
+
+		rest.remove_prefix(buffer.append(rest));
+		CHECK(buffer.nextLine(line) && line == std::string(8, 'x'));
+
+		rest.remove_prefix(buffer.append(rest));
+		CHECK(rest.empty());
+		CHECK(buffer.nextLine(line) && line == "next");
+		CHECK(!buffer.hasLine());
+	}
+
+	void testCompactionKeepsPartialLine()
+	{
+		m0st4fa::LineBuffer buffer{ 16 };
+		std::string_view line;
+
+		CHECK(buffer.append("0123456789\nabcde") == 16);
+		CHECK(buffer.nextLine(line) && line == "0123456789");
+		CHECK(!buffer.hasLine());
+
+		// the full buffer moves the partial line to its front to make room
+		CHECK(buffer.append("fgh\n") == 4);
+		CHECK(buffer.nextLine(line) && line == "abcdefgh");
+		CHECK(buffer.size() == 0);
+	}
+
+	void testFrames()
+	{
+		m0st4fa::LineBuffer buffer;
+		m0st4fa::FrameHeader header;
+		std::string_view payload;
+
+		std::string stream = frameOf("first") + frameOf("") + frameOf("third", m0st4fa::MessageType::PING);
+		buffer.append(stream);
+
+		CHECK(buffer.hasFrame());
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::COMPLETE);
+		CHECK(payload == "first" && header.type == m0st4fa::MessageType::MESSAGE && header.sender == 3);
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::COMPLETE && payload.empty());
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::COMPLETE);
+		CHECK(payload == "third" && header.type == m0st4fa::MessageType::PING);
+		CHECK(!buffer.hasFrame());
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::PARTIAL);
+	}
+
+	void testPartialFrames()
+	{
+		m0st4fa::LineBuffer buffer;
+		m0st4fa::FrameHeader header;
+		std::string_view payload;
+		std::string frame = frameOf("payload");
+
+		// part of the header, then the rest of the header and part of the payload
+		buffer.append(std::string_view{ frame }.substr(0, 4));
+		CHECK(!buffer.hasFrame());
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::PARTIAL);
+
+		buffer.append(std::string_view{ frame }.substr(4, 8));
+		CHECK(!buffer.hasFrame());
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::PARTIAL);
+		CHECK(buffer.size() == 12); // nothing has been taken
+
+		buffer.append(std::string_view{ frame }.substr(12));
+		CHECK(buffer.hasFrame());
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::COMPLETE && payload == "payload");
+	}
+
+	void testOversizedFrame()
+	{
+		m0st4fa::LineBuffer buffer{ 64 };
+		m0st4fa::FrameHeader header;
+		std::string_view payload;
+
+		// the largest frame that fits, then one that never can
+		buffer.append(frameOf(std::string(64 - m0st4fa::FrameHeader::SIZE, 'x')));
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::COMPLETE && payload.size() == 64 - m0st4fa::FrameHeader::SIZE);
+
+		buffer.append(frameOf(std::string(64, 'x')).substr(0, m0st4fa::FrameHeader::SIZE));
+		CHECK(buffer.hasFrame());
+		CHECK(buffer.nextFrame(header, payload) == m0st4fa::FrameStatus::OVERSIZED);
+		CHECK(header.length == 64);
+	}
+
+}
+
+int main()
+{
+	RUN(testLines);
+	RUN(testLineByteByByte);
+	RUN(testOversizedLine);
+	RUN(testCompactionKeepsPartialLine);
+	RUN(testFrames);
+	RUN(testPartialFrames);
+	RUN(testOversizedFrame);
+
+	return m0st4fa::test::exitCode();
+}
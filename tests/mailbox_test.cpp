@@ -0,0 +1,120 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "mailbox.h"
+
+// Checks the shard mailbox: values come out in the order they went in, a full mailbox refuses values without taking
+// them, positions wrap around the ring, and concurrent producers lose nothing and keep their own order.
+
+namespace {
+
+	void testOrderAndBound()
+	{
+		m0st4fa::Mailbox<std::string> mailbox{ 5 }; // rounded up to 8
+
+		for (int i = 0; i < 8; i++) {
+			std::string value = std::to_string(i);
+			CHECK(mailbox.push(value));
+		}
+
+		std::string refused = "refused";
+		CHECK(!mailbox.push(refused));
+		CHECK(refused == "refused");
+
+		std::string out;
+
+		for (int i = 0; i < 8; i++) {
+			CHECK(mailbox.pop(out));
+			CHECK(out == std::to_string(i));
+		}
+
+		CHECK(!mailbox.pop(out));
+
+		// room again once values have been taken
+		CHECK(mailbox.push(refused));
+		CHECK(mailbox.pop(out) && out == "refused");
+	}
+
+	void testWrapAround()
+	{
+		m0st4fa::Mailbox<uint64_t> mailbox{ 4 };
+		uint64_t next = 0;
+		bool inOrder = true;
+
+		for (uint64_t i = 0; i < 10000; i++) {
+			uint64_t value = i;
+			CHECK(mailbox.push(value));
+
+			// fills the ring every fourth push, then empties it
+			uint64_t out;
+			if (i % 4 == 3)
+				while (mailbox.pop(out))
+					inOrder = inOrder && out == next++;
+		}
+
+		CHECK(inOrder);
+		CHECK(next == 10000);
+	}
+
+	void testProducers()
+	{
+		constexpr uint64_t PRODUCERS = 4;
+		constexpr uint64_t VALUES = 100000; // per producer
+
+		m0st4fa::Mailbox<uint64_t> mailbox{ 64 }; // small, so that producers find it full
+		std::atomic<bool> go = false;
+		std::vector<std::thread> producers;
+
+		for (uint64_t p = 0; p < PRODUCERS; p++)
+			producers.emplace_back([&, p]() {
+				while (!go.load())
+					std::this_thread::yield();
+
+				for (uint64_t i = 0; i < VALUES; i++) {
+					uint64_t value = (p << 32) | i;
+
+					while (!mailbox.push(value))
+						std::this_thread::yield();
+				}
+				});
+
+		go = true;
+
+		std::vector<uint64_t> next(PRODUCERS, 0);
+		uint64_t received = 0;
+		bool inOrder = true;
+
+		while (received < PRODUCERS * VALUES) {
+			uint64_t value;
+
+			if (!mailbox.pop(value)) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			uint64_t p = value >> 32;
+			inOrder = inOrder && p < PRODUCERS && (value & 0xFFFFFFFF) == next[p]++;
+			received++;
+		}
+
+		for (std::thread& producer : producers)
+			producer.join();
+
+		uint64_t value;
+		CHECK(!mailbox.pop(value));
+		CHECK(inOrder);
+		CHECK(received == PRODUCERS * VALUES);
+	}
+
+}
+
+int main()
+{
+	RUN(testOrderAndBound);
+	RUN(testWrapAround);
+	RUN(testProducers);
+
+	return m0st4fa::test::exitCode();
+}
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "framing.h"
+#include "logger.h"
+#include "message_log.h"
+
+// Reopens logs left in the states a crash can leave them in (a torn record at the end, index entries lost or garbled
+// because the index is not synced) and checks that every committed message is read back, in order, and that the log
+// goes on from where it has stopped.
+
+#ifndef _WIN32
+
+namespace {
+
+	namespace fs = std::filesystem;
+
+	constexpr size_t MESSAGES = 700;
+	constexpr size_t PAYLOAD = 1000; // with a small segment size, the last segment holds a few records and index entries
+
+	const fs::path DIRECTORY = fs::temp_directory_path() / "message_log_test";
+
+	m0st4fa::LogPolicy policy()
+	{
+		m0st4fa::LogPolicy policy;
+		policy.directory = DIRECTORY.string();
+		policy.segmentSize = 256 * 1024;
+		policy.commitMessages = 16;
+		policy.commitInterval = std::chrono::milliseconds{ 1 };
+
+		return policy;
+	}
+
+	/**
+	 * @brief The payload of message `i`: its number, then padding.
+	 */
+	std::string payloadOf(const size_t i)
+	{
+		std::string payload = std::to_string(i) + "|";
+		payload.resize(PAYLOAD, 'x');
+
+		return payload;
+	}
+
+	m0st4fa::Frame frameOf(const size_t i)
+	{
+		std::string payload = payloadOf(i);
+
+		m0st4fa::PooledString frame;
+		frame.resize(m0st4fa::FrameHeader::SIZE);
+		m0st4fa::FrameHeader{ (uint32_t)payload.size(), m0st4fa::MessageType::MESSAGE, 7 }.encode(frame.data());
+		frame.append(payload).append("\b\b7: ").append(payload).append("\r\n> ");
+
+		return m0st4fa::makeFrame(std::move(frame));
+	}
+
+	/**
+	 * @brief Appends messages `from` to `to` (excluded) to the log, and closes it. They are committed in batches of `BATCH`, so that the log moves on to a new segment every few batches.
+	 */
+	void append(const size_t from, const size_t to)
+	{
+		constexpr size_t BATCH = 50;
+
+		m0st4fa::MessageLog log;
+		CHECK(log.open(policy()));
+
+		for (size_t i = from; i < to; i++) {
+			log.append("lobby", frameOf(i));
+
+			if ((i - from + 1) % BATCH == 0)
+				while (log.stats().committed != i - from + 1)
+					std::this_thread::yield();
+		}
+
+		log.close();
+		CHECK(log.stats().committed == to - from);
+	}
+
+	/**
+	 * @brief Reopens the log and checks that it holds messages `0` to `count` (excluded), and that its last `recent` messages are read back in order.
+	 */
+	void expectMessages(const size_t count, const size_t recent = SIZE_MAX)
+	{
+		m0st4fa::MessageLog log;
+		CHECK(log.open(policy()));
+
+		size_t next = count - std::min(count, recent);
+		bool inOrder = true;
+
+		size_t read = log.readRecent(recent, [&](const m0st4fa::MessageLog::Record& record) {
+			inOrder = inOrder && record.sequence == next && record.channel == "lobby" && record.sender == 7 && record.payload == payloadOf(next);
+			next++;
+			});
+
+		CHECK(read == std::min(count, recent));
+		CHECK(inOrder);
+	}
+
+	fs::path lastSegment(const char* extension)
+	{
+		fs::path last;
+
+		for (const fs::directory_entry& entry : fs::directory_iterator(DIRECTORY))
+			if (entry.path().extension() == extension && entry.path() > last)
+				last = entry.path();
+
+		return last;
+	}
+
+	/**
+	 * @brief Starts every test with a log of `MESSAGES` messages whose last segment has an index.
+	 */
+	void setUp()
+	{
+		fs::remove_all(DIRECTORY);
+		append(0, MESSAGES);
+
+		CHECK(lastSegment(".log").filename() != "00000000000000000000.log");
+		CHECK(fs::file_size(lastSegment(".idx")) != 0);
+	}
+
+	void testReopen()
+	{
+		setUp();
+		expectMessages(MESSAGES);
+
+		append(MESSAGES, MESSAGES + 10);
+		expectMessages(MESSAGES + 10);
+	}
+
+	void testTornRecord()
+	{
+		setUp();
+		fs::path segment = lastSegment(".log");
+		uintmax_t size = fs::file_size(segment);
+
+		// half a record: its size and some of its checksum
+		std::ofstream{ segment, std::ios::binary | std::ios::app } << std::string("\x40\x04\x00\x00\x12\x34", 6);
+
+		expectMessages(MESSAGES);
+		CHECK(fs::file_size(segment) == size);
+
+		append(MESSAGES, MESSAGES + 10);
+		expectMessages(MESSAGES + 10);
+	}
+
+	void testZeroedIndex()
+	{
+		setUp();
+		fs::path segment = lastSegment(".log");
+		fs::path index = lastSegment(".idx");
+		uintmax_t size = fs::file_size(segment);
+
+		// the blocks of the index were allocated, but its data never reached the disk
+		std::ofstream{ index, std::ios::binary | std::ios::trunc } << std::string(fs::file_size(index) + 16, '\0');
+
+		expectMessages(MESSAGES);
+		CHECK(fs::file_size(segment) == size);
+
+		append(MESSAGES, MESSAGES + 10);
+		expectMessages(MESSAGES + 10);
+	}
+
+	void testGarbledIndex()
+	{
+		setUp();
+		fs::path segment = lastSegment(".log");
+		fs::path index = lastSegment(".idx");
+		uintmax_t size = fs::file_size(segment);
+
+		// the last entry points into the middle of a record
+		std::fstream file{ index, std::ios::binary | std::ios::in | std::ios::out };
+		uint64_t entry[2];
+		file.seekg(-(std::streamoff)sizeof(entry), std::ios::end);
+		file.read((char*)entry, sizeof(entry));
+		entry[1] += 3;
+		file.seekp(-(std::streamoff)sizeof(entry), std::ios::end);
+		file.write((const char*)entry, sizeof(entry));
+		file.close();
+
+		expectMessages(MESSAGES);
+		CHECK(fs::file_size(segment) == size);
+
+		append(MESSAGES, MESSAGES + 10);
+		expectMessages(MESSAGES + 10);
+	}
+
+	void testGarbledOlderIndex()
+	{
+		setUp();
+
+		// the index of the first segment leads `readRecent` into the middle of a record
+		uint64_t entry[2] = { 100, 12345 };
+		std::ofstream{ DIRECTORY / "00000000000000000000.idx", std::ios::binary | std::ios::trunc }.write((const char*)entry, sizeof(entry));
+
+		expectMessages(MESSAGES, MESSAGES - 150);
+	}
+
+}
+
+int main()
+{
+	RUN(testReopen);
+	RUN(testTornRecord);
+	RUN(testZeroedIndex);
+	RUN(testGarbledIndex);
+	RUN(testGarbledOlderIndex);
+
+	fs::remove_all(DIRECTORY);
+	m0st4fa::Logger::global().flush();
+
+	return m0st4fa::test::exitCode();
+}
+
+#else
+
+int main()
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include <string>
+#include "check.h"
+#include "include/nickname.h"
+
+// Checks the nickname registry: nicknames are unique and looked up regardless of case, a connection may change the
+// case of its own nickname, and the names clients may pick exclude guest nicknames in any case.
+
+namespace {
+
+	const m0st4fa::NicknameOwner ALICE{ nullptr, 4, 1 };
+	const m0st4fa::NicknameOwner BOB{ nullptr, 5, 1 };
+
+	void testClaimIgnoresCase()
+	{
+		m0st4fa::NicknameRegistry registry;
+		m0st4fa::NicknameOwner owner;
+
+		CHECK(registry.claim("Alice", ALICE));
+		CHECK(!registry.claim("alice", BOB));
+		CHECK(!registry.claim("ALICE", BOB));
+
+		CHECK(registry.find("aLiCe", owner));
+		CHECK(owner.fd == ALICE.fd && owner.generation == ALICE.generation);
+		CHECK(!registry.find("Alicia", owner));
+
+		registry.release("ALICE");
+		CHECK(!registry.find("Alice", owner));
+		CHECK(registry.claim("alice", BOB));
+	}
+
+	void testRename()
+	{
+		m0st4fa::NicknameRegistry registry;
+		m0st4fa::NicknameOwner owner;
+
+		registry.claim("Alice", ALICE);
+		registry.claim("Bob", BOB);
+
+		// taken by another connection, in another case
+		CHECK(!registry.rename("Alice", "BOB", ALICE));
+		CHECK(registry.find("bob", owner) && owner.fd == BOB.fd);
+
+		// the case of its own nickname
+		CHECK(registry.rename("Alice", "ALICE", ALICE));
+		CHECK(registry.find("alice", owner) && owner.fd == ALICE.fd);
+
+		CHECK(registry.rename("ALICE", "Carol", ALICE));
+		CHECK(!registry.find("alice", owner));
+		CHECK(registry.find("CAROL", owner) && owner.fd == ALICE.fd);
+		CHECK(registry.claim("Alice", BOB));
+	}
+
+	void testTooLongNames()
+	{
+		m0st4fa::NicknameRegistry registry;
+		m0st4fa::NicknameOwner owner;
+		std::string longest(m0st4fa::NicknameRegistry::MAX_NAME_LENGTH, 'a');
+
+		CHECK(registry.claim(longest, ALICE));
+		CHECK(registry.find(longest, owner));
+
+		// a longer name is not the longest one cut short
+		CHECK(!registry.find(longest + "a", owner));
+	}
+
+	void testValidNames()
+	{
+		using m0st4fa::NicknameRegistry;
+
+		CHECK(NicknameRegistry::isValidName("alice"));
+		CHECK(NicknameRegistry::isValidName("Al-ice_2"));
+		CHECK(NicknameRegistry::isValidName("guest"));
+		CHECK(NicknameRegistry::isValidName("guestbook"));
+		CHECK(NicknameRegistry::isValidName("guest1a"));
+		CHECK(NicknameRegistry::isValidName(std::string(NicknameRegistry::MAX_NAME_LENGTH, 'a')));
+
+		CHECK(!NicknameRegistry::isValidName(""));
+		CHECK(!NicknameRegistry::isValidName("2alice"));
+		CHECK(!NicknameRegistry::isValidName("_alice"));
+		CHECK(!NicknameRegistry::isValidName("al ice"));
+		CHECK(!NicknameRegistry::isValidName("al\xC3\xA9"));
+		CHECK(!NicknameRegistry::isValidName(std::string(NicknameRegistry::MAX_NAME_LENGTH + 1, 'a')));
+
+		// guest nicknames belong to the connections they are given to, whatever the case
+		CHECK(!NicknameRegistry::isValidName("guest12"));
+		CHECK(!NicknameRegistry::isValidName("GUEST12"));
+		CHECK(!NicknameRegistry::isValidName("Guest7"));
+	}
+
+}
+
+int main()
+{
+	RUN(testClaimIgnoresCase);
+	RUN(testRename);
+	RUN(testTooLongNames);
+	RUN(testValidNames);
+
+	return m0st4fa::test::exitCode();
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <vector>
+#include "check.h"
+#include "slab.h"
+
+// Checks the connection table: records found by key and by handle, keys kept packed as records are erased, records
+// that never move, and handles that go stale once their key is reused.
+
+namespace {
+
+	struct Record {
+		int value = 0;
+	};
+
+	std::vector<int> sortedKeys(const m0st4fa::Slab<Record>& slab)
+	{
+		std::vector<int> keys = slab.keys();
+		std::sort(keys.begin(), keys.end());
+
+		return keys;
+	}
+
+	void testInsertFind()
+	{
+		m0st4fa::Slab<Record> slab;
+
+		for (int key : { 3, 0, 700, 5 })
+			slab.insert(key).value = key * 10;
+
+		CHECK(slab.size() == 4);
+		CHECK(slab.find(700) != nullptr && slab.find(700)->value == 7000);
+		CHECK(slab.find(3)->value == 30);
+		CHECK(slab.find(4) == nullptr);
+		CHECK(slab.find(-1) == nullptr);
+		CHECK(slab.find(100000) == nullptr);
+
+		// inserting a key in use keeps its record
+		slab.insert(3);
+		CHECK(slab.size() == 4);
+		CHECK(slab.find(3)->value == 30);
+	}
+
+	void testEraseKeepsKeysPacked()
+	{
+		m0st4fa::Slab<Record> slab;
+
+		for (int key = 0; key < 10; key++)
+			slab.insert(key);
+
+		CHECK(slab.erase(4));
+		CHECK(slab.erase(0));
+		CHECK(!slab.erase(4));
+		CHECK(!slab.erase(100000));
+
+		CHECK(slab.size() == 8);
+		CHECK((sortedKeys(slab) == std::vector<int>{ 1, 2, 3, 5, 6, 7, 8, 9 }));
+		CHECK(slab.find(4) == nullptr);
+
+		// a freed slot starts over with a fresh record
+		slab.find(9)->value = 1;
+		slab.erase(9);
+		CHECK(slab.insert(9).value == 0);
+	}
+
+	void testRecordsDoNotMove()
+	{
+		m0st4fa::Slab<Record> slab;
+		Record* first = &slab.insert(1);
+		first->value = 42;
+
+		for (int key = 2; key < 5000; key++)
+			slab.insert(key);
+
+		for (int key = 2; key < 5000; key += 2)
+			slab.erase(key);
+
+		CHECK(slab.find(1) == first);
+		CHECK(first->value == 42);
+	}
+
+	void testHandleGenerations()
+	{
+		m0st4fa::Slab<Record> slab;
+		slab.insert(7).value = 1;
+
+		m0st4fa::Slab<Record>::Handle old = slab.handle(7);
+		CHECK(slab.find(old) == slab.find(7));
+
+		slab.erase(7);
+		CHECK(slab.find(old) == nullptr);
+
+		// the key is reused by another record, which the old handle must not reach
+		slab.insert(7).value = 2;
+		m0st4fa::Slab<Record>::Handle current = slab.handle(7);
+
+		CHECK(slab.find(old) == nullptr);
+		CHECK(current.generation != old.generation);
+		CHECK(slab.find(current) != nullptr && slab.find(current)->value == 2);
+
+		CHECK(slab.find(m0st4fa::Slab<Record>::Handle{}) == nullptr);
+	}
+
+}
+
+int main()
+{
+	RUN(testInsertFind);
+	RUN(testEraseKeepsKeysPacked);
+	RUN(testRecordsDoNotMove);
+	RUN(testHandleGenerations);
+
+	return m0st4fa::test::exitCode();
+}
@@ -0,0 +1,152 @@
+#include <vector>
+#include "check.h"
+#include "timing_wheel.h"
+
+// Checks the timing wheel against explicit times: timers never expire early and at most a tick late, timers a turn
+// or more away wait for their turn, cancelled timers never fire (even when cancelled by the callback of another timer
+// of the same tick), ids go stale once their timer is reused, and callbacks may arm new timers.
+
+namespace {
+
+	using Clock = m0st4fa::TimingWheel::Clock;
+	using std::chrono::milliseconds;
+
+	constexpr milliseconds TICK{ 100 };
+	constexpr size_t SLOTS = 8; // a turn of the wheel is 800 ms
+
+	/**
+	 * @brief A wheel, and the time it starts at (every timer of a test is relative to it.)
+	 */
+	struct Fixture {
+		m0st4fa::TimingWheel wheel{ TICK, SLOTS };
+		Clock::time_point start = Clock::now();
+		std::vector<uint64_t> fired;
+
+		size_t advanceTo(const milliseconds at) {
+			return this->wheel.advance(this->start + at, [this](const uint64_t data) { this->fired.push_back(data); });
+		}
+	};
+
+	void testNotEarlyNorLate()
+	{
+		Fixture f;
+		f.wheel.arm(f.start + milliseconds{ 250 }, 1);
+
+		CHECK(f.advanceTo(milliseconds{ 200 }) == 0);
+		CHECK(f.wheel.size() == 1);
+
+		CHECK(f.advanceTo(milliseconds{ 400 }) == 1);
+		CHECK((f.fired == std::vector<uint64_t>{ 1 }));
+		CHECK(f.wheel.size() == 0);
+		CHECK(f.wheel.timeout(f.start) == -1);
+	}
+
+	void testLaterTurns()
+	{
+		Fixture f;
+		f.wheel.arm(f.start + milliseconds{ 2050 }, 1); // in the same slot as 450 ms, two turns later
+		f.wheel.arm(f.start + milliseconds{ 450 }, 2);
+
+		CHECK(f.advanceTo(milliseconds{ 600 }) == 1);
+		CHECK(f.advanceTo(milliseconds{ 1400 }) == 0);
+		CHECK(f.advanceTo(milliseconds{ 2200 }) == 1);
+		CHECK((f.fired == std::vector<uint64_t>{ 2, 1 }));
+	}
+
+	void testLongStall()
+	{
+		Fixture f;
+
+		for (uint64_t i = 0; i < 100; i++)
+			f.wheel.arm(f.start + milliseconds{ 10 + 37 * i }, i);
+
+		// far more than a turn at once: every slot is visited once
+		CHECK(f.advanceTo(milliseconds{ 60000 }) == 100);
+		CHECK(f.wheel.size() == 0);
+	}
+
+	void testCancel()
+	{
+		Fixture f;
+		m0st4fa::TimingWheel::TimerId id = f.wheel.arm(f.start + milliseconds{ 300 }, 1);
+
+		CHECK(f.wheel.cancel(id));
+		CHECK(!f.wheel.cancel(id));
+		CHECK(f.wheel.size() == 0);
+		CHECK(f.advanceTo(milliseconds{ 1000 }) == 0);
+
+		// the id of a timer that has expired is stale too
+		id = f.wheel.arm(f.start + milliseconds{ 1200 }, 2);
+		CHECK(f.advanceTo(milliseconds{ 1400 }) == 1);
+		CHECK(!f.wheel.cancel(id));
+	}
+
+	void testStaleIdAfterReuse()
+	{
+		Fixture f;
+		m0st4fa::TimingWheel::TimerId old = f.wheel.arm(f.start + milliseconds{ 300 }, 1);
+		f.wheel.cancel(old);
+
+		// takes the array slot of the cancelled timer
+		m0st4fa::TimingWheel::TimerId reused = f.wheel.arm(f.start + milliseconds{ 300 }, 2);
+		CHECK(reused.index == old.index);
+
+		CHECK(!f.wheel.cancel(old));
+		CHECK(f.wheel.size() == 1);
+		CHECK(f.advanceTo(milliseconds{ 500 }) == 1);
+		CHECK((f.fired == std::vector<uint64_t>{ 2 }));
+	}
+
+	void testCancelDuringAdvance()
+	{
+		Fixture f;
+		m0st4fa::TimingWheel::TimerId ids[2] = {
+			f.wheel.arm(f.start + milliseconds{ 250 }, 0),
+			f.wheel.arm(f.start + milliseconds{ 250 }, 1),
+		};
+		bool cancelled = false;
+
+		// whichever fires first cancels the other, which is in the slot being visited
+		size_t expired = f.wheel.advance(f.start + milliseconds{ 400 }, [&](const uint64_t data) {
+			cancelled = f.wheel.cancel(ids[1 - data]);
+			});
+
+		CHECK(expired == 1);
+		CHECK(cancelled);
+		CHECK(f.wheel.size() == 0);
+	}
+
+	void testArmDuringAdvance()
+	{
+		Fixture f;
+		f.wheel.arm(f.start + milliseconds{ 250 }, 1);
+
+		// the callback arms a timer that is due already (like an idle check running late): it must wait for the next tick
+		size_t expired = f.wheel.advance(f.start + milliseconds{ 350 }, [&](const uint64_t data) {
+			f.fired.push_back(data);
+
+			if (data == 1)
+				f.wheel.arm(f.start + milliseconds{ 300 }, 2);
+			});
+
+		CHECK(expired == 1);
+		CHECK(f.wheel.size() == 1);
+
+		CHECK(f.advanceTo(milliseconds{ 500 }) == 1);
+		CHECK((f.fired == std::vector<uint64_t>{ 1, 2 }));
+	}
+
+}
+
+int main()
+{
+	RUN(testNotEarlyNorLate);
+	RUN(testLaterTurns);
+	RUN(testLongStall);
+	RUN(testCancel);
+	RUN(testStaleIdAfterReuse);
+	RUN(testCancelDuringAdvance);
+	RUN(testArmDuringAdvance);
+
+	return m0st4fa::test::exitCode();
+}
@@ -0,0 +1,132 @@
+#include <bit>
+#include "timing_wheel.h"
+
+namespace m0st4fa {
+
+	TimingWheel::TimingWheel(const Clock::duration tick, const size_t slots) : mTick{ tick }, mMask{ (uint32_t)std::bit_ceil(std::max<size_t>(slots, 2)) - 1 }
+	{
+		// one more list for the slot being visited
+		this->mLists.assign((size_t)this->mMask + 2, NONE);
+	}
+
+	/**
+	 * @returns The tick `time` falls in.
+	 */
+	uint64_t TimingWheel::_tick_of(const Clock::time_point time) const
+	{
+		return time <= this->mStart ? 0 : (uint64_t)((time - this->mStart) / this->mTick);
+	}
+
+	/**
+	 * @brief Puts timer `index` at the front of list `list`.
+	 * @returns void
+	 */
+	void TimingWheel::_link(const uint32_t index, const uint32_t list)
+	{
+		Timer& timer = this->mTimers[index];
+		timer.list = list;
+		timer.prev = NONE;
+		timer.next = this->mLists[list];
+
+		if (timer.next != NONE)
+			this->mTimers[timer.next].prev = index;
+
+		this->mLists[list] = index;
+	}
+
+	/**
+	 * @brief Takes timer `index` out of its list.
+	 * @returns void
+	 */
+	void TimingWheel::_unlink(const uint32_t index)
+	{
+		Timer& timer = this->mTimers[index];
+
+		if (timer.prev != NONE)
+			this->mTimers[timer.prev].next = timer.next;
+		else
+			this->mLists[timer.list] = timer.next;
+
+		if (timer.next != NONE)
+			this->mTimers[timer.next].prev = timer.prev;
+	}
+
+	/**
+	 * @brief Frees timer `index`, which is in no list, and makes the ids that refer to it stale.
+	 * @returns void
+	 */
+	void TimingWheel::_release(const uint32_t index)
+	{
+		Timer& timer = this->mTimers[index];
+		timer.list = NONE;
+		timer.generation++;
+		timer.next = this->mFree;
+		this->mFree = index;
+		this->mArmed--;
+	}
+
+	/**
+	 * @brief Arms a timer.
+	 * @param[in] when When it expires; it expires on the next tick if it is due already.
+	 * @param[in] data Handed to the callback of `advance` when it expires.
+	 * @returns The id of the timer, to cancel it.
+	 */
+	TimingWheel::TimerId TimingWheel::arm(const Clock::time_point when, const uint64_t data)
+	{
+		uint32_t index = this->mFree;
+
+		if (index != NONE)
+			this->mFree = this->mTimers[index].next;
+		else {
+			index = (uint32_t)this->mTimers.size();
+			this->mTimers.emplace_back();
+		}
+
+		// rounded up, so that it never expires early
+		uint64_t due = _tick_of(when);
+		if (this->mStart + due * this->mTick < when)
+			due++;
+
+		Timer& timer = this->mTimers[index];
+		timer.due = std::max(due, this->mTicked + 1);
+		timer.data = data;
+		_link(index, (uint32_t)(timer.due & this->mMask));
+		this->mArmed++;
+
+		return TimerId{ index, timer.generation };
+	}
+
+	/**
+	 * @brief Cancels the timer `id`, unless it has expired (or been cancelled) already.
+	 * @returns Whether the timer was armed.
+	 */
+	bool TimingWheel::cancel(const TimerId id)
+	{
+		if (id.index >= this->mTimers.size())
+			return false;
+
+		Timer& timer = this->mTimers[id.index];
+
+		if (timer.generation != id.generation || timer.list == NONE)
+			return false;
+
+		_unlink(id.index);
+		_release(id.index);
+
+		return true;
+	}
+
+	/**
+	 * @returns How many milliseconds there are until the next tick, for the main loop to wait at most; `-1` if no timer is armed. Ticking while no timer is due costs one visit of an empty (or nearly empty) slot.
+	 */
+	int TimingWheel::timeout(const Clock::time_point now) const
+	{
+		if (this->mArmed == 0)
+			return -1;
+
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(this->mStart + (this->mTicked + 1) * this->mTick - now);
+
+		return left.count() > 0 ? (int)left.count() : 0;
+	}
+
+}
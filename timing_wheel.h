@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Hashed timing wheel: timers are hashed by the tick they expire at into one of `slots` lists, so that arming and cancelling a timer take constant time, and each tick only visits the timers of its slot (those due then, and those due a whole turn of the wheel or more later.) Timers live in one array and are recycled, so once it has grown, arming allocates nothing. Timers expire on the first `advance` after their tick, so they are late by less than a tick.
+	 */
+	class TimingWheel {
+
+		static constexpr uint32_t NONE = UINT32_MAX;
+
+	public:
+
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Identifies an armed timer; it is stale once the timer has expired or been cancelled (its slot in the array may have been reused since, with another generation.)
+		 */
+		struct TimerId {
+			uint32_t index = NONE;
+			uint32_t generation = 0;
+		};
+
+	private:
+
+		struct Timer {
+			uint64_t due = 0; // the tick it expires at
+			uint64_t data = 0; // handed to the callback of `advance`
+			uint32_t prev = NONE;
+			uint32_t next = NONE; // also chains the free timers
+			uint32_t list = NONE; // the slot it is in (`EXPIRING` while its slot is being visited); `NONE` while it is free
+			uint32_t generation = 0;
+		};
+
+		Clock::duration mTick;
+		Clock::time_point mStart = Clock::now();
+		uint64_t mTicked = 0; // the last tick visited
+		uint32_t mMask; // the number of slots, minus one
+		std::vector<uint32_t> mLists; // the first timer of every slot, then of the slot being visited
+		std::vector<Timer> mTimers;
+		uint32_t mFree = NONE;
+		size_t mArmed = 0;
+
+		uint32_t _expiring() const {
+			return this->mMask + 1;
+		}
+
+		uint64_t _tick_of(const Clock::time_point) const;
+		void _link(const uint32_t, const uint32_t);
+		void _unlink(const uint32_t);
+		void _release(const uint32_t);
+
+	public:
+
+		/**
+		 * @param[in] tick How much time a tick stands for: the resolution of the timers.
+		 * @param[in] slots The number of slots (rounded up to a power of 2); the wheel turns once every `slots` ticks.
+		 */
+		explicit TimingWheel(const Clock::duration tick = std::chrono::milliseconds{ 100 }, const size_t slots = 512);
+
+		TimerId arm(const Clock::time_point, const uint64_t);
+		bool cancel(const TimerId);
+		int timeout(const Clock::time_point) const;
+
+		/**
+		 * @brief Expires the timers due by `now`, calling `fn` with the data of each. `fn` may arm and cancel timers.
+		 * @param[in] now The current time.
+		 * @param[in] fn Function taking the `uint64_t` data of a timer.
+		 * @returns The number of timers that have expired.
+		 */
+		template <typename Fn>
+		size_t advance(const Clock::time_point now, Fn&& fn) {
+			uint64_t target = _tick_of(now);
+			size_t expired = 0;
+
+			// after a long stall, every slot is visited once, at the last tick that maps to it
+			uint64_t slots = (uint64_t)this->mMask + 1;
+			if (target - this->mTicked > slots)
+				this->mTicked = target - slots;
+
+			while (this->mTicked < target && this->mArmed != 0) {
+				uint32_t slot = (uint32_t)(++this->mTicked & this->mMask);
+				uint32_t expiring = _expiring();
+
+				// the slot is emptied first, so that the callbacks may cancel any timer in it
+				this->mLists[expiring] = std::exchange(this->mLists[slot], NONE);
+				for (uint32_t i = this->mLists[expiring]; i != NONE; i = this->mTimers[i].next)
+					this->mTimers[i].list = expiring;
+
+				while (this->mLists[expiring] != NONE) {
+					uint32_t index = this->mLists[expiring];
+					_unlink(index);
+
+					if (this->mTimers[index].due > this->mTicked) {
+						_link(index, slot); // due in a later turn
+						continue;
+					}
+
+					uint64_t data = this->mTimers[index].data;
+					_release(index);
+					expired++;
+
+					fn(data);
+				}
+			}
+
+			this->mTicked = std::max(this->mTicked, target);
+
+			return expired;
+		}
+
+		/**
+		 * @returns The number of armed timers.
+		 */
+		size_t size() const {
+			return this->mArmed;
+		}
+
+	};
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Token bucket: it gains `rate` tokens a second, and holds at most `burst` of them. The rate and the burst are passed in rather than kept, since every bucket of a server shares them. Tokens are added lazily, when the bucket is used, so an idle bucket costs nothing.
+	 *
+	 * Tokens may be taken beyond what the bucket holds (it goes into debt), so that a cost only known once it has been paid (e.g., the size of a message) can be charged afterwards; the bucket lets nothing through until the debt is paid back.
+	 */
+	struct TokenBucket {
+		double tokens = 0;
+		uint64_t refilledAt = 0; // nanoseconds, on any clock that does not go back
+
+		/**
+		 * @brief Fills the bucket up to `burst`.
+		 */
+		void fill(const double burst, const uint64_t now) {
+			this->tokens = burst;
+			this->refilledAt = now;
+		}
+
+		/**
+		 * @brief Adds the tokens gained since the last refill.
+		 */
+		void refill(const double rate, const double burst, const uint64_t now) {
+			if (now <= this->refilledAt)
+				return;
+
+			this->tokens = std::min(burst, this->tokens + rate * (double)(now - this->refilledAt) / 1e9);
+			this->refilledAt = now;
+		}
+
+		/**
+		 * @returns How many nanoseconds until the bucket holds at least `n` tokens (`0` if it does already.)
+		 */
+		uint64_t delay(const double rate, const double n) const {
+			if (this->tokens >= n)
+				return 0;
+
+			return (uint64_t)((n - this->tokens) / rate * 1e9) + 1;
+		}
+
+		void take(const double n) {
+			this->tokens -= n;
+		}
+	};
+
+}
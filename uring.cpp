@@ -0,0 +1,270 @@
+#include "uring.h"
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Creates a ring with (at least) `entries` submission slots and four times as many completion slots, since multishot requests post several completions each.
+	 * @param[in] entries The number of submission slots.
+	 */
+	IoUring::IoUring(const unsigned entries)
+	{
+		io_uring_params params{};
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = entries * 4;
+
+		this->mRingFd = (int)::syscall(__NR_io_uring_setup, entries, &params);
+
+		if (this->mRingFd < 0) {
+			LOG_CRITICAL("uring", "Could not create io_uring instance: {}", strerror(errno));
+			Logger::global().flush();
+			std::abort();
+		}
+
+		if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+			LOG_CRITICAL("uring", "The kernel is too old (IORING_FEAT_SINGLE_MMAP is not supported.)");
+			Logger::global().flush();
+			std::abort();
+		}
+
+		// the submission and completion rings share one mapping
+		size_t sqSz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		size_t cqSz = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		this->mRingSz = std::max(sqSz, cqSz);
+		this->mRingPtr = ::mmap(nullptr, this->mRingSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->mRingFd, IORING_OFF_SQ_RING);
+
+		this->mSqesSz = params.sq_entries * sizeof(io_uring_sqe);
+		this->mSqes = (io_uring_sqe*)::mmap(nullptr, this->mSqesSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->mRingFd, IORING_OFF_SQES);
+
+		if (this->mRingPtr == MAP_FAILED || this->mSqes == MAP_FAILED) {
+			LOG_CRITICAL("uring", "Could not map the rings: {}", strerror(errno));
+			Logger::global().flush();
+			std::abort();
+		}
+
+		char* ring = (char*)this->mRingPtr;
+
+		this->mSqHead = (unsigned*)(ring + params.sq_off.head);
+		this->mSqTail = (unsigned*)(ring + params.sq_off.tail);
+		this->mSqArray = (unsigned*)(ring + params.sq_off.array);
+		this->mSqMask = *(unsigned*)(ring + params.sq_off.ring_mask);
+		this->mSqEntries = params.sq_entries;
+		this->mSqLocalTail = *this->mSqTail;
+
+		this->mCqHead = (unsigned*)(ring + params.cq_off.head);
+		this->mCqTail = (unsigned*)(ring + params.cq_off.tail);
+		this->mCqMask = *(unsigned*)(ring + params.cq_off.ring_mask);
+		this->mCqes = (io_uring_cqe*)(ring + params.cq_off.cqes);
+	}
+
+	IoUring::~IoUring()
+	{
+		if (this->mBufRing != nullptr)
+			::munmap(this->mBufRing, this->mBufRingSz);
+
+		delete[] this->mBuffers;
+
+		::munmap(this->mSqes, this->mSqesSz);
+		::munmap(this->mRingPtr, this->mRingSz);
+		::close(this->mRingFd);
+	}
+
+	/**
+	 * @brief Makes every SQE handed out so far visible to the kernel.
+	 */
+	void IoUring::_publish()
+	{
+		std::atomic_ref<unsigned>{ *this->mSqTail }.store(this->mSqLocalTail, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Gets a zeroed submission entry. It is only sent to the kernel by the next call to `submit`.
+	 * @returns The entry; `nullptr` if the submission queue is full (call `submit` and try again.)
+	 */
+	io_uring_sqe* IoUring::getSqe()
+	{
+		unsigned head = std::atomic_ref<unsigned>{ *this->mSqHead }.load(std::memory_order_acquire);
+
+		if (this->mSqLocalTail - head >= this->mSqEntries)
+			return nullptr;
+
+		unsigned index = this->mSqLocalTail & this->mSqMask;
+		this->mSqArray[index] = index;
+		this->mSqLocalTail++;
+
+		io_uring_sqe* sqe = &this->mSqes[index];
+		memset(sqe, 0, sizeof(io_uring_sqe));
+
+		return sqe;
+	}
+
+	/**
+	 * @brief Submits every pending entry with a single system call, and optionally waits for completions.
+	 * @param[in] waitNr The number of completions to wait for.
+	 * @returns The number of entries submitted; `-1` on error.
+	 */
+	int IoUring::submit(const unsigned waitNr)
+	{
+		this->_publish();
+
+		unsigned head = std::atomic_ref<unsigned>{ *this->mSqHead }.load(std::memory_order_acquire);
+		unsigned toSubmit = this->mSqLocalTail - head;
+		unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+		if (toSubmit == 0 && waitNr == 0)
+			return 0;
+
+		int rv = 0;
+		do {
+			rv = (int)::syscall(__NR_io_uring_enter, this->mRingFd, toSubmit, waitNr, flags, nullptr, 0);
+		} while (rv == -1 && errno == EINTR);
+
+		return rv;
+	}
+
+	/**
+	 * @brief Registers `count` receive buffers of `size` bytes each, from which the kernel picks one whenever a buffer-select receive completes.
+	 * @param[in] group The id under which the buffers are registered.
+	 * @param[in] count The number of buffers; it must be a power of 2.
+	 * @param[in] size The size of each buffer.
+	 * @returns The value returned by `io_uring_register`.
+	 */
+	int IoUring::setupBufferRing(const unsigned short group, const unsigned count, const unsigned size)
+	{
+		this->mBufRingSz = count * sizeof(io_uring_buf);
+		void* ring = ::mmap(nullptr, this->mBufRingSz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (ring == MAP_FAILED)
+			return -1;
+
+		this->mBufRing = (io_uring_buf_ring*)ring;
+		this->mBuffers = new char[(size_t)count * size];
+		this->mBufCount = count;
+		this->mBufSize = size;
+		this->mBufGroup = group;
+
+		io_uring_buf_reg reg{};
+		reg.ring_addr = (uint64_t)ring;
+		reg.ring_entries = count;
+		reg.bgid = group;
+
+		int rv = (int)::syscall(__NR_io_uring_register, this->mRingFd, IORING_REGISTER_PBUF_RING, &reg, 1);
+
+		if (rv != 0)
+			return rv;
+
+		for (unsigned i = 0; i < count; i++)
+			this->recycleBuffer((unsigned short)i);
+
+		return 0;
+	}
+
+	/**
+	 * @brief Gives provided buffer `bid` back to the kernel once its contents have been consumed.
+	 */
+	void IoUring::recycleBuffer(const unsigned short bid)
+	{
+		// the entries start at the beginning of the ring (the tail overlays the first one); `bufs` cannot be used, since
+		// C++ gives the empty struct in front of the flexible array a size and moves it to offset 8
+		io_uring_buf* buf = (io_uring_buf*)this->mBufRing + (this->mBufLocalTail & (this->mBufCount - 1));
+		buf->addr = (uint64_t)this->bufferAt(bid);
+		buf->len = this->mBufSize;
+		buf->bid = bid;
+
+		std::atomic_ref<unsigned short>{ this->mBufRing->tail }.store(++this->mBufLocalTail, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Prepares an accept that keeps posting one completion per accepted connection until it fails or is cancelled. The accepted sockets are non-blocking; the addresses of their peers are not asked for.
+	 */
+	void IoUring::prepareMultishotAccept(io_uring_sqe* sqe, const int listenFd, const uint64_t userData)
+	{
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->fd = listenFd;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_CLOEXEC | SOCK_NONBLOCK;
+		sqe->user_data = userData;
+	}
+
+	/**
+	 * @brief Prepares a receive that keeps posting one completion per chunk of data, each stored in a provided buffer.
+	 */
+	void IoUring::prepareMultishotRecv(io_uring_sqe* sqe, const int fd, const uint64_t userData)
+	{
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = fd;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = this->mBufGroup;
+		sqe->user_data = userData;
+	}
+
+	/**
+	 * @brief Prepares a poll that posts one completion every time `fd` becomes ready for `events`, until it is cancelled.
+	 */
+	void IoUring::prepareMultishotPoll(io_uring_sqe* sqe, const int fd, const unsigned events, const uint64_t userData)
+	{
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = fd;
+		sqe->len = IORING_POLL_ADD_MULTI;
+		sqe->poll32_events = events;
+		sqe->user_data = userData;
+	}
+
+	/**
+	 * @brief Prepares the cancellation of the request submitted with `target` as its user data. The cancelled request completes with `-ECANCELED`; the cancellation itself completes too, with `-ENOENT` if the request had completed already.
+	 */
+	void IoUring::prepareCancel(io_uring_sqe* sqe, const uint64_t target, const uint64_t userData)
+	{
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = target;
+		sqe->user_data = userData;
+	}
+
+	/**
+	 * @brief Prepares a send of `len` bytes at `buf`. The buffer must stay alive until the completion is reaped.
+	 */
+	void IoUring::prepareSend(io_uring_sqe* sqe, const int fd, const void* buf, const size_t len, const uint64_t userData)
+	{
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)buf;
+		sqe->len = (unsigned)len;
+		sqe->msg_flags = MSG_NOSIGNAL;
+		sqe->user_data = userData;
+	}
+
+	/**
+	 * @brief Prepares a gathered send of the buffers described by `msg`, with `flags` (besides `MSG_NOSIGNAL`.) The header, the buffer descriptions and the buffers must stay alive until the completion is reaped.
+	 */
+	void IoUring::prepareSendmsg(io_uring_sqe* sqe, const int fd, const msghdr* msg, const uint64_t userData, const int flags)
+	{
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)msg;
+		sqe->len = 1;
+		sqe->msg_flags = MSG_NOSIGNAL | flags;
+		sqe->user_data = userData;
+	}
+
+	/**
+	 * @brief Prepares a timer that completes (with `-ETIME`) once `ts` has elapsed. `ts` must stay alive until the request is submitted.
+	 */
+	void IoUring::prepareTimeout(io_uring_sqe* sqe, const __kernel_timespec* ts, const uint64_t userData)
+	{
+		sqe->opcode = IORING_OP_TIMEOUT;
+		sqe->fd = -1;
+		sqe->addr = (uint64_t)ts;
+		sqe->len = 1;
+		sqe->off = 0; // not a completion count; only the time matters
+		sqe->user_data = userData;
+	}
+
+}
+
+#endif
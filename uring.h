@@ -0,0 +1,108 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include "common.h"
+
+namespace m0st4fa {
+
+	/**
+	 * @brief Minimal io_uring wrapper talking to the kernel through raw system calls (no liburing dependency.) It owns the submission and completion rings and, optionally, one ring of kernel-provided receive buffers.
+	 */
+	class IoUring {
+
+		int mRingFd = -1;
+
+		// submission queue
+		unsigned* mSqHead = nullptr;
+		unsigned* mSqTail = nullptr;
+		unsigned* mSqArray = nullptr;
+		unsigned mSqMask = 0;
+		unsigned mSqEntries = 0;
+		unsigned mSqLocalTail = 0; // SQEs handed out but not published to the kernel yet
+		io_uring_sqe* mSqes = nullptr;
+
+		// completion queue
+		unsigned* mCqHead = nullptr;
+		unsigned* mCqTail = nullptr;
+		unsigned mCqMask = 0;
+		io_uring_cqe* mCqes = nullptr;
+
+		void* mRingPtr = nullptr;
+		size_t mRingSz = 0;
+		size_t mSqesSz = 0;
+
+		// provided receive buffers
+		io_uring_buf_ring* mBufRing = nullptr;
+		char* mBuffers = nullptr;
+		size_t mBufRingSz = 0;
+		unsigned mBufCount = 0;
+		unsigned mBufSize = 0;
+		unsigned short mBufGroup = 0;
+		unsigned short mBufLocalTail = 0;
+
+		void _publish();
+
+	public:
+
+		explicit IoUring(const unsigned entries = 4096);
+		~IoUring();
+
+		IoUring(const IoUring&) = delete;
+		IoUring& operator=(const IoUring&) = delete;
+
+		io_uring_sqe* getSqe();
+		int submit(const unsigned waitNr = 0);
+
+		int setupBufferRing(const unsigned short group, const unsigned count, const unsigned size);
+		void recycleBuffer(const unsigned short bid);
+
+		/**
+		 * @brief Gets provided buffer `bid` (as reported in the flags of a completion.)
+		 */
+		char* bufferAt(const unsigned short bid) const {
+			return this->mBuffers + (size_t)bid * this->mBufSize;
+		}
+
+		/**
+		 * @returns The id of the group the provided buffers were registered under.
+		 */
+		unsigned short getBufferGroup() const {
+			return this->mBufGroup;
+		}
+
+		void prepareMultishotAccept(io_uring_sqe*, const int, const uint64_t);
+		void prepareMultishotRecv(io_uring_sqe*, const int, const uint64_t);
+		void prepareSend(io_uring_sqe*, const int, const void*, const size_t, const uint64_t);
+		void prepareSendmsg(io_uring_sqe*, const int, const msghdr*, const uint64_t, const int = 0);
+		void prepareTimeout(io_uring_sqe*, const __kernel_timespec*, const uint64_t);
+		void prepareMultishotPoll(io_uring_sqe*, const int, const unsigned, const uint64_t);
+		void prepareCancel(io_uring_sqe*, const uint64_t, const uint64_t);
+
+		/**
+		 * @brief Calls `fn` for every available completion, then marks them all as consumed.
+		 * @param[in] fn Function taking a `const io_uring_cqe&`.
+		 * @returns The number of completions handled.
+		 */
+		template <typename Fn>
+		unsigned forEachCompletion(Fn&& fn) {
+			unsigned head = *this->mCqHead;
+			unsigned tail = std::atomic_ref<unsigned>{ *this->mCqTail }.load(std::memory_order_acquire);
+			unsigned count = 0;
+
+			for (; head != tail; head++, count++)
+				fn(this->mCqes[head & this->mCqMask]);
+
+			std::atomic_ref<unsigned>{ *this->mCqHead }.store(head, std::memory_order_release);
+
+			return count;
+		}
+
+	};
+
+}
+
+#endif